@@ -0,0 +1,208 @@
+#pragma once
+
+#include <messages-container/queues/spsc_ring.hpp>
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#ifndef COMMON_LOG_LEVEL
+#define COMMON_LOG_LEVEL 1
+#endif
+
+enum class LogLevel : uint8_t
+{
+    Trace,
+    Debug,
+    Info,
+    Warning,
+    Error,
+    Off
+};
+
+/// @brief Lowest level compiled in (-DCOMMON_LOG_LEVEL), a logAsync call below it compiles to nothing
+constexpr LogLevel LOG_LEVEL = static_cast<LogLevel>(COMMON_LOG_LEVEL);
+
+enum class LogSink : uint8_t
+{
+    Console,  // std::cout
+    TraceFile  // file set by AsyncLogger::traceTo, records are discarded while none is set
+};
+
+/// @brief Static description of a record, its address is the format id a record carries
+/// text has one {} per argument, the log thread substitutes them
+struct LogFormat
+{
+    LogLevel level;
+    LogSink sink;
+    std::string_view text;
+};
+
+namespace async_log_details
+{
+
+constexpr size_t MAX_ARGS = 6;
+
+enum class ArgKind : uint8_t
+{
+    Unsigned,
+    Signed,
+    Double,
+    Char
+};
+
+/// @brief One log call as it travels through a ring, arguments stay binary until the log thread formats them
+struct Record
+{
+    const LogFormat* format;
+    uint8_t count;
+    std::array<ArgKind, MAX_ARGS> kinds;
+    std::array<uint64_t, MAX_ARGS> args;
+};
+
+static_assert(sizeof(Record) == 64, "A record fills one cache line");
+
+constexpr size_t placeholders(std::string_view text)
+{
+    size_t count = 0;
+    for (size_t pos = text.find("{}"); pos != std::string_view::npos; pos = text.find("{}", pos + 2))
+    {
+        ++count;
+    }
+    return count;
+}
+
+template <typename T> constexpr ArgKind kind()
+{
+    static_assert(std::is_arithmetic_v<T>, "Only numbers are logged, a pointer may dangle before it is formatted");
+
+    if constexpr (std::is_same_v<T, char>)
+    {
+        return ArgKind::Char;
+    }
+    else if constexpr (std::is_floating_point_v<T>)
+    {
+        return ArgKind::Double;
+    }
+    else if constexpr (std::is_signed_v<T>)
+    {
+        return ArgKind::Signed;
+    }
+    else
+    {
+        return ArgKind::Unsigned;
+    }
+}
+
+template <typename T> uint64_t encode(T value)
+{
+    if constexpr (std::is_floating_point_v<T>)
+    {
+        return std::bit_cast<uint64_t>(static_cast<double>(value));
+    }
+    else if constexpr (std::is_signed_v<T>)
+    {
+        return static_cast<uint64_t>(static_cast<int64_t>(value));
+    }
+    else
+    {
+        return static_cast<uint64_t>(value);
+    }
+}
+
+}  // namespace async_log_details
+
+/// @brief Asynchronous logger for hot paths
+/// Every thread that logs owns a lock free SPSC ring of binary records (format id plus arguments), a log call
+/// costs a push of one cache line and no lock, no formatting and no syscall. One background thread drains the
+/// rings, formats the records and writes each sink once per sweep. A full ring drops the record and counts
+/// it, the log thread reports drops on the console. Records of one thread keep their order, records of
+/// different threads are only ordered per sweep.
+/// While the rings stay empty the log thread sleeps longer each time, up to MAX_IDLE_WAIT, and marks itself
+/// idle; the first record after that wakes it. The idle check is a relaxed load, a wakeup it misses is
+/// bounded by the sleep.
+class AsyncLogger
+{
+  public:
+    static constexpr size_t RING_SIZE = 4096;
+    static constexpr auto FLUSH_INTERVAL = std::chrono::milliseconds(1);
+    static constexpr auto MAX_IDLE_WAIT = std::chrono::milliseconds(100);
+
+    static AsyncLogger& instance();
+
+    AsyncLogger(const AsyncLogger&) = delete;
+    AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+    ~AsyncLogger();
+
+    /// @brief Producer side, called by logAsync
+    void write(const async_log_details::Record& record);
+
+    /// @brief Open path (append) for LogSink::TraceFile records, the file is created with the first record
+    void traceTo(std::string path);
+
+    /// @brief Wait until records logged before the call are written
+    void flush();
+
+    /// @brief Records lost to full rings
+    uint64_t dropped() const;
+
+  private:
+    struct alignas(64) ThreadRing
+    {
+        SpscRing<async_log_details::Record, RING_SIZE> records;
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<bool> owned{true};
+        uint64_t reported{0};  // log thread only
+    };
+
+    AsyncLogger();
+
+    ThreadRing* acquireRing();
+    void drain();
+    size_t sweep(const std::vector<ThreadRing*>& rings);
+    void format(const async_log_details::Record& record);
+
+    mutable std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _flushed;
+    std::vector<std::unique_ptr<ThreadRing>> _rings;
+    uint64_t _flushRequested{0};
+    uint64_t _flushDone{0};
+    bool _stopping{false};
+    alignas(64) std::atomic<bool> _idle{false};  // read by every producer, written when the log thread sleeps
+
+    std::string _tracePath;
+    std::ofstream _traceFile;
+    std::string _console;  // formatted records of the current sweep
+    std::string _trace;
+
+    std::thread _thread;
+};
+
+/// @brief Log a record of Format, disabled levels are removed at compile time
+/// usage: constexpr LogFormat RECEIVED{LogLevel::Debug, LogSink::Console, "Id={}"}; logAsync<RECEIVED>(id);
+template <const LogFormat& Format, typename... Args> void logAsync([[maybe_unused]] Args... args)
+{
+    static_assert(sizeof...(Args) <= async_log_details::MAX_ARGS, "Too many arguments for one record");
+    static_assert(async_log_details::placeholders(Format.text) == sizeof...(Args), "One {} per argument");
+
+    if constexpr (Format.level >= LOG_LEVEL && Format.level != LogLevel::Off)
+    {
+        async_log_details::Record record{&Format, static_cast<uint8_t>(sizeof...(Args)),
+            {async_log_details::kind<Args>()...}, {async_log_details::encode(args)...}};
+        AsyncLogger::instance().write(record);
+    }
+}
@@ -1,8 +1,19 @@
 #pragma once
 
 #include <atomic>
+#include <cstddef>
 
 // Declare the global stop flag (extern means it's defined elsewhere)
 extern std::atomic_bool _running;
 
 void setupSignalHandler();
+
+/// @brief Eventfds notifyOnStop can hold, a loop beyond it has to be stopped by its owner
+constexpr size_t MAX_STOP_FDS = 64;
+
+/// @brief Write 1 to this eventfd when SIGINT arrives, so a thread sleeping in epoll_wait wakes up for shutdown
+/// @return false if too many descriptors are registered already
+bool notifyOnStop(int eventFd);
+
+/// @brief Stop notifying the eventfd, call before closing it
+void forgetOnStop(int eventFd);
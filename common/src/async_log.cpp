@@ -0,0 +1,265 @@
+#include "common/async_log.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <iostream>
+
+namespace
+{
+
+/// @brief Gives the ring back when its thread exits, a thread started later reuses it
+struct RingOwner
+{
+    std::atomic<bool>* owned{nullptr};
+
+    ~RingOwner()
+    {
+        if (owned)
+        {
+            owned->store(false, std::memory_order_release);
+        }
+    }
+};
+
+template <typename T> void appendNumber(std::string& out, T value)
+{
+    char buffer[32];
+    const auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, error == std::errc() ? end : buffer);
+}
+
+}  // namespace
+
+AsyncLogger& AsyncLogger::instance()
+{
+    static AsyncLogger logger;
+    return logger;
+}
+
+AsyncLogger::AsyncLogger()
+    : _thread(&AsyncLogger::drain, this)
+{
+}
+
+AsyncLogger::~AsyncLogger()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wake.notify_one();
+    _thread.join();
+}
+
+void AsyncLogger::write(const async_log_details::Record& record)
+{
+    thread_local ThreadRing* ring = acquireRing();
+
+    if (!ring->records.push(record))
+    {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (_idle.load(std::memory_order_relaxed) && _idle.exchange(false, std::memory_order_relaxed))
+    {
+        _wake.notify_one();
+    }
+}
+
+AsyncLogger::ThreadRing* AsyncLogger::acquireRing()
+{
+    thread_local RingOwner owner;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    ThreadRing* ring = nullptr;
+    for (auto& candidate : _rings)
+    {
+        bool owned = false;
+        if (candidate->owned.compare_exchange_strong(owned, true, std::memory_order_acquire))
+        {
+            ring = candidate.get();
+            break;
+        }
+    }
+
+    if (!ring)
+    {
+        _rings.push_back(std::make_unique<ThreadRing>());
+        ring = _rings.back().get();
+    }
+
+    owner.owned = &ring->owned;
+    return ring;
+}
+
+void AsyncLogger::traceTo(std::string path)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _tracePath = std::move(path);
+}
+
+void AsyncLogger::flush()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    const uint64_t ticket = ++_flushRequested;
+    _wake.notify_one();
+    _flushed.wait(lock, [&] { return _flushDone >= ticket; });
+}
+
+uint64_t AsyncLogger::dropped() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint64_t total = 0;
+    for (const auto& ring : _rings)
+    {
+        total += ring->dropped.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void AsyncLogger::drain()
+{
+    std::vector<ThreadRing*> rings;
+    std::string tracePath;
+    auto idleWait = FLUSH_INTERVAL;
+
+    for (;;)
+    {
+        uint64_t requested = 0;
+        bool stopping = false;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            requested = _flushRequested;
+            stopping = _stopping;
+            tracePath = _tracePath;
+
+            rings.clear();
+            for (const auto& ring : _rings)
+            {
+                rings.push_back(ring.get());
+            }
+        }
+
+        // sweep until every ring is empty, so a flush covers whatever was pushed before it was requested
+        size_t popped = 0;
+        for (;;)
+        {
+            const size_t count = sweep(rings);
+            popped += count;
+
+            if (!_console.empty())
+            {
+                std::cout.write(_console.data(), static_cast<std::streamsize>(_console.size()));
+                std::cout.flush();
+                _console.clear();
+            }
+
+            if (!_trace.empty())
+            {
+                if (!_traceFile.is_open() && !tracePath.empty())
+                {
+                    _traceFile.open(tracePath, std::ios::app);
+                }
+                if (_traceFile.is_open())
+                {
+                    _traceFile.write(_trace.data(), static_cast<std::streamsize>(_trace.size()));
+                    _traceFile.flush();
+                }
+                _trace.clear();
+            }
+
+            if (!count)
+            {
+                break;
+            }
+        }
+
+        if (requested)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _flushDone = requested;
+        }
+        _flushed.notify_all();
+
+        if (stopping)
+        {
+            return;
+        }
+
+        if (popped)
+        {
+            idleWait = FLUSH_INTERVAL;
+            continue;
+        }
+
+        // only the first record after a long sleep notifies, a busy logger polls every FLUSH_INTERVAL
+        idleWait = std::min<std::chrono::milliseconds>(idleWait * 2, MAX_IDLE_WAIT);
+        const bool idle = idleWait == MAX_IDLE_WAIT;
+        _idle.store(idle, std::memory_order_relaxed);
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _wake.wait_for(lock, idleWait, [&] {
+            return _stopping || _flushRequested != _flushDone || (idle && !_idle.load(std::memory_order_relaxed));
+        });
+    }
+}
+
+size_t AsyncLogger::sweep(const std::vector<ThreadRing*>& rings)
+{
+    std::array<async_log_details::Record, 256> records;
+    size_t total = 0;
+
+    for (ThreadRing* ring : rings)
+    {
+        const size_t count = ring->records.pop_n(records);
+        for (size_t i = 0; i < count; ++i)
+        {
+            format(records[i]);
+        }
+        total += count;
+
+        const uint64_t dropped = ring->dropped.load(std::memory_order_relaxed);
+        if (dropped != ring->reported)
+        {
+            _console += "Log ring full, dropped ";
+            appendNumber(_console, dropped - ring->reported);
+            _console += " records\n";
+            ring->reported = dropped;
+        }
+    }
+
+    return total;
+}
+
+void AsyncLogger::format(const async_log_details::Record& record)
+{
+    std::string& out = record.format->sink == LogSink::Console ? _console : _trace;
+    std::string_view text = record.format->text;
+
+    for (size_t i = 0; i < record.count; ++i)
+    {
+        const size_t pos = text.find("{}");
+        out.append(text.substr(0, pos));
+        text.remove_prefix(pos + 2);
+
+        const uint64_t arg = record.args[i];
+        switch (record.kinds[i])
+        {
+            case async_log_details::ArgKind::Unsigned:
+                appendNumber(out, arg);
+                break;
+            case async_log_details::ArgKind::Signed:
+                appendNumber(out, static_cast<int64_t>(arg));
+                break;
+            case async_log_details::ArgKind::Double:
+                appendNumber(out, std::bit_cast<double>(arg));
+                break;
+            case async_log_details::ArgKind::Char:
+                out.push_back(static_cast<char>(arg));
+                break;
+        }
+    }
+
+    out.append(text);
+    out.push_back('\n');
+}
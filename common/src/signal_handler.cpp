@@ -1,17 +1,39 @@
 #include "common/signal_handler.hpp"
 
+#include <array>
 #include <csignal>
+#include <cstdint>
 #include <iostream>
 
+#include <unistd.h>
+
 // Define the global stop flag
 std::atomic_bool _running{true};
 
+namespace
+{
+
+// eventfds of sleeping event loops stored as fd + 1, 0 is a free slot; lock free so the signal handler may read them
+std::array<std::atomic<int>, MAX_STOP_FDS> stopFds{};
+
+}  // namespace
+
 void signalHandler(int signum)
 {
     if (signum == SIGINT)
     {
         std::cout << "Received SIGINT, stopping all threads...\n";
         _running = false;
+
+        const uint64_t one = 1;
+        for (auto& slot : stopFds)
+        {
+            const int fd = slot.load(std::memory_order_acquire) - 1;
+            if (fd >= 0)
+            {
+                [[maybe_unused]] ssize_t written = write(fd, &one, sizeof(one));
+            }
+        }
     }
 }
 
@@ -19,3 +41,28 @@ void setupSignalHandler()
 {
     std::signal(SIGINT, signalHandler);
 }
+
+bool notifyOnStop(int eventFd)
+{
+    for (auto& slot : stopFds)
+    {
+        int expected = 0;
+        if (slot.compare_exchange_strong(expected, eventFd + 1, std::memory_order_acq_rel))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void forgetOnStop(int eventFd)
+{
+    for (auto& slot : stopFds)
+    {
+        int expected = eventFd + 1;
+        if (slot.compare_exchange_strong(expected, 0, std::memory_order_acq_rel))
+        {
+            return;
+        }
+    }
+}
@@ -1,46 +1,78 @@
-#include <messages-container/blocking/hash_map.hpp>
+#include <messages-container/message_container.hpp>
 #include <tcp-messages/tcp_processor.hpp>
 #include <udp-messages/udp_processor.hpp>
+#include <udp-messages/udp_workers.hpp>
+#include <common/async_log.hpp>
 #include <common/signal_handler.hpp>
 
+#include <chrono>
 #include <iostream>
 #include <memory>
+#include <string>
 #include <thread>
+#include <vector>
 #include <csignal>
 
 
 
-void runUdpProcessor(int16_t port, int16_t tcpPort, HashMap<INITIAL_CAPACITY>& map)
-{
-    UdpServer udpServer(tcpPort, port, map);
-
-    udpServer.run();
-}
-
 int main(int argc, char* argv[])
 {
-    if (argc != 4)
+    std::vector<std::string> args(argv + 1, argv + argc);
+    UdpWorkerOptions workerOptions;
+    try
+    {
+        workerOptions = takeWorkerOptions(args);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << "\n";
+        args.clear();
+    }
+
+    if (args.size() != 3 && args.size() != 4)
     {
-        std::cerr << "Usage: " << argv[0] << " <UDP Port 1> <UDP Port 2> <TCP Port>\n";
+        std::cerr << "Usage: " << argv[0]
+                  << " [--workers <per port>] [--cpus <a,b,...>] <UDP Port 1> <UDP Port 2> <TCP Port> [Data directory]\n";
         return 1;
     }
 
-    int16_t udpPort1 = std::stoi(argv[1]);
-    int16_t udpPort2 = std::stoi(argv[2]);
-    int16_t tcpPort = std::stoi(argv[3]);
+    int16_t udpPort1 = std::stoi(args[0]);
+    int16_t udpPort2 = std::stoi(args[1]);
+    int16_t tcpPort = std::stoi(args[2]);
 
     setupSignalHandler();
 
-    HashMap<INITIAL_CAPACITY> messageMap;
+    // UDP forwarded and TCP received messages are traced here when built with COMMON_LOG_LEVEL=trace
+    AsyncLogger::instance().traceTo("messages_system_trace.log");
+
+#if defined(MESSAGES_CONTAINER_LOCK_STATS)
+    // installs the SIGUSR1 dump before the receivers start, the stats are dumped again on exit
+    LockStats::instance();
+#endif
+
+    MessageContainer messageMap;
+
+    // with a data directory accepted messages survive a restart (write-ahead log + snapshots)
+    std::unique_ptr<MessageContainerLog> messageLog;
+    if (args.size() == 4)
+    {
+        messageLog = std::make_unique<MessageContainerLog>(messageMap, MessageLogOptions{.directory = args[3]});
 
-    std::thread udpThread1(runUdpProcessor, udpPort1, tcpPort, std::ref(messageMap));
-    std::thread udpThread2(runUdpProcessor, udpPort2, tcpPort, std::ref(messageMap));
+        auto start = std::chrono::steady_clock::now();
+        size_t recovered = messageLog->recover();
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        std::cout << "Recovered " << recovered << " messages in " << elapsed.count() << " ms\n";
+    }
 
+    // the listener is bound before the forwarder first connects to it
     TcpServer tcpServer(tcpPort);
+
+    UdpWorkerPool udpWorkers({udpPort1, udpPort2}, tcpPort, messageMap, messageLog.get(), workerOptions);
+    std::thread udpThread(&UdpWorkerPool::run, &udpWorkers);
+
     tcpServer.run();
 
-    udpThread1.join();
-    udpThread2.join();
+    udpThread.join();
 
     return 0;
 }
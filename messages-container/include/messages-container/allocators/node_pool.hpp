@@ -0,0 +1,240 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include <sys/mman.h>
+
+/// @brief Fixed size block pool for container nodes
+/// Memory comes from large slabs (2 MiB, transparent huge pages with MESSAGES_CONTAINER_HUGE_PAGES)
+/// and is never returned to the system. Every thread allocates from and frees to its own free list
+/// without synchronization. Lists move between a thread and the shared pool in batches of BATCH_SIZE
+/// blocks under a mutex, so a block freed on another thread (remove, rehash, reclamation) comes back
+/// to the allocating threads one batch at a time.
+/// The pool is a process wide singleton per block size, it outlives every thread cache.
+template <size_t BlockSize, size_t Alignment> class NodePool
+{
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    static constexpr size_t BLOCK_ALIGN = std::max(Alignment, alignof(FreeBlock));
+    static constexpr size_t BLOCK_SIZE = (std::max(BlockSize, sizeof(FreeBlock)) + BLOCK_ALIGN - 1) & ~(BLOCK_ALIGN - 1);
+
+  public:
+    static constexpr size_t SLAB_SIZE = 2 * 1024 * 1024;
+    static constexpr size_t BATCH_SIZE = 64;
+
+    static_assert(BLOCK_SIZE * BATCH_SIZE <= SLAB_SIZE, "Block is too big for the pool");
+
+  private:
+    struct Batch
+    {
+        FreeBlock* head{nullptr};
+        size_t count{0};
+    };
+
+    /// @brief Blocks owned by one thread, handed back to the pool when the thread exits
+    struct ThreadCache
+    {
+        Batch local;
+        Batch overflow;  // full batch waiting to be returned
+
+        ~ThreadCache()
+        {
+            NodePool& pool = instance();
+            pool.pushBatch(local);
+            pool.pushBatch(overflow);
+        }
+    };
+
+    std::mutex _mutex;
+    std::vector<Batch> _batches;  // full batches returned by threads
+    std::byte* _slab{nullptr};  // current slab, carved with a bump pointer
+    size_t _slabUsed{SLAB_SIZE};
+
+    NodePool() = default;
+
+    static ThreadCache& cache()
+    {
+        thread_local ThreadCache cache;
+        return cache;
+    }
+
+    /// @brief SLAB_SIZE bytes aligned to SLAB_SIZE, so a single huge page can back the whole slab
+    static std::byte* allocateSlab()
+    {
+#if defined(MESSAGES_CONTAINER_HUGE_PAGES) && defined(MAP_HUGETLB)
+        // reserved huge pages are used when the system has some, otherwise fall back to THP
+        void* huge = mmap(nullptr, SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (huge != MAP_FAILED)
+        {
+            return static_cast<std::byte*>(huge);
+        }
+#endif
+
+        // over-map by a slab and unmap the slack around the aligned start
+        void* mapped = mmap(nullptr, 2 * SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED)
+        {
+            throw std::bad_alloc();
+        }
+
+        auto* begin = static_cast<std::byte*>(mapped);
+        auto* slab = reinterpret_cast<std::byte*>(
+            (reinterpret_cast<uintptr_t>(begin) + SLAB_SIZE - 1) & ~static_cast<uintptr_t>(SLAB_SIZE - 1));
+        if (slab != begin)
+        {
+            munmap(begin, static_cast<size_t>(slab - begin));
+        }
+        munmap(slab + SLAB_SIZE, static_cast<size_t>(begin + 2 * SLAB_SIZE - (slab + SLAB_SIZE)));
+
+#if defined(MESSAGES_CONTAINER_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+        madvise(slab, SLAB_SIZE, MADV_HUGEPAGE);
+#endif
+
+        return slab;
+    }
+
+    void pushBatch(Batch& batch)
+    {
+        if (batch.count == 0)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _batches.push_back(batch);
+        batch = Batch{};
+    }
+
+    /// @brief A returned batch if there is one, otherwise BATCH_SIZE fresh blocks from the slab
+    Batch popBatch()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (!_batches.empty())
+        {
+            Batch batch = _batches.back();
+            _batches.pop_back();
+            return batch;
+        }
+
+        if (_slabUsed + BLOCK_SIZE * BATCH_SIZE > SLAB_SIZE)
+        {
+            _slab = allocateSlab();
+            _slabUsed = 0;
+        }
+
+        Batch batch;
+        for (size_t i = 0; i < BATCH_SIZE; ++i)
+        {
+            auto* block = reinterpret_cast<FreeBlock*>(_slab + _slabUsed);
+            block->next = batch.head;
+            batch.head = block;
+            _slabUsed += BLOCK_SIZE;
+        }
+        batch.count = BATCH_SIZE;
+
+        return batch;
+    }
+
+  public:
+    static NodePool& instance()
+    {
+        // leaked on purpose: thread caches are flushed after static destructors may have run
+        static NodePool* pool = new NodePool();
+        return *pool;
+    }
+
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    void* allocate()
+    {
+        ThreadCache& local = cache();
+
+        if (!local.local.head)
+        {
+            if (local.overflow.count)
+            {
+                std::swap(local.local, local.overflow);
+            }
+            else
+            {
+                local.local = popBatch();
+            }
+        }
+
+        FreeBlock* block = local.local.head;
+        local.local.head = block->next;
+        --local.local.count;
+
+        return block;
+    }
+
+    void deallocate(void* ptr)
+    {
+        ThreadCache& local = cache();
+
+        if (local.local.count == BATCH_SIZE)
+        {
+            // keep one full batch in reserve, return the older one to the pool
+            pushBatch(local.overflow);
+            std::swap(local.local, local.overflow);
+        }
+
+        auto* block = static_cast<FreeBlock*>(ptr);
+        block->next = local.local.head;
+        local.local.head = block;
+        ++local.local.count;
+    }
+};
+
+/// @brief Stateless allocator on top of NodePool, single objects come from the pool,
+/// arrays fall back to std::allocator
+template <typename T> class NodePoolAllocator
+{
+    using Pool = NodePool<sizeof(T), alignof(T)>;
+
+  public:
+    using value_type = T;
+
+    NodePoolAllocator() noexcept = default;
+
+    template <typename U> NodePoolAllocator(const NodePoolAllocator<U>&) noexcept
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        if (n != 1)
+        {
+            return std::allocator<T>().allocate(n);
+        }
+
+        return static_cast<T*>(Pool::instance().allocate());
+    }
+
+    void deallocate(T* ptr, size_t n) noexcept
+    {
+        if (n != 1)
+        {
+            std::allocator<T>().deallocate(ptr, n);
+            return;
+        }
+
+        Pool::instance().deallocate(ptr);
+    }
+
+    template <typename U> bool operator==(const NodePoolAllocator<U>&) const noexcept
+    {
+        return true;
+    }
+};
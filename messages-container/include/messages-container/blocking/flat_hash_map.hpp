@@ -0,0 +1,472 @@
+#pragma once
+
+#include <message.hpp>
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <bitset>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace flat_details
+{
+
+/// @brief Control byte values: a full slot stores the 7 low bits of the hash (h2),
+/// empty and deleted slots have the sign bit set so both match with a single movemask
+constexpr int8_t CTRL_EMPTY = -128;   // 0b10000000
+constexpr int8_t CTRL_DELETED = -2;   // 0b11111110
+
+using BitMask = uint32_t;
+
+#if defined(__AVX2__)
+
+/// @brief 32 control bytes probed at once with AVX2
+struct Group
+{
+    static constexpr size_t WIDTH = 32;
+
+    __m256i ctrl;
+
+    explicit Group(const int8_t* pos)
+        : ctrl(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos)))
+    {
+    }
+
+    BitMask match(int8_t h2) const
+    {
+        return static_cast<BitMask>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_set1_epi8(h2), ctrl)));
+    }
+
+    BitMask matchEmpty() const
+    {
+        return match(CTRL_EMPTY);
+    }
+
+    BitMask matchEmptyOrDeleted() const
+    {
+        return static_cast<BitMask>(_mm256_movemask_epi8(ctrl));
+    }
+};
+
+#elif defined(__SSE2__)
+
+/// @brief 16 control bytes probed at once with SSE2
+struct Group
+{
+    static constexpr size_t WIDTH = 16;
+
+    __m128i ctrl;
+
+    explicit Group(const int8_t* pos)
+        : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos)))
+    {
+    }
+
+    BitMask match(int8_t h2) const
+    {
+        return static_cast<BitMask>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl)));
+    }
+
+    BitMask matchEmpty() const
+    {
+        return match(CTRL_EMPTY);
+    }
+
+    BitMask matchEmptyOrDeleted() const
+    {
+        return static_cast<BitMask>(_mm_movemask_epi8(ctrl));
+    }
+};
+
+#else
+
+/// @brief Portable fallback, 8 control bytes per group
+struct Group
+{
+    static constexpr size_t WIDTH = 8;
+
+    int8_t ctrl[WIDTH];
+
+    explicit Group(const int8_t* pos)
+    {
+        std::memcpy(ctrl, pos, WIDTH);
+    }
+
+    BitMask match(int8_t h2) const
+    {
+        BitMask mask = 0;
+        for (size_t i = 0; i < WIDTH; ++i)
+        {
+            mask |= static_cast<BitMask>(ctrl[i] == h2) << i;
+        }
+        return mask;
+    }
+
+    BitMask matchEmpty() const
+    {
+        return match(CTRL_EMPTY);
+    }
+
+    BitMask matchEmptyOrDeleted() const
+    {
+        BitMask mask = 0;
+        for (size_t i = 0; i < WIDTH; ++i)
+        {
+            mask |= static_cast<BitMask>(ctrl[i] < 0) << i;
+        }
+        return mask;
+    }
+};
+
+#endif
+
+/// @brief murmur3 finalizer, spreads MessageId bits so h2 is not just the low id bits
+inline uint64_t mix(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+}  // namespace flat_details
+
+/// @brief Open addressing hash map (swiss table layout)
+/// Messages are stored inline in a contiguous slot array, a parallel array of control bytes
+/// is probed a whole group at a time with SIMD, so a lookup touches one or two cache lines
+/// and an insert never allocates unless the table grows.
+/// All operations are guarded by one reader/writer lock; wrap it in a sharded map to spread writers.
+/// @tparam Size initial capacity, must be a power of two
+template <size_t Size = 1024> class FlatHashMap
+{
+    using Group = flat_details::Group;
+
+    static_assert((Size & (Size - 1)) == 0, "Size must be a power of two");
+
+    static constexpr size_t MIN_CAPACITY = Size < Group::WIDTH ? Group::WIDTH : Size;
+
+    std::unique_ptr<int8_t[]> _ctrl{nullptr};  // capacity + WIDTH bytes, the tail mirrors the first group
+    std::unique_ptr<Message[]> _slots{nullptr};
+
+    std::atomic<size_t> _capacity{MIN_CAPACITY};
+    std::atomic<size_t> _size{0};
+    size_t _deleted{0};  // tombstones, cleaned up on the next rehash
+
+    mutable std::shared_mutex _mutex;
+
+  private:
+    static size_t h1(uint64_t hash)
+    {
+        return hash >> 7;
+    }
+
+    static int8_t h2(uint64_t hash)
+    {
+        return static_cast<int8_t>(hash & 0x7f);
+    }
+
+    /// @brief Max load 7/8, the probe sequence always hits an empty slot
+    static size_t maxLoad(size_t capacity)
+    {
+        return capacity - capacity / 8;
+    }
+
+    void setCtrl(size_t index, int8_t value, size_t capacity)
+    {
+        _ctrl[index] = value;
+        if (index < Group::WIDTH)
+        {
+            _ctrl[capacity + index] = value;
+        }
+    }
+
+    /// @brief Quadratic (triangular) probing over groups, visits every group of a power of two table
+    template <typename Visitor> bool probe(uint64_t hash, size_t capacity, Visitor&& visit) const
+    {
+        const size_t mask = capacity - 1;
+        size_t pos = h1(hash) & mask;
+
+        for (size_t step = Group::WIDTH; ; step += Group::WIDTH)
+        {
+            Group group(_ctrl.get() + pos);
+            if (visit(group, pos))
+            {
+                return true;
+            }
+
+            if (group.matchEmpty())
+            {
+                return false;
+            }
+
+            pos = (pos + step) & mask;
+        }
+    }
+
+    bool findIndex(uint64_t messageId, size_t& index) const
+    {
+        return findIndex(messageId, flat_details::mix(messageId), index);
+    }
+
+    bool findIndex(uint64_t messageId, uint64_t hash, size_t& index) const
+    {
+        const size_t capacity = _capacity.load(std::memory_order_relaxed);
+        const size_t mask = capacity - 1;
+
+        return probe(hash, capacity,
+            [&](const Group& group, size_t pos)
+            {
+                for (auto match = group.match(h2(hash)); match; match &= match - 1)
+                {
+                    size_t i = (pos + std::countr_zero(match)) & mask;
+                    if (_slots[i].MessageId == messageId)
+                    {
+                        index = i;
+                        return true;
+                    }
+                }
+                return false;
+            });
+    }
+
+    size_t findFreeSlot(uint64_t hash, size_t capacity) const
+    {
+        const size_t mask = capacity - 1;
+        size_t pos = h1(hash) & mask;
+
+        for (size_t step = Group::WIDTH; ; step += Group::WIDTH)
+        {
+            auto free = Group(_ctrl.get() + pos).matchEmptyOrDeleted();
+            if (free)
+            {
+                return (pos + std::countr_zero(free)) & mask;
+            }
+
+            pos = (pos + step) & mask;
+        }
+    }
+
+    /// @brief Rebuild the table, doubling only when live entries need it, otherwise just drop tombstones
+    void rehash()
+    {
+        const size_t capacity = _capacity.load(std::memory_order_relaxed);
+        const size_t size = _size.load(std::memory_order_relaxed);
+        const size_t newCapacity = (size + 1) > maxLoad(capacity) / 2 ? capacity << 1 : capacity;
+
+        auto oldCtrl = std::move(_ctrl);
+        auto oldSlots = std::move(_slots);
+
+        allocate(newCapacity);
+
+        for (size_t i = 0; i < capacity; ++i)
+        {
+            if (oldCtrl[i] >= 0)
+            {
+                const uint64_t hash = flat_details::mix(oldSlots[i].MessageId);
+                size_t index = findFreeSlot(hash, newCapacity);
+                setCtrl(index, h2(hash), newCapacity);
+                _slots[index] = oldSlots[i];
+            }
+        }
+
+        _deleted = 0;
+        _capacity.store(newCapacity, std::memory_order_release);
+    }
+
+    void allocate(size_t capacity)
+    {
+        _ctrl = std::make_unique<int8_t[]>(capacity + Group::WIDTH);
+        std::memset(_ctrl.get(), flat_details::CTRL_EMPTY, capacity + Group::WIDTH);
+        _slots = std::make_unique_for_overwrite<Message[]>(capacity);
+    }
+
+    /// @brief Insert unless the key is present, caller holds _mutex exclusive
+    bool insertLocked(const Message& message, uint64_t hash)
+    {
+        size_t index{};
+        if (findIndex(message.MessageId, hash, index))
+        {
+            return false;
+        }
+
+        if (_size.load(std::memory_order_relaxed) + _deleted + 1 > maxLoad(_capacity.load(std::memory_order_relaxed)))
+        {
+            rehash();
+        }
+
+        const size_t capacity = _capacity.load(std::memory_order_relaxed);
+
+        index = findFreeSlot(hash, capacity);
+        if (_ctrl[index] == flat_details::CTRL_DELETED)
+        {
+            --_deleted;
+        }
+
+        setCtrl(index, h2(hash), capacity);
+        _slots[index] = message;
+
+        _size.fetch_add(1, std::memory_order_release);
+        return true;
+    }
+
+    /// @brief Prefetch the first control group and slot of every hash, caller holds _mutex
+    template <int Rw> void prefetchGroups(std::span<const uint64_t> hashes) const
+    {
+        const size_t mask = _capacity.load(std::memory_order_relaxed) - 1;
+
+        for (uint64_t hash : hashes)
+        {
+            const size_t pos = h1(hash) & mask;
+            __builtin_prefetch(_ctrl.get() + pos, 0);
+            __builtin_prefetch(&_slots[pos], Rw);
+        }
+    }
+
+  public:
+    FlatHashMap()
+    {
+        allocate(MIN_CAPACITY);
+    }
+
+    FlatHashMap(const FlatHashMap&) = delete;
+    FlatHashMap& operator=(const FlatHashMap&) = delete;
+    FlatHashMap(FlatHashMap&&) = delete;
+    FlatHashMap& operator=(FlatHashMap&&) = delete;
+
+    bool insert(const Message& message)
+    {
+        std::unique_lock<std::shared_mutex> lock(_mutex);
+        return insertLocked(message, flat_details::mix(message.MessageId));
+    }
+
+    /// @brief Insert a batch under one lock, hashes are computed before locking and
+    /// the probes of the whole batch are prefetched before the first one runs
+    /// @param inserted bit i is set if messages[i] was inserted, N bounds the batch size
+    /// @return number of inserted messages
+    template <size_t N> size_t insertBatch(std::span<const Message> messages, std::bitset<N>& inserted)
+    {
+        assert(messages.size() <= N && "Batch is larger than the result bitset");
+
+        std::array<uint64_t, N> hashes;
+        for (size_t i = 0; i < messages.size(); ++i)
+        {
+            hashes[i] = flat_details::mix(messages[i].MessageId);
+        }
+
+        size_t count = 0;
+        inserted.reset();
+
+        std::unique_lock<std::shared_mutex> lock(_mutex);
+        prefetchGroups<1>(std::span<const uint64_t>(hashes.data(), messages.size()));
+
+        for (size_t i = 0; i < messages.size(); ++i)
+        {
+            inserted[i] = insertLocked(messages[i], hashes[i]);
+            count += inserted[i];
+        }
+
+        return count;
+    }
+
+    bool find(uint64_t messageId, Message& result) const
+    {
+        std::shared_lock<std::shared_mutex> lock(_mutex);
+
+        size_t index{};
+        if (!findIndex(messageId, index))
+        {
+            return false;
+        }
+
+        result = _slots[index];
+        return true;
+    }
+
+    /// @brief Look up a batch under one shared lock, probes of the whole batch are prefetched first
+    /// @param results results[i] receives the message of ids[i] if found
+    /// @param found bit i is set if ids[i] was found, N bounds the batch size
+    /// @return number of found messages
+    template <size_t N>
+    size_t findBatch(std::span<const uint64_t> ids, std::span<Message> results, std::bitset<N>& found) const
+    {
+        assert(ids.size() <= N && ids.size() <= results.size() && "Batch is larger than the results");
+
+        std::array<uint64_t, N> hashes;
+        for (size_t i = 0; i < ids.size(); ++i)
+        {
+            hashes[i] = flat_details::mix(ids[i]);
+        }
+
+        size_t count = 0;
+        found.reset();
+
+        std::shared_lock<std::shared_mutex> lock(_mutex);
+        prefetchGroups<0>(std::span<const uint64_t>(hashes.data(), ids.size()));
+
+        for (size_t i = 0; i < ids.size(); ++i)
+        {
+            size_t index{};
+            if (findIndex(ids[i], hashes[i], index))
+            {
+                results[i] = _slots[index];
+                found[i] = true;
+                ++count;
+            }
+        }
+
+        return count;
+    }
+
+    bool remove(uint64_t messageId)
+    {
+        std::unique_lock<std::shared_mutex> lock(_mutex);
+
+        size_t index{};
+        if (!findIndex(messageId, index))
+        {
+            return false;
+        }
+
+        setCtrl(index, flat_details::CTRL_DELETED, _capacity.load(std::memory_order_relaxed));
+        ++_deleted;
+
+        _size.fetch_sub(1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const
+    {
+        return _size.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const
+    {
+        return _capacity.load(std::memory_order_acquire);
+    }
+
+    void debug()
+    {
+        std::shared_lock<std::shared_mutex> lock(_mutex);
+        for (size_t i = 0; i < _capacity.load(std::memory_order_relaxed); ++i)
+        {
+            if (_ctrl[i] >= 0)
+            {
+                std::cout << "Index: " << i << " MessageId: " << _slots[i].MessageId << std::endl;
+            }
+        }
+    }
+};
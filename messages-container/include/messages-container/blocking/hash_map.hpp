@@ -2,264 +2,1337 @@
 
 #include <message.hpp>
 
-#include "shared_mutex.hpp"
-#include "spin_lock.hpp"
+#include "lock_policies.hpp"
+#include "lock_stats.hpp"
 
+#include "../hash_policies.hpp"
+#include "../lock-free/details/epoch_based_freedom.hpp"
+
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <bit>
+#include <bitset>
+#include <cassert>
+#include <chrono>
 #include <cstddef>
+#include <cstdlib>
 #include <cstring>
 #include <functional>
-#include <future>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <span>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+/// @brief Bounded mode of HashMap, zero means unlimited
+struct HashMapLimits
+{
+    size_t maxEntries{0};  // approximate cap, unreferenced entries are evicted (CLOCK) to stay below it
+    std::chrono::milliseconds ttl{0};  // entries older than this are invisible and dropped, up to 24 days
+};
 
-/// @brief  A hash map that uses chaining to resolve collisions with spin locks
-/// @tparam Size
-template <size_t Size = 1024> class HashMap
+/// @brief  A hash map that uses chaining to resolve collisions with striped locks
+/// The table grows incrementally: when the load factor is crossed a table of double size is installed
+/// next to the old one and every insert/remove migrates a bounded number of old buckets.
+/// Bucket locks are striped by the low bits of the hash, an old bucket and the two new buckets it
+/// splits into always share a stripe, so migration needs no extra locking.
+/// find is optimistic: every stripe carries a version counter (seqlock), writers make it odd while they
+/// change the stripe's chains, readers walk the chains without any lock and retry if the version moved.
+/// Removed entries are reclaimed with epochs, replaced tables are kept until the map is destroyed,
+/// so a reader never touches freed memory. The epochs take a process wide thread slot (MAX_THREADS); a thread
+/// that finds none free reads under the stripe locks and retires through the epoch manager's shared orphan
+/// list, so the map itself has no thread limit.
+/// With HashMapLimits the table is sized for maxEntries up front and never resized. Writers advance a
+/// CLOCK hand over a few buckets per insert: expired entries are dropped, and while the map is full
+/// entries not referenced (found or re-inserted) since the last pass are evicted.
+/// With TypeIndexed every entry is also kept in a compact list of its MessageType (one per type, under its
+/// own lock), so per-type counts, scans and drains cost O(result) instead of a walk over the whole table.
+/// snapshot() hands out a point-in-time view in O(1) while writers keep going: every bucket carries the
+/// generation of its last change, the first writer to change a bucket after a snapshot was taken copies
+/// the bucket into the snapshot (copy on write), so a snapshot costs O(buckets changed while it is open).
+/// @tparam Size initial capacity and number of lock stripes, must be a power of two
+/// @tparam Allocator allocator of Message, rebound to the entry type (e.g. NodePoolAllocator)
+/// @tparam TypeIndexed maintain the secondary index by MessageType
+/// @tparam Lock stripe lock policy (lock_policies.hpp): std::shared_mutex, TTASLock, TicketLock, MCSLock, or
+/// NoLock for a map owned by one thread (the global lock is then dropped as well)
+/// @tparam Hash hash policy (hash_policies.hpp), the bucket is the low bits of its result
+template <size_t Size = 1024, typename Allocator = std::allocator<Message>, bool TypeIndexed = false,
+    typename Lock = std::shared_mutex, typename Hash = MurmurHash>
+class HashMap
 {
+    static_assert((Size & (Size - 1)) == 0, "Size must be a power of two");
+
+    static constexpr size_t MESSAGE_TYPES = 256;
+
+    struct NoTypeSlot
+    {
+    };
+
     struct HashEntry
     {
-        Message message{};
-        HashEntry* next{nullptr};
+        Message message{};  // immutable while the entry is reachable
+        std::atomic<HashEntry*> next{nullptr};
+        uint32_t stamp{0};  // insert time in ms since the map was created, only with a TTL
+        std::atomic<bool> referenced{false};  // CLOCK bit, only with maxEntries
+        [[no_unique_address]] std::conditional_t<TypeIndexed, uint32_t, NoTypeSlot> typeSlot{};  // in its type list
+
+        HashEntry(const Message& message, HashEntry* next, uint32_t stamp)
+            : message(message)
+            , next(next)
+            , stamp(stamp)
+        {
+        }
+    };
+
+    using Bucket = std::atomic<HashEntry*>;
+
+    /// @brief Stripe locks sit on their own cache line, neighbouring stripes do not share it
+    struct alignas(64) StripeLock : Lock
+    {
     };
 
-    std::future<void> _rehashFuture;  // Background thread for rehashing
-    std::atomic<bool> _stopRehashing{false};
+    using GlobalMutex = std::conditional_t<std::is_same_v<Lock, NoLock>, NoLock, std::shared_mutex>;
+
+    using EntryAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<HashEntry>;
+    using EntryTraits = std::allocator_traits<EntryAllocator>;
+
+    struct EntryDeleter
+    {
+        [[no_unique_address]] EntryAllocator allocator;
+
+        void operator()(HashEntry* entry)
+        {
+            EntryTraits::destroy(allocator, entry);
+            EntryTraits::deallocate(allocator, entry, 1);
+        }
+    };
+
+    using Guard = typename EpochManager<HashEntry, EntryDeleter>::Guard;
+
+    /// @brief Entries of one MessageType, order is not kept (swap remove)
+    struct alignas(64) TypeList
+    {
+        mutable std::shared_mutex mutex;  // taken after a stripe lock, never the other way round
+        std::vector<HashEntry*> entries;
+    };
+
+    struct SnapshotEntry
+    {
+        Message message;
+        uint32_t stamp;
+    };
+
+    /// @brief One open snapshot, preserved is filled by writers under _snapshotMutex
+    struct SnapshotState
+    {
+        uint32_t generation{0};
+        uint32_t stamp{0};
+        size_t size{0};
+        std::array<Bucket*, 2> tables{};  // current and old (null unless resizing) table when taken
+        std::array<size_t, 2> capacities{};
+        std::unordered_map<const Bucket*, std::vector<SnapshotEntry>> preserved;  // buckets changed since
+    };
+
+    [[no_unique_address]] EntryAllocator _allocator;
+    std::unique_ptr<EpochManager<HashEntry, EntryDeleter>> _epochs;
+
     std::atomic<size_t> _capacity{Size};
     std::atomic<size_t> _size{0};
 
-    std::unique_ptr<HashEntry*[]> _table{nullptr};
-    // std::shared_ptr<Spinlock[]> _locks{nullptr};
-    std::shared_ptr<SharedMutex[]> _locks{nullptr};
-    mutable std::shared_mutex _globalMutex;
+    mutable std::atomic<Bucket*> _table{nullptr};
+    mutable std::atomic<Bucket*> _oldTable{nullptr};  // not null while a resize is in progress
+    mutable std::atomic<size_t> _oldCapacity{0};
+    mutable std::atomic<uint64_t> _tableVersion{0};  // odd while the tables are swapped
+    mutable std::vector<Bucket*> _retiredTables;  // migrated tables, readers may still walk them
+    mutable std::atomic<size_t> _migrateIndex{0};  // next old bucket to claim
+    mutable std::atomic<size_t> _migrated{0};  // old buckets already moved
+    mutable std::atomic<bool> _resizing{false};
+
+    std::unique_ptr<StripeLock[]> _locks{nullptr};
+    std::unique_ptr<std::atomic<uint64_t>[]> _versions{nullptr};  // one per stripe, odd while written
+    mutable GlobalMutex _globalMutex;  // exclusive only to swap tables, O(1)
+
+    const size_t _maxEntries;
+    const uint32_t _ttlMs;
+    const std::chrono::steady_clock::time_point _created;
+    std::atomic<size_t> _clockHand{0};
+    std::atomic<size_t> _evictions{0};
+    std::atomic<size_t> _expirations{0};
+    std::function<void(uint64_t)> _onDrop;  // set before the map is shared
+
+    std::unique_ptr<TypeList[]> _types{nullptr};  // MESSAGE_TYPES lists with TypeIndexed
+
+    mutable std::mutex _snapshotMutex;  // taken after a stripe lock, never the other way round
+    mutable std::vector<SnapshotState*> _snapshots;  // open snapshots
+    mutable std::atomic<uint32_t> _snapshotGeneration{0};  // of the latest snapshot, changes under _globalMutex
+    mutable std::atomic<size_t> _openSnapshots{0};
 
     static constexpr float LOAD_FACTOR = 0.75f;
+    static constexpr size_t MIGRATE_BUCKETS = 2;  // old buckets moved per operation
+    static constexpr size_t OPTIMISTIC_RETRIES = 4;  // lock free find attempts before taking the locks
+    static constexpr size_t CLOCK_BUCKETS = 2;  // buckets swept per insert with a TTL
+    static constexpr size_t CLOCK_SCAN_LIMIT = 64;  // buckets swept at most per insert to find a victim
 
   private:
+    HashEntry* createEntry(const Message& message, HashEntry* next, uint32_t stamp)
+    {
+        HashEntry* entry = EntryTraits::allocate(_allocator, 1);
+        EntryTraits::construct(_allocator, entry, message, next, stamp);
+        return entry;
+    }
+
+    void destroyEntry(HashEntry* entry)
+    {
+        EntryTraits::destroy(_allocator, entry);
+        EntryTraits::deallocate(_allocator, entry, 1);
+    }
+
     size_t hash(uint64_t key, size_t capacity) const
     {
-        return std::hash<uint64_t>{}(key) & (capacity - 1);
+        return Hash{}(key) & (capacity - 1);
+    }
+
+    static size_t chainLength(const Bucket& bucket)
+    {
+        size_t length = 0;
+        for (HashEntry* entry = bucket.load(std::memory_order_relaxed); entry;
+             entry = entry->next.load(std::memory_order_relaxed))
+        {
+            ++length;
+        }
+        return length;
+    }
+
+    size_t stripe(uint64_t key) const
+    {
+        return hash(key, Size);
+    }
+
+    /// @brief Lock a stripe for writing, readers of the stripe see an odd version until unlockStripe
+    void lockStripe(size_t index, LockClass lockClass = LockClass::Bucket) const
+    {
+        lockProfiled(_locks[index], lockClass);
+        // the chain stores that follow are release, a reader that sees them also sees the odd version
+        _versions[index].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void unlockStripe(size_t index) const
+    {
+        _versions[index].fetch_add(1, std::memory_order_release);
+        _locks[index].unlock();
     }
 
-    void rehash()
+    /// @brief A bounded map starts at the capacity that holds maxEntries below the load factor
+    static size_t initialCapacity(const HashMapLimits& limits)
     {
-        std::cout << "resing !!!!!!!!!!!!!!!!" << std::endl;
-        std::unique_lock<std::shared_mutex> globalLock(_globalMutex);
+        const auto needed = static_cast<size_t>(static_cast<double>(limits.maxEntries) / LOAD_FACTOR) + 1;
+        return limits.maxEntries ? std::max(Size, std::bit_ceil(needed)) : Size;
+    }
+
+    /// @brief Milliseconds since the map was created, 0 without a TTL
+    uint32_t now() const
+    {
+        if (!_ttlMs)
+        {
+            return 0;
+        }
 
-        auto capacity = _capacity.load(std::memory_order_acquire);
-        size_t newCapacity = capacity << 1;
-        std::unique_ptr<HashEntry*[]> newTable(new HashEntry*[newCapacity]);
+        auto elapsed = std::chrono::steady_clock::now() - _created;
+        return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+    }
 
-        for (size_t i = 0; i < capacity; ++i)
+    /// @brief Wrapping difference, correct as long as the hand visits every bucket within 49 days
+    bool expired(uint32_t stamp, uint32_t now) const
+    {
+        return _ttlMs && static_cast<uint32_t>(now - stamp) >= _ttlMs;
+    }
+
+    bool expired(const HashEntry* entry, uint32_t now) const
+    {
+        return expired(entry->stamp, now);
+    }
+
+    /// @brief Mark an entry as recently used for CLOCK, only written when the bit is clear
+    void touch(HashEntry* entry) const
+    {
+        if (_maxEntries && !entry->referenced.load(std::memory_order_relaxed))
         {
-            HashEntry* entry = _table[i];
-            while (entry)
+            entry->referenced.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    /// @brief Append a new entry to the list of its type, caller holds the entry's stripe lock
+    void indexEntry(HashEntry* entry)
+    {
+        if constexpr (TypeIndexed)
+        {
+            auto& list = _types[entry->message.MessageType];
+            std::unique_lock<std::shared_mutex> lock(list.mutex);
+
+            entry->typeSlot = static_cast<uint32_t>(list.entries.size());
+            list.entries.push_back(entry);
+        }
+    }
+
+    /// @brief Swap remove an entry from its type list in O(1), caller holds the entry's stripe lock
+    void unindexEntry(HashEntry* entry)
+    {
+        if constexpr (TypeIndexed)
+        {
+            auto& list = _types[entry->message.MessageType];
+            std::unique_lock<std::shared_mutex> lock(list.mutex);
+
+            HashEntry* last = list.entries.back();
+            list.entries[entry->typeSlot] = last;
+            last->typeSlot = entry->typeSlot;
+            list.entries.pop_back();
+        }
+    }
+
+    /// @brief Unlink the entry held by link, caller holds the stripe lock with its version odd
+    void unlinkEntry(Bucket* link, HashEntry* entry)
+    {
+        unindexEntry(entry);
+        link->store(entry->next.load(std::memory_order_relaxed), std::memory_order_release);
+        _size.fetch_sub(1, std::memory_order_release);
+
+        if (_onDrop)
+        {
+            _onDrop(entry->message.MessageId);
+        }
+        retireEntry(entry);
+    }
+
+    /// @brief Retire an unlinked entry, optimistic readers may still be walking through it
+    void retireEntry(HashEntry* entry)
+    {
+        if (!_epochs->canEnter())
+        {
+            _epochs->retireOrphan(entry);
+            return;
+        }
+
+        Guard guard(*_epochs);
+        _epochs->retireNode(entry);
+    }
+
+    /// @brief Advance the CLOCK hand over `buckets` buckets of the current table, caller holds _globalMutex shared
+    /// Expired entries are dropped; while the map is full a referenced entry loses its bit
+    /// (second chance) and an unreferenced one is evicted.
+    void clockStep(size_t buckets, uint32_t now)
+    {
+        Bucket* table = _table.load(std::memory_order_relaxed);
+        const size_t mask = _capacity.load(std::memory_order_relaxed) - 1;
+
+        for (size_t n = 0; n < buckets; ++n)
+        {
+            const size_t index = _clockHand.fetch_add(1, std::memory_order_relaxed) & mask;
+            const size_t lockIndex = index & (Size - 1);
+            bool changed = false;
+
+            lockProfiled(_locks[lockIndex], LockClass::Bucket);
+
+            Bucket* link = &table[index];
+            while (HashEntry* entry = link->load(std::memory_order_relaxed))
             {
-                HashEntry* next = entry->next;
-                size_t index = hash(entry->message.MessageId, newCapacity);
+                bool evict = false;
+                if (expired(entry, now))
+                {
+                    _expirations.fetch_add(1, std::memory_order_relaxed);
+                    evict = true;
+                }
+                else if (_maxEntries && _size.load(std::memory_order_relaxed) >= _maxEntries)
+                {
+                    if (entry->referenced.load(std::memory_order_relaxed))
+                    {
+                        entry->referenced.store(false, std::memory_order_relaxed);
+                    }
+                    else
+                    {
+                        _evictions.fetch_add(1, std::memory_order_relaxed);
+                        evict = true;
+                    }
+                }
+
+                if (!evict)
+                {
+                    link = &entry->next;
+                    continue;
+                }
 
-                entry->next = newTable[index];
-                newTable[index] = entry;
+                if (!changed)
+                {
+                    _versions[lockIndex].fetch_add(1, std::memory_order_relaxed);
+                    preserve(table, mask + 1, index);
+                    changed = true;
+                }
+                unlinkEntry(link, entry);
+            }
 
-                entry = next;
+            if (changed)
+            {
+                unlockStripe(lockIndex);
+            }
+            else
+            {
+                _locks[lockIndex].unlock();
             }
         }
+    }
 
-        std::unique_ptr<HashEntry*[]> oldTable = std::move(_table);
-        std::shared_ptr<SharedMutex[]> newLockPool = std::make_shared<SharedMutex[]>(newCapacity);
+    /// @brief Bounded maps: sweep until one more entry fits (at most CLOCK_SCAN_LIMIT buckets),
+    /// with a TTL also sweep CLOCK_BUCKETS buckets so expired entries go away at the insert rate
+    void makeRoom(uint32_t now)
+    {
+        if (_maxEntries)
+        {
+            for (size_t scanned = 0; scanned < CLOCK_SCAN_LIMIT && _size.load(std::memory_order_relaxed) >= _maxEntries;
+                 scanned += CLOCK_BUCKETS)
+            {
+                clockStep(CLOCK_BUCKETS, now);
+            }
+        }
 
-        for (size_t i = 0; i < newCapacity; ++i)
+        if (_ttlMs)
         {
-            newLockPool[i] = SharedMutex();  // Create new mutexes
+            clockStep(CLOCK_BUCKETS, now);
         }
+    }
 
-        _table = std::move(newTable);
-        _locks = newLockPool;
-        _capacity.store(newCapacity, std::memory_order_release);
+    /// @brief calloc'ed tables are zeroed lazily by the kernel, allocation cost does not grow with size
+    /// The buckets are followed by one generation per bucket and the generation the table was created in.
+    static Bucket* allocateTable(size_t capacity)
+    {
+        auto* table = static_cast<Bucket*>(
+            std::calloc(1, capacity * sizeof(Bucket) + (capacity + 1) * sizeof(std::atomic<uint32_t>)));
+        if (!table)
+        {
+            throw std::bad_alloc();
+        }
+
+        return table;
     }
 
-  public:
-    HashMap()
-        : _table(std::make_unique<HashEntry*[]>(Size))
-        , _locks(std::make_shared<SharedMutex[]>(Size))
-    // , _locks(std::make_shared<Spinlock[]>(Size))
+    /// @brief Snapshot generation of the last change of every bucket, [capacity] is the table's own
+    static std::atomic<uint32_t>* generations(Bucket* table, size_t capacity)
     {
-        _rehashFuture = std::async(std::launch::async, &HashMap::rehashMonitor, this);
+        return reinterpret_cast<std::atomic<uint32_t>*>(table + capacity);
     }
 
-    ~HashMap()
+    /// @brief Copy a bucket into every open snapshot that still sees its contents, before a writer changes it
+    /// Caller holds _globalMutex shared and the bucket's stripe lock, so no snapshot is taken meanwhile.
+    void preserve(Bucket* table, size_t capacity, size_t index) const
     {
-        _stopRehashing.store(true, std::memory_order_relaxed);
-        if (_rehashFuture.valid())
+        if (!_openSnapshots.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        auto* generation = generations(table, capacity);
+        const uint32_t changed = std::max(
+            generation[index].load(std::memory_order_relaxed), generation[capacity].load(std::memory_order_relaxed));
+        const uint32_t latest = _snapshotGeneration.load(std::memory_order_relaxed);
+        if (changed >= latest)
         {
-            _rehashFuture.get();  // Wait for the rehashing thread to finish
+            return;  // already preserved, or the table is newer than every snapshot
         }
 
-        auto capacity = _capacity.load(std::memory_order_relaxed);
+        std::vector<SnapshotEntry> entries;
+        for (HashEntry* entry = table[index].load(std::memory_order_relaxed); entry;
+             entry = entry->next.load(std::memory_order_relaxed))
+        {
+            entries.push_back(SnapshotEntry{entry->message, entry->stamp});
+        }
 
-        // Delete all entries in the hash table
-        for (size_t i = 0; i < capacity; ++i)
         {
-            HashEntry* entry = _table[i];
+            std::lock_guard<std::mutex> lock(_snapshotMutex);
+            for (SnapshotState* snapshot : _snapshots)
+            {
+                if (snapshot->generation > changed)
+                {
+                    snapshot->preserved.emplace(&table[index], entries);
+                }
+            }
+        }
+
+        generation[index].store(latest, std::memory_order_relaxed);
+    }
+
+    /// @brief Preserve the key's buckets in both tables, caller holds the key's stripe lock
+    void preserveKey(uint64_t key) const
+    {
+        if (Bucket* oldTable = _oldTable.load(std::memory_order_relaxed))
+        {
+            const size_t oldCapacity = _oldCapacity.load(std::memory_order_relaxed);
+            preserve(oldTable, oldCapacity, hash(key, oldCapacity));
+        }
+
+        const size_t capacity = _capacity.load(std::memory_order_relaxed);
+        preserve(_table.load(std::memory_order_relaxed), capacity, hash(key, capacity));
+    }
+
+    /// @brief Move up to MIGRATE_BUCKETS old buckets to the new table, caller holds _globalMutex shared
+    /// @return true if this call moved the last old bucket
+    bool migrateStep() const
+    {
+        Bucket* oldTable = _oldTable.load(std::memory_order_relaxed);
+        if (!oldTable)
+        {
+            return false;
+        }
+
+        bool completed = false;
+        const size_t oldCapacity = _oldCapacity.load(std::memory_order_relaxed);
+        const size_t newCapacity = _capacity.load(std::memory_order_relaxed);
+        Bucket* table = _table.load(std::memory_order_relaxed);
+
+        for (size_t n = 0; n < MIGRATE_BUCKETS; ++n)
+        {
+            size_t index = _migrateIndex.fetch_add(1, std::memory_order_relaxed);
+            if (index >= oldCapacity)
+            {
+                break;
+            }
+
+            lockStripe(index & (Size - 1), LockClass::Rehash);
+
+            // the old bucket splits into index and index + oldCapacity
+            preserve(oldTable, oldCapacity, index);
+            preserve(table, newCapacity, index);
+            preserve(table, newCapacity, index + oldCapacity);
+
+            HashEntry* entry = oldTable[index].load(std::memory_order_relaxed);
             while (entry)
             {
-                HashEntry* next = entry->next;
-                delete entry;
+                HashEntry* next = entry->next.load(std::memory_order_relaxed);
+                size_t newIndex = hash(entry->message.MessageId, newCapacity);
+
+                entry->next.store(table[newIndex].load(std::memory_order_relaxed), std::memory_order_release);
+                table[newIndex].store(entry, std::memory_order_release);
+
                 entry = next;
             }
+            oldTable[index].store(nullptr, std::memory_order_release);
+
+            unlockStripe(index & (Size - 1));
+
+            if (_migrated.fetch_add(1, std::memory_order_acq_rel) + 1 == oldCapacity)
+            {
+                completed = true;
+            }
         }
+
+        return completed;
     }
 
-    HashMap(const HashMap&) = delete;
-    HashMap& operator=(const HashMap&) = delete;
-    HashMap(HashMap&&) = delete;
-    HashMap& operator=(HashMap&&) = delete;
+    /// @brief Retire the fully migrated old table, called without _globalMutex held
+    void finishResize() const
+    {
+        {
+            std::unique_lock<GlobalMutex> globalLock(lockProfiled(_globalMutex, LockClass::Rehash), std::adopt_lock);
+            _tableVersion.fetch_add(1, std::memory_order_relaxed);
+
+            _retiredTables.push_back(_oldTable.load(std::memory_order_relaxed));
+            _oldTable.store(nullptr, std::memory_order_release);
+            _oldCapacity.store(0, std::memory_order_release);
 
-    void rehashMonitor()
+            _tableVersion.fetch_add(1, std::memory_order_release);
+        }
+
+        _resizing.store(false, std::memory_order_release);
+    }
+
+    /// @brief Install a table of double size next to the current one, called without _globalMutex held
+    void startResize()
     {
-        while (!_stopRehashing.load(std::memory_order_relaxed))
+        bool expected = false;
+        if (!_resizing.compare_exchange_strong(expected, true, std::memory_order_acquire))
         {
-            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            return;  // Another thread is already resizing
+        }
+
+        size_t capacity = _capacity.load(std::memory_order_acquire);
+        Bucket* newTable = allocateTable(capacity << 1);
+
+        std::unique_lock<GlobalMutex> globalLock(lockProfiled(_globalMutex, LockClass::Rehash), std::adopt_lock);
+        _tableVersion.fetch_add(1, std::memory_order_relaxed);
+
+        _oldTable.store(_table.load(std::memory_order_relaxed), std::memory_order_release);
+        _oldCapacity.store(capacity, std::memory_order_release);
+        _table.store(newTable, std::memory_order_release);
+        // snapshots already open do not know the new table, they never need its buckets preserved
+        generations(newTable, capacity << 1)[capacity << 1].store(
+            _snapshotGeneration.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        _migrateIndex.store(0, std::memory_order_relaxed);
+        _migrated.store(0, std::memory_order_relaxed);
+        _capacity.store(capacity << 1, std::memory_order_release);
+
+        _tableVersion.fetch_add(1, std::memory_order_release);
+    }
+
+    /// @brief Bucket of the key in the current table, caller holds _globalMutex shared and the key's stripe lock
+    Bucket* bucket(uint64_t key) const
+    {
+        return &_table.load(std::memory_order_relaxed)[hash(key, _capacity.load(std::memory_order_relaxed))];
+    }
+
+    /// @brief Bucket of the key in the old table while a resize is in progress, empty once migrated
+    Bucket* oldBucket(uint64_t key) const
+    {
+        Bucket* oldTable = _oldTable.load(std::memory_order_relaxed);
+        return oldTable ? &oldTable[hash(key, _oldCapacity.load(std::memory_order_relaxed))] : nullptr;
+    }
 
-            if (_size.load(std::memory_order_acquire) >= _capacity.load(std::memory_order_acquire) * LOAD_FACTOR)
+    static Bucket* findIn(Bucket* link, uint64_t key)
+    {
+        while (HashEntry* entry = link->load(std::memory_order_relaxed))
+        {
+            if (entry->message.MessageId == key)
             {
-                rehash();
+                return link;
             }
+
+            link = &entry->next;
         }
+
+        return nullptr;
     }
 
-    bool insert(const Message& message)
+    /// @brief Link pointing at the key's entry in either table, nullptr if absent
+    Bucket* findEntry(uint64_t key) const
+    {
+        Bucket* old = oldBucket(key);
+        Bucket* found = old ? findIn(old, key) : nullptr;
+
+        return found ? found : findIn(bucket(key), key);
+    }
+
+    /// @brief Lock free chain walk for readers, the caller validates the stripe version afterwards
+    static HashEntry* readChain(const Bucket& head, uint64_t key)
+    {
+        for (HashEntry* entry = head.load(std::memory_order_acquire); entry;
+             entry = entry->next.load(std::memory_order_acquire))
+        {
+            if (entry->message.MessageId == key)
+            {
+                return entry;
+            }
+        }
+
+        return nullptr;
+    }
+
+    /// @brief One optimistic lookup inside an epoch, no lock and no shared write
+    /// @return false if a writer changed the stripe or the tables were swapped meanwhile
+    bool tryFind(uint64_t key, Message& result, bool& found, uint32_t now) const
     {
-        std::shared_lock<std::shared_mutex> globalLock(_globalMutex);
-        // std::shared_ptr<Spinlock[]> lockPool = _locks;
+        const uint64_t tableVersion = _tableVersion.load(std::memory_order_acquire);
+        const auto& version = _versions[stripe(key)];
+        const uint64_t start = version.load(std::memory_order_acquire);
+        if ((tableVersion | start) & 1)
+        {
+            return false;
+        }
 
-        std::shared_ptr<SharedMutex[]> lockPool = _locks;
-        size_t index = hash(message.MessageId, _capacity.load(std::memory_order_relaxed));
+        Bucket* oldTable = _oldTable.load(std::memory_order_acquire);
+        const size_t oldCapacity = _oldCapacity.load(std::memory_order_acquire);
+        Bucket* table = _table.load(std::memory_order_acquire);
+        const size_t capacity = _capacity.load(std::memory_order_acquire);
 
-        lockPool[index].lock();
+        // the loads above may straddle a table swap (e.g. an old table with the capacity 0 of a finished
+        // resize), nothing is indexed unless they all belong to the same tables
+        if (_tableVersion.load(std::memory_order_acquire) != tableVersion)
+        {
+            return false;
+        }
 
-        HashEntry* entry = _table[index];
-        HashEntry* prev = nullptr;
+        HashEntry* entry = oldTable ? readChain(oldTable[hash(key, oldCapacity)], key) : nullptr;
+        if (!entry)
+        {
+            entry = readChain(table[hash(key, capacity)], key);
+        }
+
+        // all loads above are acquire, the version checks cannot move before them
+        if (version.load(std::memory_order_acquire) != start ||
+            _tableVersion.load(std::memory_order_acquire) != tableVersion)
+        {
+            return false;
+        }
 
-        while (entry)
+        found = entry && !expired(entry, now);
+        if (found)
         {
-            if (entry->message.MessageId == message.MessageId)
+            result = entry->message;  // entries are immutable and the epoch keeps them alive
+            touch(entry);
+        }
+        return true;
+    }
+
+    /// @brief Optimistic lookup with retries, caller holds an epoch guard
+    /// @return false if every attempt was invalidated by a writer
+    bool findOptimistic(uint64_t key, Message& result, bool& found, uint32_t now) const
+    {
+        for (size_t attempt = 0; attempt < OPTIMISTIC_RETRIES; ++attempt)
+        {
+            if (tryFind(key, result, found, now))
             {
-                lockPool[index].unlock();
-                return false;
+                return true;
             }
-
-            prev = entry;
-            entry = entry->next;
         }
 
-        // Insert new message
-        HashEntry* newEntry = new HashEntry{message, nullptr};
-        if (prev)
+        return false;
+    }
+
+    /// @brief Insert unless the key is present, caller holds _globalMutex shared
+    /// An expired entry with the same key is replaced, a live duplicate counts as a CLOCK reference.
+    bool insertEntry(const Message& message, uint32_t now)
+    {
+        const size_t index = stripe(message.MessageId);
+        lockProfiled(_locks[index], LockClass::Bucket);
+
+        Bucket* existing = findEntry(message.MessageId);
+        if (existing && !expired(existing->load(std::memory_order_relaxed), now))
         {
-            prev->next = newEntry;
+            touch(existing->load(std::memory_order_relaxed));
+            _locks[index].unlock();
+            return false;
         }
-        else
+
+        // Insert new message at the head of its bucket in the current table,
+        // the version only moves here so duplicates do not send readers into a retry
+        _versions[index].fetch_add(1, std::memory_order_relaxed);
+        preserveKey(message.MessageId);
+
+        if (existing)
         {
-            _table[index] = newEntry;
+            _expirations.fetch_add(1, std::memory_order_relaxed);
+            unlinkEntry(existing, existing->load(std::memory_order_relaxed));
         }
 
+        Bucket* head = bucket(message.MessageId);
+        HashEntry* entry = createEntry(message, head->load(std::memory_order_relaxed), now);
+        indexEntry(entry);
+        head->store(entry, std::memory_order_release);
+
         _size.fetch_add(1, std::memory_order_release);
 
-        lockPool[index].unlock();
+        unlockStripe(index);
         return true;
     }
 
-    bool find(uint64_t messageId, Message& result) const
+    /// @brief Finish a resize this thread completed and start the next one if the load factor is crossed
+    void afterInsert(bool completed)
     {
-        std::shared_lock<std::shared_mutex> globalLock(_globalMutex);
-        // std::shared_ptr<Spinlock[]> lockPool = _locks;
-        std::shared_ptr<SharedMutex[]> lockPool = _locks;
-        size_t index = hash(messageId, _capacity.load(std::memory_order_relaxed));
+        if (completed)
+        {
+            finishResize();
+        }
+
+        // a bounded table is sized for maxEntries and evicts instead of growing
+        if (!_maxEntries && _size.load(std::memory_order_acquire) >= _capacity.load(std::memory_order_acquire) * LOAD_FACTOR)
+        {
+            startResize();
+        }
+    }
 
-        lockPool[index].lock();
+    /// @brief Prefetch the current bucket of every key, then the first entry of every bucket
+    /// Capacity is read before the table: a larger capacity is only published after its table.
+    template <int Rw, typename KeyOf> void prefetchBuckets(size_t count, KeyOf&& keyOf) const
+    {
+        const size_t capacity = _capacity.load(std::memory_order_acquire);
+        Bucket* table = _table.load(std::memory_order_acquire);
 
-        HashEntry* entry = _table[index];
-        while (entry)
+        for (size_t i = 0; i < count; ++i)
         {
-            if (entry->message.MessageId == messageId)
+            __builtin_prefetch(&table[hash(keyOf(i), capacity)], Rw);
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (HashEntry* head = table[hash(keyOf(i), capacity)].load(std::memory_order_acquire))
             {
-                result = entry->message;
-                lockPool[index].unlock();
-                return true;
+                __builtin_prefetch(head);
+            }
+        }
+    }
+
+    /// @brief Fallback for a stripe that keeps changing under the optimistic reader
+    bool findLocked(uint64_t messageId, Message& result, uint32_t now) const
+    {
+        bool completed = false;
+        bool found = false;
+        {
+            std::shared_lock<GlobalMutex> globalLock(lockSharedProfiled(_globalMutex, LockClass::Global), std::adopt_lock);
+            completed = migrateStep();
+
+            auto& lock = _locks[stripe(messageId)];
+            lockSharedProfiled(lock, LockClass::Bucket);
+
+            Bucket* entry = findEntry(messageId);
+            if (entry && !expired(entry->load(std::memory_order_relaxed), now))
+            {
+                result = entry->load(std::memory_order_relaxed)->message;
+                touch(entry->load(std::memory_order_relaxed));
+                found = true;
             }
 
-            entry = entry->next;
+            lock.unlock_shared();
         }
 
-        lockPool[index].unlock();
-        return false;
+        if (completed)
+        {
+            finishResize();
+        }
+        return found;
     }
 
-    bool remove(uint64_t messageId)
+    /// @brief Remove the key's entry if pred(message) holds, an expired entry is always dropped
+    /// @return true if a live entry was removed, its message is copied to removedMessage
+    template <typename Pred> bool removeIf(uint64_t messageId, Pred&& pred, Message& removedMessage)
     {
-        std::shared_lock<std::shared_mutex> globalLock(_globalMutex);
-        std::shared_ptr<SharedMutex[]> lockPool = _locks;
-        size_t index = hash(messageId, _capacity.load(std::memory_order_relaxed));
-        // std::shared_ptr<Spinlock[]> lockPool = _locks;
+        bool completed = false;
+        bool visible = false;
+        HashEntry* removed = nullptr;
+        {
+            const uint32_t stamp = now();
+            std::shared_lock<GlobalMutex> globalLock(lockSharedProfiled(_globalMutex, LockClass::Global), std::adopt_lock);
+            completed = migrateStep();
+
+            const size_t index = stripe(messageId);
+            lockStripe(index);
 
-        lockPool[index].lock();
+            if (Bucket* entry = findEntry(messageId))
+            {
+                HashEntry* candidate = entry->load(std::memory_order_relaxed);
+                const bool live = !expired(candidate, stamp);
+
+                if (!live || pred(candidate->message))
+                {
+                    preserveKey(messageId);
+                    removed = candidate;
+                    visible = live;
 
-        HashEntry* entry = _table[index];
-        HashEntry* prev = nullptr;
+                    unindexEntry(removed);
+                    entry->store(removed->next.load(std::memory_order_relaxed), std::memory_order_release);
+                    _size.fetch_sub(1, std::memory_order_release);
 
-        while (entry)
+                    if (!live)
+                    {
+                        _expirations.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+            }
+
+            unlockStripe(index);
+        }
+
+        if (removed)
         {
-            if (entry->message.MessageId == messageId)
+            removedMessage = removed->message;
+            if (_onDrop)
             {
-                if (prev)
+                _onDrop(messageId);
+            }
+            retireEntry(removed);
+        }
+        if (completed)
+        {
+            finishResize();
+        }
+        return visible;
+    }
+
+    /// @brief Walk a snapshot bucket by bucket: changed buckets from their preserved copy, the others
+    /// live under their stripe lock, fn runs without any lock held
+    template <typename Fn> void visitSnapshot(const SnapshotState& snapshot, Fn&& fn) const
+    {
+        std::vector<SnapshotEntry> entries;
+        for (size_t t = 0; t < snapshot.tables.size(); ++t)
+        {
+            Bucket* table = snapshot.tables[t];
+            if (!table)
+            {
+                continue;
+            }
+
+            const size_t capacity = snapshot.capacities[t];
+            auto* generation = generations(table, capacity);
+
+            for (size_t i = 0; i < capacity; ++i)
+            {
+                entries.clear();
+
+                auto& lock = _locks[i & (Size - 1)];
+                lockSharedProfiled(lock, LockClass::Bucket);
+
+                const bool changed = generation[i].load(std::memory_order_relaxed) >= snapshot.generation;
+                if (!changed)
                 {
-                    prev->next = entry->next;
+                    for (HashEntry* entry = table[i].load(std::memory_order_relaxed); entry;
+                         entry = entry->next.load(std::memory_order_relaxed))
+                    {
+                        entries.push_back(SnapshotEntry{entry->message, entry->stamp});
+                    }
                 }
-                else
+
+                lock.unlock_shared();
+
+                if (changed)
                 {
-                    _table[index] = entry->next;
+                    // the copy was made before the generation moved and never changes afterwards
+                    std::lock_guard<std::mutex> guard(_snapshotMutex);
+                    entries = snapshot.preserved.at(&table[i]);
                 }
 
-                delete entry;
-                _size.fetch_sub(1, std::memory_order_release);
+                for (const auto& entry : entries)
+                {
+                    if (!expired(entry.stamp, snapshot.stamp))
+                    {
+                        fn(entry.message);
+                    }
+                }
+            }
+        }
+    }
 
-                lockPool[index].unlock();
-                return true;
+    void closeSnapshot(const SnapshotState* snapshot) const
+    {
+        std::lock_guard<std::mutex> lock(_snapshotMutex);
+        std::erase(_snapshots, snapshot);
+        _openSnapshots.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+  public:
+    /// @brief Point-in-time view of the map, see snapshot(), must not outlive the map
+    class Snapshot
+    {
+        friend class HashMap;
+
+        const HashMap* _map;
+        std::unique_ptr<SnapshotState> _state;
+
+        Snapshot(const HashMap* map, std::unique_ptr<SnapshotState> state)
+            : _map(map)
+            , _state(std::move(state))
+        {
+        }
+
+      public:
+        Snapshot(Snapshot&&) noexcept = default;
+        Snapshot& operator=(Snapshot&&) = delete;
+
+        ~Snapshot()
+        {
+            if (_state)
+            {
+                _map->closeSnapshot(_state.get());
             }
+        }
 
-            prev = entry;
-            entry = entry->next;
+        /// @brief Stored entries when taken, with a TTL this includes expired entries
+        size_t size() const
+        {
+            return _state->size;
         }
 
-        lockPool[index].unlock();
-        return false;
+        /// @brief Visit every message live when the snapshot was taken exactly once,
+        /// no lock is held while fn runs so it may use the map
+        template <typename Fn> void forEach(Fn&& fn) const
+        {
+            _map->visitSnapshot(*_state, fn);
+        }
+    };
+
+    explicit HashMap(const Allocator& allocator = Allocator())
+        : HashMap(HashMapLimits{}, allocator)
+    {
     }
 
+    explicit HashMap(const HashMapLimits& limits, const Allocator& allocator = Allocator())
+        : _allocator(allocator)
+        , _epochs(std::make_unique<EpochManager<HashEntry, EntryDeleter>>(EntryDeleter{_allocator}))
+        , _capacity(initialCapacity(limits))
+        , _table(allocateTable(initialCapacity(limits)))
+        , _locks(std::make_unique<StripeLock[]>(Size))
+        , _versions(std::make_unique<std::atomic<uint64_t>[]>(Size))
+        , _maxEntries(limits.maxEntries)
+        , _ttlMs(static_cast<uint32_t>(limits.ttl.count()))
+        , _created(std::chrono::steady_clock::now())
+    {
+        if constexpr (TypeIndexed)
+        {
+            _types = std::make_unique<TypeList[]>(MESSAGE_TYPES);
+        }
+    }
+
+    ~HashMap()
+    {
+        for (bool old : {true, false})
+        {
+            Bucket* table = old ? _oldTable.load() : _table.load();
+            if (!table)
+            {
+                continue;
+            }
+
+            size_t capacity = old ? _oldCapacity.load() : _capacity.load();
+
+            // Delete all entries in the hash table
+            for (size_t i = 0; i < capacity; ++i)
+            {
+                HashEntry* entry = table[i].load(std::memory_order_relaxed);
+                while (entry)
+                {
+                    HashEntry* next = entry->next.load(std::memory_order_relaxed);
+                    destroyEntry(entry);
+                    entry = next;
+                }
+            }
+
+            std::free(table);
+        }
+
+        for (Bucket* table : _retiredTables)
+        {
+            std::free(table);
+        }
+    }
+
+    HashMap(const HashMap&) = delete;
+    HashMap& operator=(const HashMap&) = delete;
+    HashMap(HashMap&&) = delete;
+    HashMap& operator=(HashMap&&) = delete;
+
+    bool insert(const Message& message)
+    {
+        bool completed = false;
+        bool inserted = false;
+        {
+            std::shared_lock<GlobalMutex> globalLock(lockSharedProfiled(_globalMutex, LockClass::Global), std::adopt_lock);
+            completed = migrateStep();
+
+            const uint32_t stamp = now();
+            makeRoom(stamp);
+            inserted = insertEntry(message, stamp);
+        }
+
+        afterInsert(completed);
+        return inserted;
+    }
+
+    /// @brief Insert a batch under one global lock, bucket misses of the whole batch overlap
+    /// @param inserted bit i is set if messages[i] was inserted, N bounds the batch size
+    /// @return number of inserted messages
+    template <size_t N> size_t insertBatch(std::span<const Message> messages, std::bitset<N>& inserted)
+    {
+        assert(messages.size() <= N && "Batch is larger than the result bitset");
+
+        bool completed = false;
+        size_t count = 0;
+        inserted.reset();
+        {
+            std::shared_lock<GlobalMutex> globalLock(lockSharedProfiled(_globalMutex, LockClass::Global), std::adopt_lock);
+            prefetchBuckets<1>(messages.size(), [&](size_t i) { return messages[i].MessageId; });
+
+            const uint32_t stamp = now();
+            for (size_t i = 0; i < messages.size(); ++i)
+            {
+                completed |= migrateStep();
+                makeRoom(stamp);
+
+                inserted[i] = insertEntry(messages[i], stamp);
+                count += inserted[i];
+            }
+        }
+
+        afterInsert(completed);
+        return count;
+    }
+
+    /// @brief Lock free unless the key's stripe keeps being written, then falls back to the locks
+    /// A thread that gets no epoch slot (MAX_THREADS in use) always reads under the locks
+    bool find(uint64_t messageId, Message& result) const
+    {
+        const uint32_t stamp = now();
+        if (_epochs->canEnter())
+        {
+            Guard guard(*_epochs);
+
+            bool found = false;
+            if (findOptimistic(messageId, result, found, stamp))
+            {
+                return found;
+            }
+        }
+
+        return findLocked(messageId, result, stamp);
+    }
+
+    /// @brief Look up a batch, bucket misses of the whole batch overlap
+    /// @param results results[i] receives the message of ids[i] if found
+    /// @param found bit i is set if ids[i] was found, N bounds the batch size
+    /// @return number of found messages
+    template <size_t N>
+    size_t findBatch(std::span<const uint64_t> ids, std::span<Message> results, std::bitset<N>& found) const
+    {
+        assert(ids.size() <= N && ids.size() <= results.size() && "Batch is larger than the results");
+
+        std::bitset<N> contended;
+        found.reset();
+
+        const uint32_t stamp = now();
+        if (!_epochs->canEnter())
+        {
+            contended.set();
+        }
+        else
+        {
+            Guard guard(*_epochs);
+            prefetchBuckets<0>(ids.size(), [&](size_t i) { return ids[i]; });
+
+            for (size_t i = 0; i < ids.size(); ++i)
+            {
+                bool hit = false;
+                contended[i] = !findOptimistic(ids[i], results[i], hit, stamp);
+                found[i] = hit;
+            }
+        }
+
+        for (size_t i = 0; i < ids.size(); ++i)
+        {
+            if (contended[i])
+            {
+                found[i] = findLocked(ids[i], results[i], stamp);
+            }
+        }
+
+        return found.count();
+    }
+
+    bool remove(uint64_t messageId)
+    {
+        Message removed;
+        return removeIf(messageId, [](const Message&) { return true; }, removed);
+    }
+
+    /// @brief Size an empty map for `entries` up front, a bulk load then never resizes
+    /// Call before the map is shared, a bounded map keeps the capacity it was created with.
+    /// @return false if the map is bounded or not empty
+    bool reserve(size_t entries)
+    {
+        const size_t capacity = initialCapacity(HashMapLimits{entries, {}});
+
+        std::unique_lock<GlobalMutex> globalLock(lockProfiled(_globalMutex, LockClass::Global), std::adopt_lock);
+        if (_maxEntries || _size.load(std::memory_order_relaxed) || _oldTable.load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+        if (capacity <= _capacity.load(std::memory_order_relaxed))
+        {
+            return true;
+        }
+
+        Bucket* table = allocateTable(capacity);
+        generations(table, capacity)[capacity].store(
+            _snapshotGeneration.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+        _tableVersion.fetch_add(1, std::memory_order_relaxed);
+        _retiredTables.push_back(_table.load(std::memory_order_relaxed));
+        _table.store(table, std::memory_order_release);
+        _capacity.store(capacity, std::memory_order_release);
+        _tableVersion.fetch_add(1, std::memory_order_release);
+
+        return true;
+    }
+
+    /// @brief Stored entries, with a TTL this includes expired entries the CLOCK hand has not reached yet
     size_t size() const
     {
         return _size.load(std::memory_order_acquire);
     }
 
+    /// @brief Stored messages of one type in O(1), with a TTL expired entries count until they are swept
+    size_t countType(uint8_t type) const
+        requires TypeIndexed
+    {
+        auto& list = _types[type];
+        std::shared_lock<std::shared_mutex> lock(list.mutex);
+        return list.entries.size();
+    }
+
+    /// @brief Visit every live message of one type in O(result) under the type's shared lock,
+    /// fn must not modify the map
+    template <typename Fn>
+    void forEachOfType(uint8_t type, Fn&& fn) const
+        requires TypeIndexed
+    {
+        const uint32_t stamp = now();
+        auto& list = _types[type];
+        std::shared_lock<std::shared_mutex> lock(list.mutex);
+
+        for (const HashEntry* entry : list.entries)
+        {
+            if (!expired(entry, stamp))
+            {
+                fn(entry->message);
+            }
+        }
+    }
+
+    /// @brief Visit every live message with first <= MessageType <= last, one type lock at a time
+    template <typename Fn>
+    void forEachInTypeRange(uint8_t first, uint8_t last, Fn&& fn) const
+        requires TypeIndexed
+    {
+        for (unsigned type = first; type <= last; ++type)
+        {
+            forEachOfType(static_cast<uint8_t>(type), fn);
+        }
+    }
+
+    /// @brief Remove the messages of one type and append them to out, concurrent drains never
+    /// hand out the same message twice
+    /// @return number of drained messages
+    size_t drainType(uint8_t type, std::vector<Message>& out)
+        requires TypeIndexed
+    {
+        std::vector<Message> candidates;
+        forEachOfType(type, [&](const Message& message) { candidates.push_back(message); });
+
+        // the id may have been removed and reused with another type since the scan
+        size_t drained = 0;
+        for (const auto& candidate : candidates)
+        {
+            Message message;
+            if (removeIf(candidate.MessageId, [type](const Message& stored) { return stored.MessageType == type; },
+                    message))
+            {
+                out.push_back(message);
+                ++drained;
+            }
+        }
+
+        return drained;
+    }
+
+    /// @brief Take a point-in-time view in O(1), only waits for the writers in flight
+    /// Writers copy a bucket into the snapshot on their first change to it while it is open,
+    /// so an open snapshot costs memory and writer time in proportion to the buckets changed.
+    Snapshot snapshot() const
+    {
+        auto state = std::make_unique<SnapshotState>();
+        state->stamp = now();
+
+        std::unique_lock<GlobalMutex> globalLock(lockProfiled(_globalMutex, LockClass::Global), std::adopt_lock);
+        std::lock_guard<std::mutex> lock(_snapshotMutex);
+
+        state->generation = _snapshotGeneration.fetch_add(1, std::memory_order_relaxed) + 1;
+        state->size = _size.load(std::memory_order_relaxed);
+        state->tables = {_table.load(std::memory_order_relaxed), _oldTable.load(std::memory_order_relaxed)};
+        state->capacities = {_capacity.load(std::memory_order_relaxed), _oldCapacity.load(std::memory_order_relaxed)};
+
+        _snapshots.push_back(state.get());
+        _openSnapshots.fetch_add(1, std::memory_order_relaxed);
+
+        return Snapshot(this, std::move(state));
+    }
+
+    /// @brief Call hook(MessageId) for every entry that leaves the map: remove, drainType, CLOCK eviction and
+    /// TTL expiry. The hook may run under a stripe lock and must not call back into the map; set it before
+    /// the map is shared.
+    void onDrop(std::function<void(uint64_t)> hook)
+    {
+        _onDrop = std::move(hook);
+    }
+
+    /// @brief Entries dropped by CLOCK to stay below maxEntries
+    size_t evictions() const
+    {
+        return _evictions.load(std::memory_order_relaxed);
+    }
+
+    /// @brief Entries dropped because their TTL ran out
+    size_t expirations() const
+    {
+        return _expirations.load(std::memory_order_relaxed);
+    }
+
     size_t capacity() const
     {
         return _capacity.load(std::memory_order_acquire);
     }
 
+    /// @brief Chain length distribution of the current table, one stripe locked at a time
+    /// While a resize is in progress entries not migrated yet count in the new bucket they move to.
+    ChainStats chainStats() const
+    {
+        std::shared_lock<GlobalMutex> globalLock(lockSharedProfiled(_globalMutex, LockClass::Global), std::adopt_lock);
+        Bucket* table = _table.load(std::memory_order_relaxed);
+        Bucket* oldTable = _oldTable.load(std::memory_order_relaxed);
+        const size_t capacity = _capacity.load(std::memory_order_relaxed);
+        const size_t oldCapacity = oldTable ? _oldCapacity.load(std::memory_order_relaxed) : capacity;
+
+        // without a resize bucket i alone, during one old bucket i and the new buckets i, i + oldCapacity
+        ChainStats stats;
+        for (size_t i = 0; i < oldCapacity; ++i)
+        {
+            auto& lock = _locks[i & (Size - 1)];
+            lockSharedProfiled(lock, LockClass::Bucket);
+
+            std::array<size_t, 2> lengths{chainLength(table[i]), 0};
+            if (oldTable)
+            {
+                lengths[1] = chainLength(table[i + oldCapacity]);
+                for (HashEntry* entry = oldTable[i].load(std::memory_order_relaxed); entry;
+                     entry = entry->next.load(std::memory_order_relaxed))
+                {
+                    ++lengths[hash(entry->message.MessageId, capacity) != i];
+                }
+            }
+
+            lock.unlock_shared();
+
+            stats.add(lengths[0]);
+            if (oldTable)
+            {
+                stats.add(lengths[1]);
+            }
+        }
+
+        return stats;
+    }
+
     void debug()
     {
-        std::shared_lock<std::shared_mutex> globalLock(_globalMutex);
+        std::shared_lock<GlobalMutex> globalLock(_globalMutex);
+        Bucket* table = _table.load(std::memory_order_relaxed);
+        Bucket* oldTable = _oldTable.load(std::memory_order_relaxed);
+        const size_t oldCapacity = _oldCapacity.load(std::memory_order_relaxed);
+
         for (size_t i = 0; i < _capacity.load(std::memory_order_relaxed); ++i)
         {
-            _locks[i].lock();
+            auto& lock = _locks[i & (Size - 1)];
+            lock.lock_shared();
 
-            HashEntry* entry = _table[i];
-            while (entry)
+            for (HashEntry* entry = table[i].load(); entry; entry = entry->next.load())
             {
                 std::cout << "Index: " << i << " MessageId: " << entry->message.MessageId << std::endl;
-                entry = entry->next;
             }
 
-            _locks[i].unlock();
+            if (oldTable && i < oldCapacity)
+            {
+                for (HashEntry* entry = oldTable[i].load(); entry; entry = entry->next.load())
+                {
+                    std::cout << "Old index: " << i << " MessageId: " << entry->message.MessageId << std::endl;
+                }
+            }
+
+            lock.unlock_shared();
         }
     }
 };
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+
+/// @brief Lock policies for the stripe locks of HashMap, all with lock/unlock and lock_shared/unlock_shared.
+/// Exclusive locks take their shared side exclusively. std::shared_mutex is a policy as it is.
+
+namespace lock_details
+{
+
+inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+constexpr size_t MIN_BACKOFF = 4;  // pause instructions
+constexpr size_t MAX_BACKOFF = 1024;
+constexpr size_t SPINS_BEFORE_YIELD = 64;  // the holder may be preempted on an oversubscribed core
+
+/// @brief Spin with exponential backoff until ready() holds, yielding once the backoff is at its cap
+template <typename Ready> void spinUntil(Ready&& ready)
+{
+    size_t backoff = MIN_BACKOFF;
+    for (size_t spins = 0; !ready(); ++spins)
+    {
+        for (size_t i = 0; i < backoff; ++i)
+        {
+            cpuRelax();
+        }
+
+        backoff = std::min(backoff * 2, MAX_BACKOFF);
+        if (spins >= SPINS_BEFORE_YIELD)
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+}  // namespace lock_details
+
+/// @brief Test and test-and-set spinlock: waiters spin on a plain load (the line stays shared) and back off
+/// exponentially after every lost exchange
+class TTASLock
+{
+    std::atomic<bool> _locked{false};
+
+  public:
+    bool try_lock()
+    {
+        return !_locked.load(std::memory_order_relaxed) && !_locked.exchange(true, std::memory_order_acquire);
+    }
+
+    void lock()
+    {
+        while (!try_lock())
+        {
+            lock_details::spinUntil([this] { return !_locked.load(std::memory_order_relaxed); });
+        }
+    }
+
+    void unlock()
+    {
+        _locked.store(false, std::memory_order_release);
+    }
+
+    void lock_shared()
+    {
+        lock();
+    }
+
+    bool try_lock_shared()
+    {
+        return try_lock();
+    }
+
+    void unlock_shared()
+    {
+        unlock();
+    }
+};
+
+/// @brief FIFO ticket lock: waiters are served in arrival order, no starvation under contention
+class TicketLock
+{
+    std::atomic<uint32_t> _next{0};
+    std::atomic<uint32_t> _serving{0};
+
+  public:
+    /// @brief Take the next ticket only if it is served right away
+    bool try_lock()
+    {
+        uint32_t ticket = _serving.load(std::memory_order_acquire);
+        return _next.compare_exchange_strong(ticket, ticket + 1, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    void lock()
+    {
+        const uint32_t ticket = _next.fetch_add(1, std::memory_order_relaxed);
+        lock_details::spinUntil([&] { return _serving.load(std::memory_order_acquire) == ticket; });
+    }
+
+    void unlock()
+    {
+        // only the holder writes _serving
+        _serving.store(_serving.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    void lock_shared()
+    {
+        lock();
+    }
+
+    bool try_lock_shared()
+    {
+        return try_lock();
+    }
+
+    void unlock_shared()
+    {
+        unlock();
+    }
+};
+
+/// @brief MCS queue lock: every waiter spins on its own cache line and the holder hands the lock to its
+/// successor directly. Queue nodes are thread local, a thread holds at most NODES MCS locks at once.
+class MCSLock
+{
+    struct alignas(64) Node
+    {
+        std::atomic<Node*> next{nullptr};
+        std::atomic<bool> waiting{false};
+        bool used{false};
+    };
+
+    static constexpr size_t NODES = 4;
+
+    std::atomic<Node*> _tail{nullptr};
+    Node* _holder{nullptr};  // node of the current holder, only touched while holding the lock
+
+    static Node* takeNode()
+    {
+        thread_local std::array<Node, NODES> nodes;
+        for (auto& node : nodes)
+        {
+            if (!node.used)
+            {
+                node.used = true;
+                return &node;
+            }
+        }
+
+        throw std::runtime_error("Too many MCS locks held by one thread");
+    }
+
+  public:
+    /// @brief Enqueue only into an empty queue
+    bool try_lock()
+    {
+        Node* node = takeNode();
+        node->next.store(nullptr, std::memory_order_relaxed);
+
+        Node* expected = nullptr;
+        if (_tail.compare_exchange_strong(expected, node, std::memory_order_acq_rel, std::memory_order_relaxed))
+        {
+            _holder = node;
+            return true;
+        }
+
+        node->used = false;
+        return false;
+    }
+
+    void lock()
+    {
+        Node* node = takeNode();
+        node->next.store(nullptr, std::memory_order_relaxed);
+        node->waiting.store(true, std::memory_order_relaxed);
+
+        if (Node* predecessor = _tail.exchange(node, std::memory_order_acq_rel))
+        {
+            predecessor->next.store(node, std::memory_order_release);
+            lock_details::spinUntil([node] { return !node->waiting.load(std::memory_order_acquire); });
+        }
+
+        _holder = node;
+    }
+
+    void unlock()
+    {
+        Node* node = _holder;
+        Node* successor = node->next.load(std::memory_order_acquire);
+        if (!successor)
+        {
+            Node* expected = node;
+            if (_tail.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel, std::memory_order_relaxed))
+            {
+                node->used = false;
+                return;
+            }
+
+            // a successor swapped the tail but has not linked itself yet
+            lock_details::spinUntil([&] { return (successor = node->next.load(std::memory_order_acquire)) != nullptr; });
+        }
+
+        successor->waiting.store(false, std::memory_order_release);
+        node->used = false;
+    }
+
+    void lock_shared()
+    {
+        lock();
+    }
+
+    bool try_lock_shared()
+    {
+        return try_lock();
+    }
+
+    void unlock_shared()
+    {
+        unlock();
+    }
+};
+
+/// @brief No synchronization, for a map owned by a single thread
+class NoLock
+{
+  public:
+    bool try_lock()
+    {
+        return true;
+    }
+
+    void lock()
+    {
+    }
+
+    void unlock()
+    {
+    }
+
+    void lock_shared()
+    {
+    }
+
+    bool try_lock_shared()
+    {
+        return true;
+    }
+
+    void unlock_shared()
+    {
+    }
+};
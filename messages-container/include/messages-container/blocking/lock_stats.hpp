@@ -0,0 +1,229 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#if defined(MESSAGES_CONTAINER_LOCK_STATS)
+#include <csignal>
+#endif
+
+/// @brief Lock contention profiling of the container locks, compiled in with -DMESSAGES_CONTAINER_LOCK_STATS=ON
+/// Every acquisition first tries the lock, only a failed try is timed, so an uncontended acquisition costs one
+/// counter increment. Without the flag lockProfiled/lockSharedProfiled are plain lock/lock_shared calls.
+
+enum class LockClass : size_t
+{
+    Global,  // HashMap _globalMutex for operations (shared) and snapshots
+    Bucket,  // stripe locks of inserts, removes, locked finds and snapshot walks
+    Rehash,  // table installs/retires (_globalMutex exclusive) and stripe locks of bucket migration
+    Count
+};
+
+/// @brief Process wide counters per LockClass, dumped on SIGUSR1 and when the process exits
+class LockStats
+{
+  public:
+    static constexpr size_t HISTOGRAM_BUCKETS = 40;  // wait time in [2^i, 2^(i+1)) ns
+
+  private:
+    struct alignas(64) Counters
+    {
+        std::atomic<uint64_t> acquisitions{0};
+        std::atomic<uint64_t> contended{0};
+        std::atomic<uint64_t> waitNs{0};
+        std::atomic<uint64_t> maxWaitNs{0};
+        std::array<std::atomic<uint64_t>, HISTOGRAM_BUCKETS> histogram{};
+    };
+
+    static constexpr std::array<const char*, static_cast<size_t>(LockClass::Count)> NAMES = {
+        "global", "bucket", "rehash"};
+
+    std::array<Counters, static_cast<size_t>(LockClass::Count)> _counters{};
+
+    inline static std::atomic<bool> _dumpRequested{false};
+    std::atomic<bool> _running{true};
+    std::thread _watcher;
+
+    static void signalHandler(int)
+    {
+        _dumpRequested.store(true, std::memory_order_relaxed);
+    }
+
+    /// @brief Percentile of the contended waits, as the upper bound of its histogram bucket (at most the max)
+    static uint64_t percentile(const Counters& counters, uint64_t contended, double fraction)
+    {
+        const uint64_t max = counters.maxWaitNs.load(std::memory_order_relaxed);
+        const auto rank = static_cast<uint64_t>(static_cast<double>(contended) * fraction);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+        {
+            seen += counters.histogram[i].load(std::memory_order_relaxed);
+            if (seen > rank)
+            {
+                return std::min(uint64_t{2} << i, max);
+            }
+        }
+        return max;
+    }
+
+    LockStats()
+    {
+#if defined(MESSAGES_CONTAINER_LOCK_STATS)
+        std::signal(SIGUSR1, signalHandler);
+
+        // the handler only raises a flag, printing is not async signal safe
+        _watcher = std::thread(
+            [this]
+            {
+                while (_running.load(std::memory_order_relaxed))
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    if (_dumpRequested.exchange(false, std::memory_order_relaxed))
+                    {
+                        dump(std::cerr);
+                    }
+                }
+            });
+#endif
+    }
+
+  public:
+    LockStats(const LockStats&) = delete;
+    LockStats& operator=(const LockStats&) = delete;
+
+    ~LockStats()
+    {
+        _running.store(false, std::memory_order_relaxed);
+        if (_watcher.joinable())
+        {
+            _watcher.join();
+        }
+
+        for (const auto& counters : _counters)
+        {
+            if (counters.acquisitions.load(std::memory_order_relaxed))
+            {
+                dump(std::cerr);
+                break;
+            }
+        }
+    }
+
+    /// @brief Created on the first profiled acquisition, call it early to have SIGUSR1 handled from the start
+    static LockStats& instance()
+    {
+        static LockStats stats;
+        return stats;
+    }
+
+    void record(LockClass lockClass, bool contended, uint64_t waitNs)
+    {
+        auto& counters = _counters[static_cast<size_t>(lockClass)];
+        counters.acquisitions.fetch_add(1, std::memory_order_relaxed);
+        if (!contended)
+        {
+            return;
+        }
+
+        counters.contended.fetch_add(1, std::memory_order_relaxed);
+        counters.waitNs.fetch_add(waitNs, std::memory_order_relaxed);
+
+        uint64_t max = counters.maxWaitNs.load(std::memory_order_relaxed);
+        while (waitNs > max && !counters.maxWaitNs.compare_exchange_weak(max, waitNs, std::memory_order_relaxed))
+        {
+        }
+
+        size_t bucket = 0;
+        while (bucket + 1 < HISTOGRAM_BUCKETS && (waitNs >> (bucket + 1)))
+        {
+            ++bucket;
+        }
+        counters.histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t acquisitions(LockClass lockClass) const
+    {
+        return _counters[static_cast<size_t>(lockClass)].acquisitions.load(std::memory_order_relaxed);
+    }
+
+    uint64_t contended(LockClass lockClass) const
+    {
+        return _counters[static_cast<size_t>(lockClass)].contended.load(std::memory_order_relaxed);
+    }
+
+    void dump(std::ostream& out) const
+    {
+        out << "lock stats\n"
+            << std::left << std::setw(8) << "class" << std::right << std::setw(14) << "acquisitions" << std::setw(12)
+            << "contended" << std::setw(8) << "%" << std::setw(14) << "wait ms" << std::setw(10) << "p50 ns"
+            << std::setw(10) << "p99 ns" << std::setw(12) << "p99.9 ns" << std::setw(12) << "max ns" << "\n";
+
+        for (size_t c = 0; c < _counters.size(); ++c)
+        {
+            const auto& counters = _counters[c];
+            const uint64_t acquisitions = counters.acquisitions.load(std::memory_order_relaxed);
+            const uint64_t contended = counters.contended.load(std::memory_order_relaxed);
+            const double share =
+                acquisitions ? 100.0 * static_cast<double>(contended) / static_cast<double>(acquisitions) : 0.0;
+
+            out << std::left << std::setw(8) << NAMES[c] << std::right << std::setw(14) << acquisitions << std::setw(12)
+                << contended << std::setw(8) << std::fixed << std::setprecision(2) << share << std::setw(14)
+                << std::setprecision(3) << static_cast<double>(counters.waitNs.load(std::memory_order_relaxed)) / 1e6
+                << std::setw(10) << (contended ? percentile(counters, contended, 0.5) : 0) << std::setw(10)
+                << (contended ? percentile(counters, contended, 0.99) : 0) << std::setw(12)
+                << (contended ? percentile(counters, contended, 0.999) : 0) << std::setw(12)
+                << counters.maxWaitNs.load(std::memory_order_relaxed) << "\n";
+        }
+
+        out << std::defaultfloat << std::flush;
+    }
+};
+
+/// @brief lock() that records the acquisition under lockClass when profiling is compiled in
+/// @return mutex, for std::unique_lock(..., std::adopt_lock)
+template <typename Mutex> Mutex& lockProfiled(Mutex& mutex, [[maybe_unused]] LockClass lockClass)
+{
+#if defined(MESSAGES_CONTAINER_LOCK_STATS)
+    if (mutex.try_lock())
+    {
+        LockStats::instance().record(lockClass, false, 0);
+        return mutex;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    mutex.lock();
+    const auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    LockStats::instance().record(lockClass, true, static_cast<uint64_t>(waited.count()));
+#else
+    mutex.lock();
+#endif
+    return mutex;
+}
+
+/// @brief lock_shared() that records the acquisition under lockClass when profiling is compiled in
+/// @return mutex, for std::shared_lock(..., std::adopt_lock)
+template <typename Mutex> Mutex& lockSharedProfiled(Mutex& mutex, [[maybe_unused]] LockClass lockClass)
+{
+#if defined(MESSAGES_CONTAINER_LOCK_STATS)
+    if (mutex.try_lock_shared())
+    {
+        LockStats::instance().record(lockClass, false, 0);
+        return mutex;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    mutex.lock_shared();
+    const auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    LockStats::instance().record(lockClass, true, static_cast<uint64_t>(waited.count()));
+#else
+    mutex.lock_shared();
+#endif
+    return mutex;
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <message.hpp>
+
+#include <array>
+#include <bit>
+#include <bitset>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <span>
+
+/// @brief Routes every MessageId to one of Shards independent inner maps
+/// Each shard has its own locks, size and resize, so a resize or a hot bucket only stalls 1/Shards
+/// of the traffic. Shards are cache line aligned, the lock words of two shards never share a line.
+/// The shard is picked from the high bits of a Fibonacci hash, inner maps index with the low bits,
+/// so keys of one shard still spread over all of its buckets.
+/// @tparam Shards number of shards, power of two
+/// @tparam Inner map type with the HashMap interface (HashMap, FlatHashMap, ...)
+template <size_t Shards, typename Inner> class ShardedHashMap
+{
+    static_assert(Shards > 0 && (Shards & (Shards - 1)) == 0, "Shards must be a power of two");
+
+    static constexpr unsigned SHARD_BITS = std::countr_zero(Shards);
+
+    struct alignas(64) Shard
+    {
+        Inner map;
+    };
+
+    std::unique_ptr<Shard[]> _shards;
+
+  private:
+    static size_t shardIndex(uint64_t messageId)
+    {
+        if constexpr (SHARD_BITS == 0)
+        {
+            return 0;
+        }
+        else
+        {
+            return (messageId * 0x9E3779B97F4A7C15ULL) >> (64 - SHARD_BITS);
+        }
+    }
+
+    Inner& shardFor(uint64_t messageId) const
+    {
+        return _shards[shardIndex(messageId)].map;
+    }
+
+    /// @brief Group a batch by shard (counting sort), fn(map, indices) runs once per non empty shard
+    template <size_t N, typename KeyOf, typename Fn> void forEachShard(size_t count, KeyOf&& keyOf, Fn&& fn) const
+    {
+        std::array<uint32_t, Shards + 1> offsets{};
+        std::array<uint32_t, N> shardOf;
+        std::array<uint32_t, N> order;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            shardOf[i] = static_cast<uint32_t>(shardIndex(keyOf(i)));
+            ++offsets[shardOf[i] + 1];
+        }
+
+        for (size_t shard = 0; shard < Shards; ++shard)
+        {
+            offsets[shard + 1] += offsets[shard];
+        }
+
+        auto next = offsets;
+        for (size_t i = 0; i < count; ++i)
+        {
+            order[next[shardOf[i]]++] = static_cast<uint32_t>(i);
+        }
+
+        for (size_t shard = 0; shard < Shards; ++shard)
+        {
+            if (offsets[shard] != offsets[shard + 1])
+            {
+                fn(_shards[shard].map,
+                    std::span<const uint32_t>(order.data() + offsets[shard], offsets[shard + 1] - offsets[shard]));
+            }
+        }
+    }
+
+  public:
+    ShardedHashMap()
+        : _shards(std::make_unique<Shard[]>(Shards))
+    {
+    }
+
+    ShardedHashMap(const ShardedHashMap&) = delete;
+    ShardedHashMap& operator=(const ShardedHashMap&) = delete;
+    ShardedHashMap(ShardedHashMap&&) = delete;
+    ShardedHashMap& operator=(ShardedHashMap&&) = delete;
+
+    bool insert(const Message& message)
+    {
+        return shardFor(message.MessageId).insert(message);
+    }
+
+    /// @brief Split the batch by shard and hand every shard its part as one inner batch
+    template <size_t N> size_t insertBatch(std::span<const Message> messages, std::bitset<N>& inserted)
+    {
+        assert(messages.size() <= N && "Batch is larger than the result bitset");
+
+        std::array<Message, N> batch;
+        size_t count = 0;
+        inserted.reset();
+
+        forEachShard<N>(messages.size(), [&](size_t i) { return messages[i].MessageId; },
+            [&](Inner& map, std::span<const uint32_t> indices)
+            {
+                for (size_t j = 0; j < indices.size(); ++j)
+                {
+                    batch[j] = messages[indices[j]];
+                }
+
+                std::bitset<N> shardInserted;
+                count += map.insertBatch(std::span<const Message>(batch.data(), indices.size()), shardInserted);
+
+                for (size_t j = 0; j < indices.size(); ++j)
+                {
+                    inserted[indices[j]] = shardInserted[j];
+                }
+            });
+
+        return count;
+    }
+
+    bool find(uint64_t messageId, Message& result) const
+    {
+        return shardFor(messageId).find(messageId, result);
+    }
+
+    template <size_t N>
+    size_t findBatch(std::span<const uint64_t> ids, std::span<Message> results, std::bitset<N>& found) const
+    {
+        assert(ids.size() <= N && ids.size() <= results.size() && "Batch is larger than the results");
+
+        std::array<uint64_t, N> batchIds;
+        std::array<Message, N> batchResults;
+        size_t count = 0;
+        found.reset();
+
+        forEachShard<N>(ids.size(), [&](size_t i) { return ids[i]; },
+            [&](const Inner& map, std::span<const uint32_t> indices)
+            {
+                for (size_t j = 0; j < indices.size(); ++j)
+                {
+                    batchIds[j] = ids[indices[j]];
+                }
+
+                std::bitset<N> shardFound;
+                count += map.findBatch(std::span<const uint64_t>(batchIds.data(), indices.size()),
+                    std::span<Message>(batchResults.data(), indices.size()), shardFound);
+
+                for (size_t j = 0; j < indices.size(); ++j)
+                {
+                    if (shardFound[j])
+                    {
+                        results[indices[j]] = batchResults[j];
+                        found[indices[j]] = true;
+                    }
+                }
+            });
+
+        return count;
+    }
+
+    bool remove(uint64_t messageId)
+    {
+        return shardFor(messageId).remove(messageId);
+    }
+
+    /// @brief Sum over shards, not a snapshot while writers are running
+    size_t size() const
+    {
+        size_t size = 0;
+        for (size_t i = 0; i < Shards; ++i)
+        {
+            size += _shards[i].map.size();
+        }
+        return size;
+    }
+
+    size_t capacity() const
+    {
+        size_t capacity = 0;
+        for (size_t i = 0; i < Shards; ++i)
+        {
+            capacity += _shards[i].map.capacity();
+        }
+        return capacity;
+    }
+
+    static constexpr size_t shards()
+    {
+        return Shards;
+    }
+
+    void debug()
+    {
+        for (size_t i = 0; i < Shards; ++i)
+        {
+            std::cout << "Shard: " << i << std::endl;
+            _shards[i].map.debug();
+        }
+    }
+};
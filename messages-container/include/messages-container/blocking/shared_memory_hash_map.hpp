@@ -0,0 +1,519 @@
+#pragma once
+
+#include <message.hpp>
+
+#include "../hash_policies.hpp"
+
+#include <atomic>
+#include <bit>
+#include <bitset>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// @brief Chained hash map in one shared memory region, several processes insert into and query it
+/// Links are 32 bit node indices instead of pointers, every process may map the region at another address.
+/// Chains are guarded by striped robust process-shared mutexes: when a process dies holding one, the next
+/// locker takes it over and recounts the stripe. Every change is published by a single store into a chain,
+/// so a crash leaves the chains consistent and leaks at most one node.
+/// The capacity is fixed when the region is created, removed nodes go to a lock free free list (tagged head),
+/// a full map rejects inserts and counts them.
+/// A named region (shm_open) outlives its processes, a restarted worker reattaches to the same state.
+/// The anonymous region (memfd) is shared with children through fork.
+/// @tparam Size number of lock stripes, power of two, all processes must agree on it
+/// @tparam Hash hash policy (hash_policies.hpp), the bucket is the low bits of its result, all processes must
+/// agree on it
+template <size_t Size = 256, typename Hash = MurmurHash> class SharedMemoryHashMap
+{
+    static_assert((Size & (Size - 1)) == 0, "Size must be a power of two");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared atomics must be address free");
+
+    static constexpr uint64_t MAGIC = 0x3250414D4D48534DULL;  // "MSHMMAP2"
+    static constexpr uint32_t NIL = 0;  // node indices start at 1
+    static constexpr float LOAD_FACTOR = 0.75f;
+    static constexpr auto ATTACH_TIMEOUT = std::chrono::seconds(5);
+
+    struct Header
+    {
+        std::atomic<uint64_t> magic;  // written last by the creating process
+        uint64_t capacity;
+        uint64_t buckets;
+        uint64_t stripes;
+        uint64_t bytes;
+        uint64_t hash;  // Hash of MAGIC, a process with another hash policy must not attach
+        std::atomic<uint64_t> freeList;  // ABA tag << 32 | node index
+        std::atomic<uint64_t> unused;  // nodes from here on were never handed out
+        std::atomic<uint64_t> rejected;  // inserts refused because every node was in use
+    };
+
+    struct alignas(64) Stripe
+    {
+        pthread_mutex_t mutex;
+        std::atomic<uint64_t> count;  // entries in the stripe's buckets, changed under mutex
+    };
+
+    struct Node
+    {
+        Message message;
+        std::atomic<uint32_t> next;  // chain while linked, free list while free
+    };
+
+    using Bucket = std::atomic<uint32_t>;
+
+    /// @brief Offsets of the parts of a region holding `capacity` nodes
+    struct Layout
+    {
+        size_t buckets;
+        size_t stripes;
+        size_t bucketArray;
+        size_t nodes;
+        size_t bytes;
+    };
+
+    int _fd{-1};
+    void* _region{MAP_FAILED};
+    size_t _bytes{0};
+
+    Header* _header{nullptr};
+    Stripe* _stripes{nullptr};
+    Bucket* _buckets{nullptr};
+    Node* _nodes{nullptr};
+    size_t _mask{0};
+
+  public:
+    static constexpr size_t DEFAULT_CAPACITY = 1 << 20;
+
+  private:
+    static size_t alignUp(size_t offset, size_t alignment)
+    {
+        return (offset + alignment - 1) & ~(alignment - 1);
+    }
+
+    static Layout layout(size_t capacity)
+    {
+        if (capacity == 0 || capacity >= UINT32_MAX)
+        {
+            throw std::invalid_argument("SharedMemoryHashMap capacity must be in [1, 2^32 - 1)");
+        }
+
+        Layout layout{};
+        const auto needed = static_cast<size_t>(static_cast<double>(capacity) / LOAD_FACTOR) + 1;
+        layout.buckets = std::max(Size, std::bit_ceil(needed));
+        layout.stripes = alignUp(sizeof(Header), alignof(Stripe));
+        layout.bucketArray = alignUp(layout.stripes + Size * sizeof(Stripe), 64);
+        layout.nodes = alignUp(layout.bucketArray + layout.buckets * sizeof(Bucket), 64);
+        layout.bytes = layout.nodes + capacity * sizeof(Node);
+        return layout;
+    }
+
+    void map(size_t bytes)
+    {
+        _region = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+        if (_region == MAP_FAILED)
+        {
+            throw std::system_error(errno, std::generic_category(), "SharedMemoryHashMap: mmap");
+        }
+        _bytes = bytes;
+    }
+
+    void bind(const Layout& layout)
+    {
+        auto* base = static_cast<char*>(_region);
+        _header = reinterpret_cast<Header*>(base);
+        _stripes = reinterpret_cast<Stripe*>(base + layout.stripes);
+        _buckets = reinterpret_cast<Bucket*>(base + layout.bucketArray);
+        _nodes = reinterpret_cast<Node*>(base + layout.nodes);
+        _mask = layout.buckets - 1;
+    }
+
+    /// @brief Size and lay out a fresh region, a new file is zero filled so only the header and locks are written
+    void initialize(size_t capacity)
+    {
+        const Layout regionLayout = layout(capacity);
+        if (::ftruncate(_fd, static_cast<off_t>(regionLayout.bytes)) != 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "SharedMemoryHashMap: ftruncate");
+        }
+
+        map(regionLayout.bytes);
+        bind(regionLayout);
+
+        _header->capacity = capacity;
+        _header->buckets = regionLayout.buckets;
+        _header->stripes = Size;
+        _header->bytes = regionLayout.bytes;
+        _header->hash = Hash{}(MAGIC);
+
+        pthread_mutexattr_t attributes;
+        pthread_mutexattr_init(&attributes);
+        pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+        for (size_t i = 0; i < Size; ++i)
+        {
+            pthread_mutex_init(&_stripes[i].mutex, &attributes);
+        }
+        pthread_mutexattr_destroy(&attributes);
+
+        _header->magic.store(MAGIC, std::memory_order_release);
+    }
+
+    /// @brief Map a region another process created, waiting for it to finish the layout
+    void attach()
+    {
+        const auto deadline = std::chrono::steady_clock::now() + ATTACH_TIMEOUT;
+        auto wait = [&]
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+            {
+                throw std::runtime_error("SharedMemoryHashMap: the region was never initialized");
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        };
+
+        struct stat status{};
+        while (::fstat(_fd, &status) == 0 && static_cast<size_t>(status.st_size) < sizeof(Header))
+        {
+            wait();
+        }
+
+        map(static_cast<size_t>(status.st_size));
+        _header = static_cast<Header*>(_region);
+        while (_header->magic.load(std::memory_order_acquire) != MAGIC)
+        {
+            wait();
+        }
+
+        if (_header->stripes != Size || _header->bytes != _bytes || _header->hash != Hash{}(MAGIC))
+        {
+            throw std::runtime_error("SharedMemoryHashMap: the region has another layout");
+        }
+        bind(layout(_header->capacity));
+    }
+
+    void release()
+    {
+        if (_region != MAP_FAILED)
+        {
+            ::munmap(_region, _bytes);
+            _region = MAP_FAILED;
+        }
+        if (_fd >= 0)
+        {
+            ::close(_fd);
+            _fd = -1;
+        }
+    }
+
+    size_t bucketIndex(uint64_t key) const
+    {
+        return Hash{}(key) & _mask;
+    }
+
+    Node& node(uint32_t index) const
+    {
+        return _nodes[index - 1];
+    }
+
+    /// @brief Entries are counted again after a process died inside a change of the stripe
+    void recount(size_t stripe) const
+    {
+        uint64_t count = 0;
+        for (size_t bucket = stripe; bucket <= _mask; bucket += Size)
+        {
+            for (uint32_t index = _buckets[bucket].load(std::memory_order_relaxed); index != NIL;
+                 index = node(index).next.load(std::memory_order_relaxed))
+            {
+                ++count;
+            }
+        }
+        _stripes[stripe].count.store(count, std::memory_order_relaxed);
+    }
+
+    void lockStripe(size_t stripe) const
+    {
+        const int result = pthread_mutex_lock(&_stripes[stripe].mutex);
+        if (result == EOWNERDEAD)
+        {
+            // the owner died, its change is either published or invisible, only the count may be off
+            recount(stripe);
+            pthread_mutex_consistent(&_stripes[stripe].mutex);
+        }
+        else if (result != 0)
+        {
+            throw std::system_error(result, std::generic_category(), "SharedMemoryHashMap: lock");
+        }
+    }
+
+    void unlockStripe(size_t stripe) const
+    {
+        pthread_mutex_unlock(&_stripes[stripe].mutex);
+    }
+
+    /// @brief Pop the free list, then carve a never used node
+    /// @return NIL if every node is in use
+    uint32_t allocateNode()
+    {
+        uint64_t head = _header->freeList.load(std::memory_order_acquire);
+        while (const auto index = static_cast<uint32_t>(head))
+        {
+            // a stale next only reaches the CAS with a stale tag
+            const uint32_t next = node(index).next.load(std::memory_order_relaxed);
+            const uint64_t desired = (((head >> 32) + 1) << 32) | next;
+            if (_header->freeList.compare_exchange_weak(head, desired, std::memory_order_acquire))
+            {
+                return index;
+            }
+        }
+
+        const uint64_t unused = _header->unused.fetch_add(1, std::memory_order_relaxed);
+        return unused < _header->capacity ? static_cast<uint32_t>(unused + 1) : NIL;
+    }
+
+    void freeNode(uint32_t index)
+    {
+        uint64_t head = _header->freeList.load(std::memory_order_relaxed);
+        uint64_t desired = 0;
+        do
+        {
+            node(index).next.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+            desired = (((head >> 32) + 1) << 32) | index;
+        } while (!_header->freeList.compare_exchange_weak(head, desired, std::memory_order_release));
+    }
+
+    /// @brief Link holding the key's node in its bucket, nullptr if absent, caller holds the stripe lock
+    Bucket* findLink(size_t bucket, uint64_t key) const
+    {
+        Bucket* link = &_buckets[bucket];
+        while (const uint32_t index = link->load(std::memory_order_relaxed))
+        {
+            if (node(index).message.MessageId == key)
+            {
+                return link;
+            }
+            link = &node(index).next;
+        }
+
+        return nullptr;
+    }
+
+  public:
+    /// @brief Anonymous region (memfd) for `capacity` messages, children created by fork share it
+    explicit SharedMemoryHashMap(size_t capacity = DEFAULT_CAPACITY)
+    {
+        _fd = ::memfd_create("messages-container", MFD_CLOEXEC);
+        if (_fd < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "SharedMemoryHashMap: memfd_create");
+        }
+
+        try
+        {
+            initialize(capacity);
+        }
+        catch (...)
+        {
+            release();
+            throw;
+        }
+    }
+
+    /// @brief Named region (shm_open), created for `capacity` messages by the first process, attached by the
+    /// others and by restarted ones with the capacity it was created with
+    explicit SharedMemoryHashMap(const std::string& name, size_t capacity = DEFAULT_CAPACITY)
+    {
+        _fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        const bool created = _fd >= 0;
+        if (!created && errno == EEXIST)
+        {
+            _fd = ::shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+        }
+        if (_fd < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "SharedMemoryHashMap: shm_open " + name);
+        }
+
+        try
+        {
+            created ? initialize(capacity) : attach();
+        }
+        catch (...)
+        {
+            release();
+            throw;
+        }
+    }
+
+    /// @brief Unmaps the region, the messages stay as long as another process or the name holds it
+    ~SharedMemoryHashMap()
+    {
+        release();
+    }
+
+    SharedMemoryHashMap(const SharedMemoryHashMap&) = delete;
+    SharedMemoryHashMap& operator=(const SharedMemoryHashMap&) = delete;
+    SharedMemoryHashMap(SharedMemoryHashMap&&) = delete;
+    SharedMemoryHashMap& operator=(SharedMemoryHashMap&&) = delete;
+
+    /// @brief Remove a named region, processes that mapped it keep using it
+    static void unlink(const std::string& name)
+    {
+        ::shm_unlink(name.c_str());
+    }
+
+    /// @return false for a duplicate, or if the map is full (see rejected())
+    bool insert(const Message& message)
+    {
+        const size_t bucket = bucketIndex(message.MessageId);
+        const size_t stripe = bucket & (Size - 1);
+        lockStripe(stripe);
+
+        if (findLink(bucket, message.MessageId))
+        {
+            unlockStripe(stripe);
+            return false;
+        }
+
+        const uint32_t index = allocateNode();
+        if (index == NIL)
+        {
+            unlockStripe(stripe);
+            _header->rejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        Node& entry = node(index);
+        entry.message = message;
+        entry.next.store(_buckets[bucket].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        _buckets[bucket].store(index, std::memory_order_release);  // the single publishing store
+        _stripes[stripe].count.fetch_add(1, std::memory_order_relaxed);
+
+        unlockStripe(stripe);
+        return true;
+    }
+
+    template <size_t N> size_t insertBatch(std::span<const Message> messages, std::bitset<N>& inserted)
+    {
+        assert(messages.size() <= N && "Batch is larger than the result bitset");
+
+        inserted.reset();
+        for (size_t i = 0; i < messages.size(); ++i)
+        {
+            inserted[i] = insert(messages[i]);
+        }
+        return inserted.count();
+    }
+
+    bool find(uint64_t messageId, Message& result) const
+    {
+        const size_t bucket = bucketIndex(messageId);
+        const size_t stripe = bucket & (Size - 1);
+        lockStripe(stripe);
+
+        Bucket* link = findLink(bucket, messageId);
+        if (link)
+        {
+            result = node(link->load(std::memory_order_relaxed)).message;
+        }
+
+        unlockStripe(stripe);
+        return link != nullptr;
+    }
+
+    template <size_t N>
+    size_t findBatch(std::span<const uint64_t> ids, std::span<Message> results, std::bitset<N>& found) const
+    {
+        assert(ids.size() <= N && ids.size() <= results.size() && "Batch is larger than the results");
+
+        found.reset();
+        for (size_t i = 0; i < ids.size(); ++i)
+        {
+            found[i] = find(ids[i], results[i]);
+        }
+        return found.count();
+    }
+
+    bool remove(uint64_t messageId)
+    {
+        const size_t bucket = bucketIndex(messageId);
+        const size_t stripe = bucket & (Size - 1);
+        lockStripe(stripe);
+
+        Bucket* link = findLink(bucket, messageId);
+        uint32_t index = NIL;
+        if (link)
+        {
+            index = link->load(std::memory_order_relaxed);
+            link->store(node(index).next.load(std::memory_order_relaxed), std::memory_order_release);
+            _stripes[stripe].count.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        unlockStripe(stripe);
+
+        // a crash before this point leaks the node, the chain is already consistent
+        if (index != NIL)
+        {
+            freeNode(index);
+        }
+        return index != NIL;
+    }
+
+    /// @brief Sum of the stripe counts, not a snapshot while writers are running
+    size_t size() const
+    {
+        uint64_t size = 0;
+        for (size_t i = 0; i < Size; ++i)
+        {
+            size += _stripes[i].count.load(std::memory_order_relaxed);
+        }
+        return static_cast<size_t>(size);
+    }
+
+    /// @brief Messages the region holds at most
+    size_t capacity() const
+    {
+        return static_cast<size_t>(_header->capacity);
+    }
+
+    /// @brief Inserts refused because the region was full, over all processes
+    size_t rejected() const
+    {
+        return static_cast<size_t>(_header->rejected.load(std::memory_order_relaxed));
+    }
+
+    /// @brief memfd or shm descriptor of the region, e.g. to hand it to another process
+    int fd() const
+    {
+        return _fd;
+    }
+
+    void debug()
+    {
+        for (size_t bucket = 0; bucket <= _mask; ++bucket)
+        {
+            const size_t stripe = bucket & (Size - 1);
+            lockStripe(stripe);
+
+            for (uint32_t index = _buckets[bucket].load(std::memory_order_relaxed); index != NIL;
+                 index = node(index).next.load(std::memory_order_relaxed))
+            {
+                std::cout << "Index: " << bucket << " MessageId: " << node(index).message.MessageId << std::endl;
+            }
+
+            unlockStripe(stripe);
+        }
+    }
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "../hash_policies.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/// @brief Concurrent blocked counting Bloom filter of MessageIds
+/// The filter is an array of 64 byte blocks of 128 4 bit counters. A key maps to one block and to one counter
+/// in each of Probes different words of it, so a query costs a single cache miss and every update is one CAS
+/// per word. add() increments the key's counters and remove() decrements them, a key that was added and not
+/// removed always answers true. A counter that reaches 15 saturates and is never decremented again, so
+/// overflow can only add false positives, never lose a key.
+/// @tparam Hash hash policy (hash_policies.hpp), the block is taken from the high bits and the counters from
+/// the low bits of its result
+/// @tparam Probes counters per key, at most 8 (one per word of the block)
+template <typename Hash = WyHash, size_t Probes = 4> class CountingBloomFilter
+{
+    static_assert(Probes > 0 && Probes <= 8, "One counter per word of a block");
+
+    static constexpr size_t WORDS = 8;
+    static constexpr size_t COUNTERS_PER_WORD = 16;
+    static constexpr uint64_t COUNTER_MAX = 15;
+
+    struct alignas(64) Block
+    {
+        std::array<std::atomic<uint64_t>, WORDS> words{};
+    };
+
+    std::unique_ptr<Block[]> _blocks;
+    unsigned _blockShift;
+
+    /// @brief Probes go to consecutive words from a hashed start, so no two share a word,
+    /// 4 low bits of the hash per probe pick the counter inside its word
+    static size_t word(size_t probe, uint64_t hash)
+    {
+        return (probe + (hash >> (4 * WORDS))) % WORDS;
+    }
+
+    static unsigned shift(size_t probe, uint64_t hash)
+    {
+        return static_cast<unsigned>((hash >> (4 * probe)) & (COUNTERS_PER_WORD - 1)) * 4;
+    }
+
+    Block& block(uint64_t hash) const
+    {
+        return _blocks[_blockShift == 64 ? 0 : hash >> _blockShift];
+    }
+
+    void update(uint64_t key, bool increment)
+    {
+        const uint64_t hash = Hash{}(key);
+        Block& target = block(hash);
+        for (size_t probe = 0; probe < Probes; ++probe)
+        {
+            std::atomic<uint64_t>& slot = target.words[word(probe, hash)];
+            const unsigned offset = shift(probe, hash);
+
+            uint64_t value = slot.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                const uint64_t counter = (value >> offset) & COUNTER_MAX;
+                if (counter == COUNTER_MAX || (!increment && !counter))
+                {
+                    break;  // saturated counters stick
+                }
+
+                const uint64_t next = increment ? value + (uint64_t{1} << offset) : value - (uint64_t{1} << offset);
+                if (slot.compare_exchange_weak(value, next, std::memory_order_release, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+        }
+    }
+
+  public:
+    static constexpr size_t COUNTERS_PER_ENTRY = 8;  // about 2% false positives at the expected size
+
+    /// @param expectedEntries keys present at the same time the filter is sized for, more only raise the
+    /// false positive rate
+    explicit CountingBloomFilter(size_t expectedEntries)
+    {
+        const size_t blocks =
+            std::bit_ceil(std::max<size_t>(1, expectedEntries * COUNTERS_PER_ENTRY / (WORDS * COUNTERS_PER_WORD)));
+        _blocks = std::make_unique<Block[]>(blocks);
+        _blockShift = 64 - std::countr_zero(blocks);
+    }
+
+    CountingBloomFilter(const CountingBloomFilter&) = delete;
+    CountingBloomFilter& operator=(const CountingBloomFilter&) = delete;
+
+    /// @brief false means the key was never added (or removed as often as added)
+    bool mayContain(uint64_t key) const
+    {
+        const uint64_t hash = Hash{}(key);
+        const Block& target = block(hash);
+        for (size_t probe = 0; probe < Probes; ++probe)
+        {
+            const uint64_t value = target.words[word(probe, hash)].load(std::memory_order_acquire);
+            if (!((value >> shift(probe, hash)) & COUNTER_MAX))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void add(uint64_t key)
+    {
+        update(key, true);
+    }
+
+    /// @brief Undo one add() of the key, removing a key that was not added corrupts the filter
+    void remove(uint64_t key)
+    {
+        update(key, false);
+    }
+
+    /// @brief Bytes of counters
+    size_t memory() const
+    {
+        return sizeof(Block) << (64 - _blockShift);
+    }
+};
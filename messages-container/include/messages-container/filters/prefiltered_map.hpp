@@ -0,0 +1,322 @@
+#pragma once
+
+#include <message.hpp>
+
+#include "counting_bloom_filter.hpp"
+
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <span>
+
+/// @brief Counters of a PrefilteredMap, read while it runs they are approximate
+struct PrefilterStats
+{
+    uint64_t queries{0};  // filter lookups of insert and find
+    uint64_t negatives{0};  // answered by the filter alone, the map lookup was skipped
+    uint64_t duplicates{0};  // positives the map confirmed
+    uint64_t falsePositives{0};  // positives the map did not confirm
+
+    /// @brief Share of lookups the filter answered on its own
+    double skipRate() const
+    {
+        return queries ? static_cast<double>(negatives) / static_cast<double>(queries) : 0.0;
+    }
+
+    /// @brief Share of positives that were wrong, grows once the map holds more than the filter was sized for
+    double falsePositiveRate() const
+    {
+        const uint64_t positives = duplicates + falsePositives;
+        return positives ? static_cast<double>(falsePositives) / static_cast<double>(positives) : 0.0;
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& out, const PrefilterStats& stats)
+{
+    return out << "queries: " << stats.queries << " negatives: " << stats.negatives
+               << " duplicates: " << stats.duplicates << " false positives: " << stats.falsePositives
+               << " skip rate: " << stats.skipRate() << " false positive rate: " << stats.falsePositiveRate() << "\n";
+}
+
+/// @brief Approximate duplicate prefilter in front of a message map
+/// insert first asks the filter: a negative (new MessageId) goes straight to the map's insert without
+/// looking the message up, a positive is checked with the map's find, which is lock free on HashMap, and a
+/// confirmed duplicate returns without taking any map lock. find answers a negative without touching the map.
+/// A key is added to the filter before the map insert publishes it, so a key in the map always answers
+/// positive. remove (and an insert that loses a race to a duplicate) takes the key out of the counting
+/// filter again. A map with an onDrop hook (HashMap) reports every entry that leaves it, so entries it drops
+/// on its own (CLOCK eviction, TTL expiry, drainType through map()) give their counters back as well and a
+/// bounded map keeps the filter at the size of what it holds.
+/// @tparam Inner map type with the HashMap interface (HashMap, FlatHashMap, ShardedHashMap, LF_HashMap)
+/// @tparam Filter concurrent filter with mayContain/add/remove of a MessageId (CountingBloomFilter)
+template <typename Inner, typename Filter = CountingBloomFilter<>> class PrefilteredMap
+{
+    struct alignas(64) Counters
+    {
+        std::atomic<uint64_t> negatives{0};
+        std::atomic<uint64_t> duplicates{0};
+        std::atomic<uint64_t> falsePositives{0};
+    };
+
+    /// @brief The map reports its own drops, remove leaves the filter to the hook
+    static constexpr bool DROP_HOOK = requires(Inner& map) { map.onDrop([](uint64_t) {}); };
+
+    mutable Inner _map;  // LF_HashMap lookups are not const
+    Filter _filter;
+    mutable Counters _counters;
+
+    /// @brief Filter answer for one key, a negative is counted here and a positive by confirm()
+    bool mayContain(uint64_t messageId) const
+    {
+        if (_filter.mayContain(messageId))
+        {
+            return true;
+        }
+
+        _counters.negatives.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    /// @brief Count the map's answer to a positive
+    void confirm(bool found) const
+    {
+        (found ? _counters.duplicates : _counters.falsePositives).fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// @brief Insert a key the filter or the map has not seen, the filter learns it first
+    bool insertNew(const Message& message)
+    {
+        _filter.add(message.MessageId);
+        if (_map.insert(message))
+        {
+            return true;
+        }
+
+        // a concurrent insert of the same key won, its own add keeps the key positive
+        _filter.remove(message.MessageId);
+        return false;
+    }
+
+  public:
+    static constexpr size_t DEFAULT_ENTRIES = size_t{1} << 20;
+
+    /// @param expectedEntries messages the map holds at the same time, sizes the filter
+    explicit PrefilteredMap(size_t expectedEntries = DEFAULT_ENTRIES)
+        : _filter(expectedEntries)
+    {
+        if constexpr (DROP_HOOK)
+        {
+            _map.onDrop([this](uint64_t messageId) { _filter.remove(messageId); });
+        }
+    }
+
+    PrefilteredMap(const PrefilteredMap&) = delete;
+    PrefilteredMap& operator=(const PrefilteredMap&) = delete;
+    PrefilteredMap(PrefilteredMap&&) = delete;
+    PrefilteredMap& operator=(PrefilteredMap&&) = delete;
+
+    bool insert(const Message& message)
+    {
+        if (mayContain(message.MessageId))
+        {
+            Message existing;
+            const bool found = _map.find(message.MessageId, existing);
+            confirm(found);
+            if (found)
+            {
+                return false;
+            }
+        }
+
+        return insertNew(message);
+    }
+
+    /// @brief Positives of the batch are looked up with one findBatch, the rest go to one insertBatch
+    template <size_t N> size_t insertBatch(std::span<const Message> messages, std::bitset<N>& inserted)
+    {
+        assert(messages.size() <= N && "Batch is larger than the result bitset");
+
+        std::array<uint64_t, N> ids{};
+        std::array<uint32_t, N> positives{};
+        size_t positiveCount = 0;
+        for (size_t i = 0; i < messages.size(); ++i)
+        {
+            if (mayContain(messages[i].MessageId))
+            {
+                ids[positiveCount] = messages[i].MessageId;
+                positives[positiveCount++] = static_cast<uint32_t>(i);
+            }
+        }
+
+        std::bitset<N> duplicate;
+        if (positiveCount)
+        {
+            std::array<Message, N> found;
+            std::bitset<N> foundBits;
+            _map.findBatch(std::span<const uint64_t>(ids.data(), positiveCount),
+                std::span<Message>(found.data(), positiveCount), foundBits);
+
+            for (size_t j = 0; j < positiveCount; ++j)
+            {
+                confirm(foundBits[j]);
+                duplicate[positives[j]] = foundBits[j];
+            }
+        }
+
+        std::array<Message, N> batch;
+        std::array<uint32_t, N> order{};
+        size_t count = 0;
+        for (size_t i = 0; i < messages.size(); ++i)
+        {
+            if (!duplicate[i])
+            {
+                _filter.add(messages[i].MessageId);
+                batch[count] = messages[i];
+                order[count++] = static_cast<uint32_t>(i);
+            }
+        }
+
+        inserted.reset();
+        if (!count)
+        {
+            return 0;
+        }
+
+        std::bitset<N> batchInserted;
+        const size_t insertedCount = _map.insertBatch(std::span<const Message>(batch.data(), count), batchInserted);
+        for (size_t j = 0; j < count; ++j)
+        {
+            if (batchInserted[j])
+            {
+                inserted[order[j]] = true;
+            }
+            else
+            {
+                _filter.remove(batch[j].MessageId);
+            }
+        }
+
+        return insertedCount;
+    }
+
+    bool find(uint64_t messageId, Message& result) const
+    {
+        if (!mayContain(messageId))
+        {
+            return false;
+        }
+
+        const bool found = _map.find(messageId, result);
+        confirm(found);
+        return found;
+    }
+
+    template <size_t N>
+    size_t findBatch(std::span<const uint64_t> ids, std::span<Message> results, std::bitset<N>& found) const
+    {
+        assert(ids.size() <= N && ids.size() <= results.size() && "Batch is larger than the results");
+
+        std::array<uint64_t, N> batchIds{};
+        std::array<uint32_t, N> order{};
+        size_t count = 0;
+        for (size_t i = 0; i < ids.size(); ++i)
+        {
+            if (mayContain(ids[i]))
+            {
+                batchIds[count] = ids[i];
+                order[count++] = static_cast<uint32_t>(i);
+            }
+        }
+
+        found.reset();
+        if (!count)
+        {
+            return 0;
+        }
+
+        std::array<Message, N> batchResults;
+        std::bitset<N> batchFound;
+        const size_t foundCount = _map.findBatch(std::span<const uint64_t>(batchIds.data(), count),
+            std::span<Message>(batchResults.data(), count), batchFound);
+
+        for (size_t j = 0; j < count; ++j)
+        {
+            confirm(batchFound[j]);
+            if (batchFound[j])
+            {
+                results[order[j]] = batchResults[j];
+                found[order[j]] = true;
+            }
+        }
+
+        return foundCount;
+    }
+
+    bool remove(uint64_t messageId)
+    {
+        if (!_map.remove(messageId))
+        {
+            return false;
+        }
+
+        if constexpr (!DROP_HOOK)
+        {
+            _filter.remove(messageId);
+        }
+        return true;
+    }
+
+    bool reserve(size_t entries)
+        requires requires(Inner& map) { map.reserve(size_t{}); }
+    {
+        return _map.reserve(entries);
+    }
+
+    auto snapshot() const
+        requires requires(const Inner& map) { map.snapshot(); }
+    {
+        return _map.snapshot();
+    }
+
+    size_t size() const
+    {
+        return _map.size();
+    }
+
+    size_t capacity() const
+    {
+        return _map.capacity();
+    }
+
+    PrefilterStats prefilterStats() const
+    {
+        PrefilterStats stats;
+        stats.negatives = _counters.negatives.load(std::memory_order_relaxed);
+        stats.duplicates = _counters.duplicates.load(std::memory_order_relaxed);
+        stats.falsePositives = _counters.falsePositives.load(std::memory_order_relaxed);
+        stats.queries = stats.negatives + stats.duplicates + stats.falsePositives;
+        return stats;
+    }
+
+    /// @brief The wrapped map for its own operations (type index, statistics), without DROP_HOOK its removes
+    /// bypass the filter
+    Inner& map()
+    {
+        return _map;
+    }
+
+    const Inner& map() const
+    {
+        return _map;
+    }
+
+    void debug()
+    {
+        std::cout << prefilterStats();
+        _map.debug();
+    }
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+
+/// @brief Hash policies of HashMap and LF_HashMap, the containers index buckets with the low bits of the hash
+/// (hash & (capacity - 1)), so a policy has to leave well mixed low bits.
+
+/// @brief std::hash, the identity on libstdc++: buckets follow the low bits of MessageId
+struct IdentityHash
+{
+    uint64_t operator()(uint64_t key) const noexcept
+    {
+        return std::hash<uint64_t>{}(key);
+    }
+};
+
+/// @brief murmur3 64 bit finalizer, every input bit reaches every output bit
+struct MurmurHash
+{
+    uint64_t operator()(uint64_t key) const noexcept
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ULL;
+        key ^= key >> 33;
+        return key;
+    }
+};
+
+/// @brief wyhash mum mix: one 64x64->128 multiply, high and low halves folded
+struct WyHash
+{
+    uint64_t operator()(uint64_t key) const noexcept
+    {
+        const __uint128_t product =
+            static_cast<__uint128_t>(key ^ 0xa0761d6478bd642fULL) * (key ^ 0xe7037ed1a0b428dbULL);
+        return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+    }
+};
+
+/// @brief Fibonacci hashing: multiply by 2^64 / golden ratio. The well mixed bits are the high ones,
+/// the byte swap moves them to the bottom where the containers take the bucket index.
+struct FibonacciHash
+{
+    uint64_t operator()(uint64_t key) const noexcept
+    {
+        return __builtin_bswap64(key * 0x9e3779b97f4a7c15ULL);
+    }
+};
+
+/// @brief Chain length distribution of a chained map (chainStats()), to spot a skewed key set in production
+struct ChainStats
+{
+    static constexpr size_t MAX_TRACKED = 16;
+
+    size_t buckets{0};
+    size_t entries{0};
+    size_t maxLength{0};
+    size_t probes{0};  // entries compared by looking up every key once
+    std::array<size_t, MAX_TRACKED + 1> lengths{};  // buckets by chain length, the last one counts longer chains too
+
+    void add(size_t length)
+    {
+        ++buckets;
+        entries += length;
+        probes += length * (length + 1) / 2;
+        maxLength = std::max(maxLength, length);
+        ++lengths[std::min(length, MAX_TRACKED)];
+    }
+
+    /// @brief Mean entries compared by a successful lookup
+    double meanProbe() const
+    {
+        return entries ? static_cast<double>(probes) / static_cast<double>(entries) : 0.0;
+    }
+
+    /// @brief meanProbe over its expectation with a uniform hash (1 + load / 2), well above 1 means skew
+    double skew() const
+    {
+        if (!entries)
+        {
+            return 0.0;
+        }
+        const double load = static_cast<double>(entries) / static_cast<double>(buckets);
+        return meanProbe() / (1.0 + load / 2.0);
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& out, const ChainStats& stats)
+{
+    out << "buckets: " << stats.buckets << " entries: " << stats.entries << " empty: " << stats.lengths[0]
+        << " max chain: " << stats.maxLength << " mean probe: " << stats.meanProbe() << " skew: " << stats.skew()
+        << "\nchain length:";
+    for (size_t length = 1; length <= ChainStats::MAX_TRACKED; ++length)
+    {
+        if (stats.lengths[length])
+        {
+            out << " " << length << (length == ChainStats::MAX_TRACKED ? "+" : "") << "=" << stats.lengths[length];
+        }
+    }
+    return out << "\n";
+}
@@ -1,170 +1,257 @@
 #pragma once
 
-#include <algorithm>
+#include "thread_registry.hpp"
+
 #include <atomic>
-#include <functional>
-#include <thread>
-#include <vector>
-#include <iostream>
 #include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
 
-constexpr size_t MAX_THREADS = 64;
 constexpr size_t CLEANUP_THRESHOLD = 64;
 
-template <typename Node> class EpochManager
+/// @brief Epoch based reclamation, three epoch scheme
+/// Readers publish the global epoch they entered in. A retired node goes to the retiring thread's bucket
+/// of the current global epoch; the global epoch advances once every active thread has observed it,
+/// so a bucket of epoch E is safe to free as soon as the global epoch reaches E + 2.
+/// Each thread keeps three buckets (E, E - 1, E - 2) and frees a whole bucket in one pass.
+/// Retire only appends a pointer to a vector that keeps its capacity, nobody ever waits for readers.
+/// A thread that finds every slot taken may still retire through retireOrphan as long as it never enters an
+/// epoch, its nodes share one set of buckets under a mutex.
+/// @tparam Node type of retired objects
+/// @tparam Deleter frees one node, stateless types cost nothing
+template <typename Node, typename Deleter = std::default_delete<Node>> class EpochManager
 {
-    struct RetiredNode
+    static constexpr size_t EPOCHS = 3;
+    static constexpr size_t INACTIVE = SIZE_MAX;
+
+    struct RetireBucket
     {
-        size_t epoch;
-        void* ptr;
-        std::function<void(void*)> deleter;
+        size_t epoch{0};
+        std::vector<Node*> nodes;
     };
 
-    std::atomic<size_t> _globalEpoch{0};
-    thread_local static size_t _localEpoch;
+    struct alignas(64) ThreadState
+    {
+        std::atomic<size_t> epoch{INACTIVE};  // read by other threads
+        alignas(64) RetireBucket buckets[EPOCHS];  // owner only
+        size_t retired{0};  // retires since the last reclaim
+    };
 
-    std::atomic<size_t> _activeEpochs[MAX_THREADS];
-    /// @brief Retired nodes for each epoch for each thread
-    /// as long as each thread writes to its own list, we don't need to synchronize
-    /// Team, I am viaoliting  here rules not using STL - but sorry
-    /// The main challenge is to avoid using mutexes and locks
-    /// due to lack of time I am using vector of nodes for now
-    std::vector<RetiredNode> _retiredNodes[MAX_THREADS];
+    alignas(64) std::atomic<size_t> _globalEpoch{0};
+    ThreadState _threads[MAX_THREADS];
+    [[no_unique_address]] Deleter _deleter;
 
-    std::atomic<bool> _reclaiming{false};  // Ensures only one thread executes reclaim()
-    std::atomic<int> _activeReclaimingThread{-1};
-    std::thread::id _reclaimingThread{};
-    const size_t _threadCnt;
-    std::atomic<size_t> _nextThreadIdx{0};
-    static thread_local int _threadIdx;
+    std::mutex _orphanMutex;
+    RetireBucket _orphans[EPOCHS];  // nodes retired by threads without a slot
+    size_t _orphansRetired{0};
 
-  public:
-    EpochManager()
-        : _threadCnt(std::min(MAX_THREADS, static_cast<size_t>(std::thread::hardware_concurrency())))
+  private:
+    void freeBucket(RetireBucket& bucket)
     {
+        for (Node* node : bucket.nodes)
+        {
+            _deleter(node);
+        }
 
-        for (size_t i = 0; i < _threadCnt; ++i)
+        bucket.nodes.clear();
+    }
+
+    /// @brief Advance the global epoch if every active thread has observed it
+    void tryAdvance()
+    {
+        size_t global = _globalEpoch.load(std::memory_order_seq_cst);
+
+        for (auto& thread : _threads)
         {
-            _activeEpochs[i].store(0, std::memory_order_release);
+            size_t epoch = thread.epoch.load(std::memory_order_seq_cst);
+            if (epoch != INACTIVE && epoch != global)
+            {
+                return;
+            }
         }
+
+        _globalEpoch.compare_exchange_strong(global, global + 1, std::memory_order_seq_cst);
+    }
+
+  public:
+    explicit EpochManager(Deleter deleter = Deleter{})
+        : _deleter(std::move(deleter))
+    {
     }
 
     ~EpochManager()
     {
-        reclaim();
+        for (auto& thread : _threads)
+        {
+            for (auto& bucket : thread.buckets)
+            {
+                freeBucket(bucket);
+            }
+        }
+
+        for (auto& bucket : _orphans)
+        {
+            freeBucket(bucket);
+        }
     }
 
     EpochManager(const EpochManager&) = delete;
     EpochManager& operator=(const EpochManager&) = delete;
 
+    /// @brief Optional, takes the thread slot before the first operation instead of lazily
+    static size_t registerThread()
+    {
+        return reclamation_details::registerThread();
+    }
+
+    /// @brief Optional, releases the thread slot early, retired nodes stay with the slot
+    static void unregisterThread()
+    {
+        reclamation_details::unregisterThread();
+    }
+
+    /// @brief False if the calling thread has no slot and none is free, it must not enter an epoch then:
+    /// it reads shared nodes only under locks and retires with retireOrphan
+    static bool canEnter()
+    {
+        return reclamation_details::tryThreadIndex() != reclamation_details::NO_SLOT;
+    }
+
     void enterEpoch()
     {
-        _localEpoch = _globalEpoch.load(std::memory_order_acquire);
-        _activeEpochs[calcIdx()].store(_localEpoch, std::memory_order_release);
+        // seq_cst RMW, reads of shared nodes must not be reordered before the published epoch
+        size_t epoch = _globalEpoch.load(std::memory_order_seq_cst);
+        _threads[reclamation_details::threadIndex()].epoch.exchange(epoch, std::memory_order_seq_cst);
     }
 
     void exitEpoch()
     {
-        // _localEpoch[calcIdx()].store(0, std::memory_order_release);
-        _activeEpochs[calcIdx()].store(0, std::memory_order_release);
+        _threads[reclamation_details::threadIndex()].epoch.store(INACTIVE, std::memory_order_release);
     }
 
-    /// @brief Retire a node (add it to the retired list for the current epoch)
-    void retireNode(
-        void* ptr,
-        std::function<void(void*)> deleter = [](void* ptr) { delete static_cast<Node*>(ptr); })
+    /// @brief Critical section of one container operation
+    class Guard
     {
-        if (!deleter) {
-            std::cerr << "Error: Deleter is null for ptr=" << ptr << std::endl;
-            throw std::invalid_argument("Deleter must be callable");
-        }
+        EpochManager& _manager;
 
-        auto reclaimingThread = _activeReclaimingThread.load(std::memory_order_acquire);
-        if (reclaimingThread != -1)
+      public:
+        explicit Guard(EpochManager& manager)
+            : _manager(manager)
         {
-            assert((size_t)reclaimingThread != calcIdx() && " Reclaiming thread is the same as the current thread\n");
+            _manager.enterEpoch();
         }
 
-         // Check if the pointer is already retired
-        for (auto& entry : _retiredNodes[calcIdx()]) {
-            if (entry.ptr == ptr) {
-                return;
-            }
+        ~Guard()
+        {
+            _manager.exitEpoch();
         }
 
-        _retiredNodes[calcIdx()].push_back({_localEpoch, ptr, deleter});
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    };
 
-        // std::cout << "Thread " << calcIdx() << " retiring node at " << ptr << std::endl;
+    /// @brief Nodes stay alive for the whole critical section, a plain load is enough
+    template <typename T> T* protect(size_t /*slot*/, const std::atomic<T*>& source)
+    {
+        return source.load(std::memory_order_acquire);
+    }
 
-        if (_retiredNodes[calcIdx()].size() >= CLEANUP_THRESHOLD)
-        {
-            reclaim();
-        }
+    void assign(size_t /*slot*/, const void* /*ptr*/)
+    {
     }
 
-  private:
-    /// @brief Try to reclaim memory from older epochs
-    size_t calcIdx() {
-        if (_threadIdx < 0) {
-            _threadIdx = static_cast<int>(_nextThreadIdx.fetch_add(1, std::memory_order_relaxed) % _threadCnt);
+    /// @brief Retire an already unlinked node, called inside a critical section
+    void retireNode(Node* node)
+    {
+        assert(node && "Node ptr is not valid");
+
+        auto& thread = _threads[reclamation_details::threadIndex()];
+        size_t epoch = _globalEpoch.load(std::memory_order_seq_cst);
+
+        auto& bucket = thread.buckets[epoch % EPOCHS];
+        if (bucket.epoch != epoch)
+        {
+            // the bucket holds epoch - 3 or older, safe to free
+            freeBucket(bucket);
+            bucket.epoch = epoch;
         }
 
-        return _threadIdx;
+        bucket.nodes.push_back(node);
+
+        if (++thread.retired >= CLEANUP_THRESHOLD)
+        {
+            thread.retired = 0;
+            tryAdvance();
+            reclaim();
+        }
     }
 
-    void reclaim()
+    /// @brief Retire an already unlinked node from a thread without a slot, outside of any critical section
+    void retireOrphan(Node* node)
     {
-        bool expected = false;
-        if (!_reclaiming.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
-            return; // Another thread is already reclaiming
+        assert(node && "Node ptr is not valid");
+
+        std::lock_guard<std::mutex> lock(_orphanMutex);
+        size_t epoch = _globalEpoch.load(std::memory_order_seq_cst);
+
+        auto& bucket = _orphans[epoch % EPOCHS];
+        if (bucket.epoch != epoch)
+        {
+            freeBucket(bucket);
+            bucket.epoch = epoch;
         }
 
-        _activeReclaimingThread = calcIdx();
-        _reclaimingThread = std::this_thread::get_id();
+        bucket.nodes.push_back(node);
 
-        size_t newEpoch = _globalEpoch.fetch_add(1, std::memory_order_acq_rel);
+        if (++_orphansRetired >= CLEANUP_THRESHOLD)
+        {
+            _orphansRetired = 0;
+            tryAdvance();
 
-          // Wait for all threads to advance to the new epoch
-        for (size_t i = 0; i < _threadCnt; ++i) {
-            size_t retries = 1000;
-            while (_activeEpochs[i].load(std::memory_order_acquire) < newEpoch) {
-                if (--retries == 0) {
-                    std::cerr << "Warning: Thread " << i << " stuck in old epoch\n";
-                    goto EXIT;
+            const size_t global = _globalEpoch.load(std::memory_order_seq_cst);
+            for (auto& orphans : _orphans)
+            {
+                if (!orphans.nodes.empty() && orphans.epoch + 2 <= global)
+                {
+                    freeBucket(orphans);
                 }
-                std::this_thread::yield();
             }
         }
+    }
 
+    /// @brief Free the calling thread's buckets that no reader can reference anymore
+    void reclaim()
+    {
+        auto& thread = _threads[reclamation_details::threadIndex()];
+        size_t global = _globalEpoch.load(std::memory_order_seq_cst);
 
-        for (size_t i = 0; i < _threadCnt; ++i)
+        for (auto& bucket : thread.buckets)
         {
-            auto& list = _retiredNodes[i];
-            auto it = list.begin();
-            while (it != list.end())
+            if (!bucket.nodes.empty() && bucket.epoch + 2 <= global)
             {
-                if (it->epoch < newEpoch && _activeEpochs[i].load(std::memory_order_acquire) == 0)
-                {
-                    // std::cout << "Thread " << _activeReclaimingThread << " reclaiming node at " << it->ptr << std::endl;
+                freeBucket(bucket);
+            }
+        }
+    }
 
-                    assert(it->deleter && "Node deleter is not valid");
-                    assert(it->ptr && "Node ptr is not valid");
+    /// @brief Advance the epoch if possible and reclaim, for threads that stopped retiring
+    void flush()
+    {
+        tryAdvance();
+        reclaim();
+    }
 
-                    it->deleter(it->ptr);
-                    it = list.erase(it);
-                }
-                else
-                {
-                    ++it;
-                }
-            }
+    /// @brief Nodes retired by the calling thread and not freed yet
+    size_t retiredCount()
+    {
+        size_t count = 0;
+        for (auto& bucket : _threads[reclamation_details::threadIndex()].buckets)
+        {
+            count += bucket.nodes.size();
         }
-EXIT:
-        _reclaiming.store(false, std::memory_order_release);
-        _activeReclaimingThread.store(-1, std::memory_order_release);
-        _reclaimingThread = std::thread::id{};
+
+        return count;
     }
 };
-
-template <typename Node> thread_local size_t EpochManager<Node>::_localEpoch = 0;
-template <typename Node> thread_local int EpochManager<Node>::_threadIdx = -1;
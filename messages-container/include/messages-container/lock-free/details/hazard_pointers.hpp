@@ -0,0 +1,190 @@
+#pragma once
+
+#include "thread_registry.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+constexpr size_t HAZARD_SLOTS = 3;  // prev, curr and next of a list traversal
+
+/// @brief Hazard pointer reclamation (Michael)
+/// Every thread owns HAZARD_SLOTS hazard pointers and its own retire list. A node is freed by a scan
+/// once no hazard pointer of any thread points at it, a stalled reader pins at most HAZARD_SLOTS nodes.
+/// A scan runs when the retire list reaches SCAN_THRESHOLD and leaves at most MAX_THREADS * HAZARD_SLOTS
+/// nodes behind, so a thread never holds more than SCAN_THRESHOLD unreclaimed nodes.
+/// @tparam Node type of retired objects
+/// @tparam Deleter frees one node, stateless types cost nothing
+template <typename Node, typename Deleter = std::default_delete<Node>> class HazardPointerDomain
+{
+  public:
+    static constexpr size_t SCAN_THRESHOLD = 2 * MAX_THREADS * HAZARD_SLOTS;
+
+  private:
+    struct alignas(64) ThreadHazards
+    {
+        std::atomic<const void*> slots[HAZARD_SLOTS]{};
+    };
+
+    struct alignas(64) RetireList
+    {
+        std::vector<Node*> nodes;
+    };
+
+    ThreadHazards _hazards[MAX_THREADS];
+    RetireList _retired[MAX_THREADS];
+    [[no_unique_address]] Deleter _deleter;
+
+    /// @brief Pointers may carry tag bits (deletion mark), hazards always hold the clean address
+    static const void* untagged(const void* ptr)
+    {
+        return reinterpret_cast<const void*>(reinterpret_cast<uintptr_t>(ptr) & ~uintptr_t{alignof(Node) - 1});
+    }
+
+    std::atomic<const void*>& slot(size_t index)
+    {
+        assert(index < HAZARD_SLOTS && "Hazard slot out of range");
+        return _hazards[reclamation_details::threadIndex()].slots[index];
+    }
+
+    void scan(std::vector<Node*>& nodes)
+    {
+        thread_local std::vector<const void*> hazards;
+        hazards.clear();
+
+        for (auto& thread : _hazards)
+        {
+            for (auto& hazard : thread.slots)
+            {
+                if (const void* ptr = hazard.load(std::memory_order_seq_cst))
+                {
+                    hazards.push_back(ptr);
+                }
+            }
+        }
+
+        std::sort(hazards.begin(), hazards.end());
+
+        auto keep = std::partition(nodes.begin(), nodes.end(),
+            [&](Node* node)
+            {
+                return std::binary_search(hazards.begin(), hazards.end(), static_cast<const void*>(node));
+            });
+
+        for (auto it = keep; it != nodes.end(); ++it)
+        {
+            _deleter(*it);
+        }
+
+        nodes.erase(keep, nodes.end());
+    }
+
+  public:
+    explicit HazardPointerDomain(Deleter deleter = Deleter{})
+        : _deleter(std::move(deleter))
+    {
+        for (auto& list : _retired)
+        {
+            list.nodes.reserve(SCAN_THRESHOLD);
+        }
+    }
+
+    ~HazardPointerDomain()
+    {
+        for (auto& list : _retired)
+        {
+            for (Node* node : list.nodes)
+            {
+                _deleter(node);
+            }
+        }
+    }
+
+    HazardPointerDomain(const HazardPointerDomain&) = delete;
+    HazardPointerDomain& operator=(const HazardPointerDomain&) = delete;
+
+    /// @brief Optional, takes the thread slot before the first operation instead of lazily
+    static size_t registerThread()
+    {
+        return reclamation_details::registerThread();
+    }
+
+    /// @brief Optional, releases the thread slot early, retired nodes stay with the slot
+    static void unregisterThread()
+    {
+        reclamation_details::unregisterThread();
+    }
+
+    /// @brief Scope of one container operation, clears the thread's hazard pointers on exit
+    class Guard
+    {
+        HazardPointerDomain& _domain;
+
+      public:
+        explicit Guard(HazardPointerDomain& domain)
+            : _domain(domain)
+        {
+        }
+
+        ~Guard()
+        {
+            for (size_t i = 0; i < HAZARD_SLOTS; ++i)
+            {
+                _domain.slot(i).store(nullptr, std::memory_order_release);
+            }
+        }
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    };
+
+    /// @brief Load a pointer and publish it in a hazard slot, retry until the source is stable
+    template <typename T> T* protect(size_t index, const std::atomic<T*>& source)
+    {
+        auto& hazard = slot(index);
+        T* ptr = source.load(std::memory_order_acquire);
+
+        while (true)
+        {
+            // seq_cst RMW, the re-read below must not be reordered before the publication
+            hazard.exchange(untagged(ptr), std::memory_order_seq_cst);
+
+            T* current = source.load(std::memory_order_seq_cst);
+            if (current == ptr)
+            {
+                return ptr;
+            }
+
+            ptr = current;
+        }
+    }
+
+    /// @brief Publish a pointer that is already protected by another slot of this thread
+    void assign(size_t index, const void* ptr)
+    {
+        slot(index).store(untagged(ptr), std::memory_order_release);
+    }
+
+    /// @brief Retire an already unlinked node
+    void retireNode(Node* node)
+    {
+        assert(node && "Node ptr is not valid");
+
+        auto& nodes = _retired[reclamation_details::threadIndex()].nodes;
+        nodes.push_back(node);
+
+        if (nodes.size() >= SCAN_THRESHOLD)
+        {
+            scan(nodes);
+        }
+    }
+
+    /// @brief Nodes retired by the calling thread and not freed yet
+    size_t retiredCount()
+    {
+        return _retired[reclamation_details::threadIndex()].nodes.size();
+    }
+};
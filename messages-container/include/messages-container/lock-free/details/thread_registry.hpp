@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+constexpr size_t MAX_THREADS = 64;
+
+namespace reclamation_details
+{
+
+/// @brief Process wide registry of thread slots, a slot belongs to one live thread at a time
+/// so two threads never publish their epoch or hazard pointers into the same cell
+class ThreadRegistry
+{
+    std::atomic<bool> _used[MAX_THREADS]{};
+
+  public:
+    static ThreadRegistry& instance()
+    {
+        static ThreadRegistry registry;
+        return registry;
+    }
+
+    /// @return a free slot, NO_SLOT if all MAX_THREADS are taken
+    size_t tryAcquire()
+    {
+        for (size_t i = 0; i < MAX_THREADS; ++i)
+        {
+            bool expected = false;
+            if (!_used[i].load(std::memory_order_relaxed)
+                && _used[i].compare_exchange_strong(expected, true, std::memory_order_acquire))
+            {
+                return i;
+            }
+        }
+
+        return SIZE_MAX;
+    }
+
+    size_t acquire()
+    {
+        const size_t index = tryAcquire();
+        if (index == SIZE_MAX)
+        {
+            throw std::runtime_error("Too many threads use lock-free containers");
+        }
+
+        return index;
+    }
+
+    void release(size_t index)
+    {
+        _used[index].store(false, std::memory_order_release);
+    }
+};
+
+constexpr size_t NO_SLOT = SIZE_MAX;
+
+struct ThreadSlot
+{
+    size_t index{NO_SLOT};
+
+    ~ThreadSlot()
+    {
+        if (index != NO_SLOT)
+        {
+            ThreadRegistry::instance().release(index);
+        }
+    }
+};
+
+inline ThreadSlot& threadSlot()
+{
+    thread_local ThreadSlot slot;
+    return slot;
+}
+
+/// @brief Take a slot for the calling thread up front, a no-op if it already has one
+inline size_t registerThread()
+{
+    auto& slot = threadSlot();
+    if (slot.index == NO_SLOT)
+    {
+        slot.index = ThreadRegistry::instance().acquire();
+    }
+
+    return slot.index;
+}
+
+/// @brief Give the slot back before the thread exits, must be called outside of any container operation
+inline void unregisterThread()
+{
+    auto& slot = threadSlot();
+    if (slot.index != NO_SLOT)
+    {
+        ThreadRegistry::instance().release(slot.index);
+        slot.index = NO_SLOT;
+    }
+}
+
+/// @brief Slot of the calling thread, registers it lazily on first use and releases it when the thread exits
+inline size_t threadIndex()
+{
+    size_t index = threadSlot().index;
+    return index != NO_SLOT ? index : registerThread();
+}
+
+/// @brief Like threadIndex but NO_SLOT instead of a throw when every slot is taken, the next call tries again
+inline size_t tryThreadIndex()
+{
+    auto& slot = threadSlot();
+    if (slot.index == NO_SLOT)
+    {
+        slot.index = ThreadRegistry::instance().tryAcquire();
+    }
+
+    return slot.index;
+}
+
+}  // namespace reclamation_details
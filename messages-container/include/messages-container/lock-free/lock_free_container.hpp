@@ -1,107 +1,213 @@
 #pragma once
 
 #include "details/epoch_based_freedom.hpp"
+#include "details/hazard_pointers.hpp"
 
+#include "../hash_policies.hpp"
+
+#include <array>
 #include <atomic>
+#include <bit>
+#include <bitset>
+#include <cassert>
 #include <cstdint>
 #include <cstdio>
-#include <iostream>
+#include <cstdlib>
+#include <functional>
 #include <memory>
-#include <thread>
-
-/// @brief: Lock-free hashmap with dynamic resizing and linear probing
-/// The map is implemented as an array of buckets, each bucket is a linked list of nodes
-/// Each node contains a message and a pointer to the next node
-/// The map is lock-free, but not wait-free, because resizing is done with CAS
-/// Could be done as template class -> template <size_t BUCKET_COUNT = 8191>
+#include <new>
+#include <span>
+
+/// @brief: Lock-free hashmap based on split-ordered lists (Shalev, Shavit)
+/// All nodes live in one lock-free sorted linked list (Harris, Michael), ordered by the bit reversed hash.
+/// Buckets are shortcuts into that list: each bucket owns a dummy node, so doubling the bucket count
+/// only inserts new dummies lazily and never moves a node.
+/// A node is logically deleted by setting the low bit of its next pointer, then physically unlinked
+/// with CAS by whoever gets there first and retired through the reclamation policy.
+/// Bucket arrays are segments of growing size, published once and kept until the map is destroyed.
+/// The reclamation policy is a template parameter: EpochManager (cheapest reads) or HazardPointerDomain
+/// (bounded number of unreclaimed nodes per thread even if a reader stalls).
+/// Nodes come from Allocator (rebound from Value), retired nodes are given back to it by the reclaimer.
+/// Hash is a policy of hash_policies.hpp, the bucket is the low bits of its result.
 
 constexpr uintptr_t DELETED_MARK = 0b01;
 
-template <typename Value, size_t Size = 8191> class LF_HashMap
+template <typename Value, size_t Size = 8192, template <typename, typename> class Reclaimer = EpochManager,
+    typename Allocator = std::allocator<Value>, typename Hash = MurmurHash>
+class LF_HashMap
 {
+    static_assert((Size & (Size - 1)) == 0, "Size must be a power of two");
+
     struct Node
     {
+        uint64_t key;  // split-order key: reversed hash, odd for regular nodes, even for dummies
         Value message;
         std::atomic<Node*> next;
 
-        Node(const Value& msg, Node* next_ = nullptr)
-            : message(msg)
+        Node(uint64_t key_, const Value& msg, Node* next_ = nullptr)
+            : key(key_)
+            , message(msg)
             , next(next_)
         {
         }
     };
 
-    struct Bucket
+    using Bucket = std::atomic<Node*>;
+
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+    struct NodeDeleter
     {
-        std::atomic<Node*> head{nullptr};
+        [[no_unique_address]] NodeAllocator allocator;
+
+        void operator()(Node* node)
+        {
+            NodeTraits::destroy(allocator, node);
+            NodeTraits::deallocate(allocator, node, 1);
+        }
     };
 
-    ///@NOTE: atomic<shared_ptr<Node>> would be better, but C++20 standard impl is not lock free
-    /// there are other not commonly used implementation, but they are very platform specific
-    /// so let's stick with atomic<Node*> for now, raw pointers, is not  perfect, but it's lock free
+    /// segment 0 holds Size buckets, segment k holds Size << (k - 1)
+    static constexpr size_t MAX_SEGMENTS = 64 - std::countr_zero(Size);
+
+    Node* _head{nullptr};  // dummy of bucket 0, never removed
+    std::atomic<Bucket*> _segments[MAX_SEGMENTS]{};
 
-    std::atomic<Bucket*> _table{nullptr};
     std::atomic<size_t> _size{0};  // Current number of elements
-    std::atomic<size_t> _capacity;
-    std::atomic<bool> _resizing{false};
+    std::atomic<size_t> _capacity{Size};  // Current number of buckets
 
     static constexpr float LOAD_FACTOR = 0.75f;
 
-    std::unique_ptr<EpochManager<Node>> _epochManager;
+    // hazard slots used by a list traversal
+    static constexpr size_t HP_NEXT = 0;
+    static constexpr size_t HP_CURR = 1;
+    static constexpr size_t HP_PREV = 2;
+
+    using Guard = typename Reclaimer<Node, NodeDeleter>::Guard;
+
+    [[no_unique_address]] NodeAllocator _allocator;
+    std::unique_ptr<Reclaimer<Node, NodeDeleter>> _reclaimer;
 
   private:  // Private methods
-    size_t hash(uint64_t messageId, size_t bucket_count) const
+    static bool isMarked(Node* node)
     {
-        return std::hash<uint64_t>{}(messageId) % bucket_count;
+        return reinterpret_cast<uintptr_t>(node) & DELETED_MARK;
     }
 
-    Bucket* createBucketArray(size_t newSize);
+    static Node* marked(Node* node)
+    {
+        return reinterpret_cast<Node*>(reinterpret_cast<uintptr_t>(node) | DELETED_MARK);
+    }
 
-    void tryResize()
+    static Node* unmarked(Node* node)
     {
-        bool expected = false;
-        if (!_resizing.compare_exchange_strong(expected, true, std::memory_order_acquire))
-        {
-            return; // Another thread is already resizing
-        }
+        return reinterpret_cast<Node*>(reinterpret_cast<uintptr_t>(node) & ~DELETED_MARK);
+    }
 
-        resize();
+    static uint64_t reverseBits(uint64_t value)
+    {
+        value = ((value >> 1) & 0x5555555555555555ULL) | ((value & 0x5555555555555555ULL) << 1);
+        value = ((value >> 2) & 0x3333333333333333ULL) | ((value & 0x3333333333333333ULL) << 2);
+        value = ((value >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((value & 0x0F0F0F0F0F0F0F0FULL) << 4);
+        return __builtin_bswap64(value);
+    }
 
-        _resizing.store(false, std::memory_order_release);
+    static uint64_t regularKey(uint64_t hash)
+    {
+        return reverseBits(hash | (1ULL << 63));
     }
 
-    void resize();
+    static uint64_t dummyKey(size_t bucket)
+    {
+        return reverseBits(bucket);
+    }
+
+    static uint64_t messageId(const Node* node)
+    {
+        return node->message.MessageId;
+    }
+
+    uint64_t hash(uint64_t messageId) const
+    {
+        return Hash{}(messageId);
+    }
+
+    /// @brief Node order in the list, dummies compare by split-order key only
+    static bool less(const Node* node, uint64_t key, uint64_t id)
+    {
+        return node->key < key || (node->key == key && (key & 1) && messageId(node) < id);
+    }
+
+    static bool equal(const Node* node, uint64_t key, uint64_t id)
+    {
+        return node->key == key && (!(key & 1) || messageId(node) == id);
+    }
+
+    Node* createNode(uint64_t key, const Value& msg)
+    {
+        Node* node = NodeTraits::allocate(_allocator, 1);
+        NodeTraits::construct(_allocator, node, key, msg);
+        return node;
+    }
+
+    void destroyNode(Node* node)
+    {
+        NodeDeleter{_allocator}(node);
+    }
+
+    Bucket& bucketSlot(size_t bucket);
+    Bucket* peekBucketSlot(size_t bucket) const;
+    Node* getBucket(size_t bucket);
+    void initializeBucket(size_t bucket);
+
+    /// @brief Harris-Michael search starting at a dummy node, unlinks marked nodes on the way
+    /// @return true if a node equal to (key, id) was found, prev/curr are set around the position
+    bool listFind(Node* start, uint64_t key, uint64_t id, std::atomic<Node*>*& prev, Node*& curr);
+
+    bool insertHashed(const Value& msg, uint64_t hashValue);
+    bool findHashed(uint64_t messageId, uint64_t hashValue, Value& result);
+
+    /// @brief Prefetch the bucket slot of every hash, then the dummy nodes of the initialized ones
+    void prefetchBuckets(std::span<const uint64_t> hashes) const;
+
     void clearInternal();
 
   public:
-    void debug() const
+    /// @brief Not safe against concurrent removes with hazard pointers, nodes are not protected
+    void debug()
     {
-        for (size_t i = 0; i < _capacity; ++i)
+        Guard guard(*_reclaimer);
+        for (Node* node = _head; node; node = unmarked(node->next.load(std::memory_order_acquire)))
         {
-            Node* node = _table[i].head.load();
-            while (node)
+            if (node->key & 1)
             {
-                printf("Bucket %zu: ", i);
-                printf("%lu \n", node->message.MessageId);
-                node = node->next.load();
+                printf("Bucket %zu: ", static_cast<size_t>(hash(messageId(node)) & (_capacity.load() - 1)));
+                printf("%lu \n", messageId(node));
             }
         }
     }
 
-    LF_HashMap();
+    explicit LF_HashMap(const Allocator& allocator = Allocator());
     ~LF_HashMap();
 
-    LF_HashMap(const HashMap&) = delete;
-    LF_HashMap(HashMap&&) = delete;
-    LF_HashMap& operator=(const HashMap&) = delete;
-    LF_HashMap&& operator=(HashMap&&) = delete;
+    LF_HashMap(const LF_HashMap&) = delete;
+    LF_HashMap(LF_HashMap&&) = delete;
+    LF_HashMap& operator=(const LF_HashMap&) = delete;
+    LF_HashMap& operator=(LF_HashMap&&) = delete;
 
     // Insert a message (drop duplicates)
     bool insert(const Value& msg);
 
+    // Insert a batch, bit i of inserted is set if values[i] was inserted
+    template <size_t N> size_t insertBatch(std::span<const Value> values, std::bitset<N>& inserted);
+
     // Find a message by MessageId
     bool find(uint64_t messageId, Value& result);
 
+    // Find a batch, bit i of found is set and results[i] filled if ids[i] was found
+    template <size_t N> size_t findBatch(std::span<const uint64_t> ids, std::span<Value> results, std::bitset<N>& found);
+
     // Remove a message by MessageId
     bool remove(uint64_t messageId);
 
@@ -111,196 +217,418 @@ template <typename Value, size_t Size = 8191> class LF_HashMap
         return _size.load(std::memory_order_acquire);
     }
 
+    size_t capacity() const
+    {
+        return _capacity.load(std::memory_order_acquire);
+    }
+
+    /// @brief Chain length (regular nodes walked past a bucket's dummy) distribution at the current capacity
+    /// The list is ordered by the reversed hash, so the nodes of a bucket are adjacent. Not safe against
+    /// concurrent removes with hazard pointers, nodes are not protected.
+    ChainStats chainStats()
+    {
+        Guard guard(*_reclaimer);
+        const size_t mask = _capacity.load(std::memory_order_acquire) - 1;
+
+        ChainStats stats;
+        size_t bucket = 0;
+        size_t length = 0;
+        for (Node* node = _head; node; node = unmarked(node->next.load(std::memory_order_acquire)))
+        {
+            if (!(node->key & 1))
+            {
+                continue;
+            }
+
+            const size_t nodeBucket = hash(messageId(node)) & mask;
+            if (length && nodeBucket != bucket)
+            {
+                stats.add(length);
+                length = 0;
+            }
+            bucket = nodeBucket;
+            ++length;
+        }
+        if (length)
+        {
+            stats.add(length);
+        }
+
+        while (stats.buckets <= mask)
+        {
+            stats.add(0);
+        }
+
+        return stats;
+    }
 };
 
-template <typename Value, size_t Size>
-LF_HashMap<Value, Size>::LF_HashMap()
-    : _capacity(Size)
-    , _epochManager(std::make_unique<EpochManager<Node>>())
+template <typename Value, size_t Size, template <typename, typename> class Reclaimer, typename Allocator, typename Hash>
+LF_HashMap<Value, Size, Reclaimer, Allocator, Hash>::LF_HashMap(const Allocator& allocator)
+    : _allocator(allocator)
+    , _reclaimer(std::make_unique<Reclaimer<Node, NodeDeleter>>(NodeDeleter{_allocator}))
 {
-    _table.store(createBucketArray(Size), std::memory_order_release);
+    _head = createNode(dummyKey(0), Value{});
+    bucketSlot(0).store(_head, std::memory_order_release);
 }
 
-template <typename Value, size_t Size> LF_HashMap<Value, Size>::~HashMap()
+template <typename Value, size_t Size, template <typename, typename> class Reclaimer, typename Allocator, typename Hash>
+LF_HashMap<Value, Size, Reclaimer, Allocator, Hash>::~LF_HashMap()
 {
     clearInternal();
 }
 
-template <typename Value, size_t Size> void LF_HashMap<Value, Size>::clearInternal()
+template <typename Value, size_t Size, template <typename, typename> class Reclaimer, typename Allocator, typename Hash>
+void LF_HashMap<Value, Size, Reclaimer, Allocator, Hash>::clearInternal()
 {
-    auto table_p = _table.load();
+    Node* curr = _head;
+    while (curr)
+    {
+        Node* next = unmarked(curr->next.load());
+        destroyNode(curr);
+        curr = next;
+    }
 
-    for (size_t i = 0; i < _capacity.load(); ++i)
+    for (auto& segment : _segments)
     {
-        Node* curr = table_p[i].head.load();
-        while (curr)
-        {
-            Node* next = curr->next.load();
-            delete curr;
-            curr = next;
-        }
+        std::free(segment.load());
     }
 
     _size.store(0);
+}
+
+template <typename Value, size_t Size, template <typename, typename> class Reclaimer, typename Allocator, typename Hash>
+typename LF_HashMap<Value, Size, Reclaimer, Allocator, Hash>::Bucket& LF_HashMap<Value, Size, Reclaimer, Allocator, Hash>::bucketSlot(size_t bucket)
+{
+    size_t segment = bucket < Size ? 0 : std::bit_width(bucket / Size);
+    size_t offset = segment == 0 ? bucket : bucket - (Size << (segment - 1));
+
+    Bucket* buckets = _segments[segment].load(std::memory_order_acquire);
+    if (!buckets)
+    {
+        // zero filled memory is a valid array of null atomic pointers
+        size_t count = segment == 0 ? Size : Size << (segment - 1);
+        auto* fresh = static_cast<Bucket*>(std::calloc(count, sizeof(Bucket)));
+        if (!fresh)
+        {
+            throw std::bad_alloc();
+        }
+
+        if (_segments[segment].compare_exchange_strong(buckets, fresh, std::memory_order_acq_rel))
+        {
+            buckets = fresh;
+        }
+        else
+        {
+            std::free(fresh);
+        }
+    }
 
-    delete[] table_p;
+    return buckets[offset];
 }
 
-template <typename Value, size_t Size>
-typename LF_HashMap<Value, Size>::Bucket* LF_HashMap<Value, Size>::createBucketArray(size_t newSize)
+template <typename Value, size_t Size, template <typename, typename> class Reclaimer, typename Allocator, typename Hash>
+typename LF_HashMap<Value, Size, Reclaimer, Allocator, Hash>::Bucket* LF_HashMap<Value, Size, Reclaimer, Allocator, Hash>::peekBucketSlot(size_t bucket) const
 {
-    Bucket* newBuckets = new Bucket[newSize];
+    size_t segment = bucket < Size ? 0 : std::bit_width(bucket / Size);
+    size_t offset = segment == 0 ? bucket : bucket - (Size << (segment - 1));
+
+    Bucket* buckets = _segments[segment].load(std::memory_order_acquire);
+    return buckets ? &buckets[offset] : nullptr;
+}
 
-    for (size_t i = 0; i < newSize; ++i)
+template <typename Value, size_t Size, template <typename, typename> class Reclaimer, typename Allocator, typename Hash>
+typename LF_HashMap<Value, Size, Reclaimer, Allocator, Hash>::Node* LF_HashMap<Value, Size, Reclaimer, Allocator, Hash>::getBucket(size_t bucket)
+{
+    Node* dummy = bucketSlot(bucket).load(std::memory_order_acquire);
+    if (!dummy)
     {
-        newBuckets[i].head.store(nullptr, std::memory_order_relaxed);
+        initializeBucket(bucket);
+        dummy = bucketSlot(bucket).load(std::memory_order_acquire);
     }
 
-    return newBuckets;
+    return dummy;
 }
 
-template <typename Value, size_t Size> bool LF_HashMap<Value, Size>::insert(const Value& msg)
+template <typename Value, size_t Size, template <typename, typename> class Reclaimer, typename Allocator, typename Hash>
+void LF_HashMap<Value, Size, Reclaimer, Allocator, Hash>::initializeBucket(size_t bucket)
 {
-    _epochManager->enterEpoch();
+    // the parent bucket is the one this bucket was split from
+    size_t parent = bucket & ~(std::bit_floor(bucket));
+    Node* start = getBucket(parent);
 
-    Bucket* table_p = _table.load();
-    size_t index = hash(msg.MessageId, _capacity.load(std::memory_order_acquire));
-    Node* newNode = new Node(msg);
+    Node* dummy = createNode(dummyKey(bucket), Value{});
+    std::atomic<Node*>* prev = nullptr;
+    Node* curr = nullptr;
 
-    // Traverse the linked list to check for duplicates
-    Node* curr = table_p[index].head.load(std::memory_order_acquire);
-    while (curr != nullptr)
+    while (true)
     {
-        if (curr->message.MessageId == msg.MessageId)
+        if (listFind(start, dummy->key, 0, prev, curr))
         {
-            delete newNode;
-            std::cout << "message with ID: " << msg.MessageId << " already exist " << "\n";
-            _epochManager->exitEpoch();
-            return false;
+            destroyNode(dummy);  // Another thread already linked the dummy
+            dummy = curr;
+            break;
         }
 
-        curr = curr->next.load();
+        dummy->next.store(curr, std::memory_order_relaxed);
+        if (prev->compare_exchange_weak(curr, dummy, std::memory_order_release, std::memory_order_relaxed))
+        {
+            break;
+        }
     }
 
-    Node* head = _table[index].head.load(std::memory_order_acquire);
-    do
-    {
-        newNode->next.store(head, std::memory_order_relaxed);
-    } while (!_table[index].head.compare_exchange_weak(head, newNode, std::memory_order_release, std::memory_order_relaxed));
+    bucketSlot(bucket).store(dummy, std::memory_order_release);
+}
 
-    _size.fetch_add(1, std::memory_order_relaxed);
-    _epochManager->exitEpoch();
+template <typename Value, size_t Size, template <typename, typename> class Reclaimer, typename Allocator, typename Hash>
+bool LF_HashMap<Value, Size, Reclaimer, Allocator, Hash>::listFind(Node* start, uint64_t key, uint64_t id, std::atomic<Node*>*& prev, Node*& curr)
+{
+retry:
+    prev = &start->next;
+    curr = _reclaimer->protect(HP_CURR, *prev);
 
-    if (_size.load() >= LOAD_FACTOR * _capacity.load())
+    while (true)
     {
-        tryResize();
-    }
+        if (isMarked(curr))
+        {
+            goto retry;  // prev itself got deleted
+        }
 
-    return true;
+        if (!curr)
+        {
+            return false;
+        }
+
+        Node* next = _reclaimer->protect(HP_NEXT, curr->next);
+        if (prev->load(std::memory_order_acquire) != curr)
+        {
+            goto retry;
+        }
+
+        if (isMarked(next))
+        {
+            // curr is logically deleted, help unlinking it
+            Node* expected = curr;
+            if (!prev->compare_exchange_strong(expected, unmarked(next), std::memory_order_acq_rel))
+            {
+                goto retry;
+            }
+
+            _reclaimer->retireNode(curr);
+        }
+        else
+        {
+            if (!less(curr, key, id))
+            {
+                return equal(curr, key, id);
+            }
+
+            prev = &curr->next;
+            _reclaimer->assign(HP_PREV, curr);
+        }
+
+        // hazards are handed over to a higher slot before the lower one is overwritten,
+        // a scan reads slots in index order and can't miss the node in between
+        curr = unmarked(next);
+        _reclaimer->assign(HP_CURR, curr);
+    }
 }
 
-template <typename Value, size_t Size> void LF_HashMap<Value, Size>::resize()
+template <typename Value, size_t Size, template <typename, typename> class Reclaimer, typename Allocator, typename Hash>
+bool LF_HashMap<Value, Size, Reclaimer, Allocator, Hash>::insert(const Value& msg)
 {
-    std::cout << "Resizing the table\n";
+    return insertHashed(msg, hash(msg.MessageId));
+}
 
-    _epochManager->enterEpoch();
-    size_t newCapacity = _capacity.load() * 2;
+template <typename Value, size_t Size, template <typename, typename> class Reclaimer, typename Allocator, typename Hash>
+bool LF_HashMap<Value, Size, Reclaimer, Allocator, Hash>::insertHashed(const Value& msg, uint64_t hashValue)
+{
+    const uint64_t key = regularKey(hashValue);
 
-    Bucket* newTable = createBucketArray(newCapacity);
-    Bucket* oldTable = _table.load(std::memory_order_acquire);
+    {
+        Guard guard(*_reclaimer);
 
-    // Copy all pointers from the old buckets to the new buckets
+        Node* start = getBucket(hashValue & (_capacity.load(std::memory_order_acquire) - 1));
+        Node* newNode = nullptr;  // allocated once the key is known to be absent, duplicates cost no allocation
+        std::atomic<Node*>* prev = nullptr;
+        Node* curr = nullptr;
 
-    for (size_t i = 0; i < _capacity.load(); ++i)
-    {
-        Node* curr = oldTable[i].head.load(std::memory_order_acquire);
-        while (curr)
+        while (true)
         {
-            Node* next = curr->next.load(std::memory_order_acquire);
-            size_t newIndex = hash(curr->message.MessageId, newCapacity);
+            if (listFind(start, key, msg.MessageId, prev, curr))
+            {
+                if (newNode)
+                {
+                    destroyNode(newNode);  // a concurrent insert of the key won the race
+                }
+                return false;
+            }
 
-            Node* expected = newTable[newIndex].head.load(std::memory_order_acquire);
-            do
+            if (!newNode)
             {
-                curr->next.store(expected, std::memory_order_relaxed);
-            } while (!newTable[newIndex].head.compare_exchange_weak(expected, curr, std::memory_order_release, std::memory_order_relaxed));
+                newNode = createNode(key, msg);
+            }
 
-            curr = next;
+            newNode->next.store(curr, std::memory_order_relaxed);
+            if (prev->compare_exchange_weak(curr, newNode, std::memory_order_release, std::memory_order_relaxed))
+            {
+                break;
+            }
         }
     }
 
-    std::atomic_thread_fence(std::memory_order_acq_rel);
-    _table.store(newTable, std::memory_order_release);
-    _capacity.store(newCapacity, std::memory_order_release);
+    size_t size = _size.fetch_add(1, std::memory_order_relaxed) + 1;
+    size_t capacity = _capacity.load(std::memory_order_relaxed);
+    if (size >= LOAD_FACTOR * capacity && capacity < (Size << (MAX_SEGMENTS - 1)))
+    {
+        // new buckets get their dummies lazily on first use
+        _capacity.compare_exchange_strong(capacity, capacity << 1, std::memory_order_acq_rel);
+    }
 
-    // Retire the old table as a custom object
-    _epochManager->retireNode(oldTable,
-        [](void* ptr)
-        {
-            Bucket* oldTable = static_cast<Bucket*>(ptr);
-            delete[] oldTable;
-        }
-    );
+    return true;
+}
 
-    _epochManager->exitEpoch();
+template <typename Value, size_t Size, template <typename, typename> class Reclaimer, typename Allocator, typename Hash>
+bool LF_HashMap<Value, Size, Reclaimer, Allocator, Hash>::find(uint64_t messageId, Value& result)
+{
+    return findHashed(messageId, hash(messageId), result);
 }
 
-template <typename Value, size_t Size> bool LF_HashMap<Value, Size>::find(uint64_t messageId, Value& result)
+template <typename Value, size_t Size, template <typename, typename> class Reclaimer, typename Allocator, typename Hash>
+bool LF_HashMap<Value, Size, Reclaimer, Allocator, Hash>::findHashed(uint64_t messageId, uint64_t hashValue, Value& result)
 {
-    _epochManager->enterEpoch();
-    size_t index = hash(messageId, _capacity.load());
-    Node* curr = _table.load()[index].head.load(std::memory_order_acquire);
-    while (curr)
+    Guard guard(*_reclaimer);
+
+    Node* start = getBucket(hashValue & (_capacity.load(std::memory_order_acquire) - 1));
+    std::atomic<Node*>* prev = nullptr;
+    Node* curr = nullptr;
+
+    bool found = listFind(start, regularKey(hashValue), messageId, prev, curr);
+    if (found)
     {
-        if (curr->message.MessageId == messageId)
+        result = curr->message;
+    }
+
+    return found;
+}
+
+template <typename Value, size_t Size, template <typename, typename> class Reclaimer, typename Allocator, typename Hash>
+bool LF_HashMap<Value, Size, Reclaimer, Allocator, Hash>::remove(uint64_t messageId)
+{
+    const uint64_t hashValue = hash(messageId);
+    const uint64_t key = regularKey(hashValue);
+
+    Guard guard(*_reclaimer);
+
+    Node* start = getBucket(hashValue & (_capacity.load(std::memory_order_acquire) - 1));
+    std::atomic<Node*>* prev = nullptr;
+    Node* curr = nullptr;
+
+    while (true)
+    {
+        if (!listFind(start, key, messageId, prev, curr))
+        {
+            return false;
+        }
+
+        // logical deletion, the thread that marks the node owns the removal
+        Node* next = curr->next.load(std::memory_order_acquire);
+        if (isMarked(next)
+            || !curr->next.compare_exchange_strong(next, marked(next), std::memory_order_acq_rel))
+        {
+            continue;
+        }
+
+        // physical deletion, on failure let a search unlink and retire it
+        Node* expected = curr;
+        if (prev->compare_exchange_strong(expected, next, std::memory_order_acq_rel))
+        {
+            _reclaimer->retireNode(curr);
+        }
+        else
         {
-            result = curr->message;
-            _epochManager->exitEpoch();
-            return true;
+            listFind(start, key, messageId, prev, curr);
         }
 
-        curr = curr->next.load(std::memory_order_acquire);
+        break;
     }
 
-    _epochManager->exitEpoch();
-    return false;
+    _size.fetch_sub(1, std::memory_order_relaxed);
+    return true;
 }
 
-template <typename Value, size_t Size> bool LF_HashMap<Value, Size>::remove(uint64_t messageId)
+template <typename Value, size_t Size, template <typename, typename> class Reclaimer, typename Allocator, typename Hash>
+void LF_HashMap<Value, Size, Reclaimer, Allocator, Hash>::prefetchBuckets(std::span<const uint64_t> hashes) const
 {
-    _epochManager->enterEpoch();
+    const size_t mask = _capacity.load(std::memory_order_acquire) - 1;
 
-    size_t index = hash(messageId, _capacity.load());
-    Bucket* table = _table.load();
-    Node* prev = nullptr;
-    Node* curr = table[index].head.load(std::memory_order_acquire);
+    for (size_t i = 0; i < hashes.size(); ++i)
+    {
+        if (Bucket* slot = peekBucketSlot(hashes[i] & mask))
+        {
+            __builtin_prefetch(slot);
+        }
+    }
 
-    while (curr)
+    // dummies are never freed while the map exists, prefetching them needs no guard
+    for (size_t i = 0; i < hashes.size(); ++i)
     {
-        if (curr->message.MessageId == messageId)
+        if (Bucket* slot = peekBucketSlot(hashes[i] & mask))
         {
-            Node* next = curr->next.load(std::memory_order_acquire);
-            if (prev)
-            {
-                prev->next.store(next, std::memory_order_release);
-            }
-            else
+            if (Node* dummy = slot->load(std::memory_order_acquire))
             {
-                table[index].head.store(next, std::memory_order_release);
+                __builtin_prefetch(dummy);
             }
+        }
+    }
+}
 
-            _epochManager->retireNode(curr);
-            _size.fetch_sub(1, std::memory_order_relaxed);
-            _epochManager->exitEpoch();
+template <typename Value, size_t Size, template <typename, typename> class Reclaimer, typename Allocator, typename Hash>
+template <size_t N>
+size_t LF_HashMap<Value, Size, Reclaimer, Allocator, Hash>::insertBatch(std::span<const Value> values, std::bitset<N>& inserted)
+{
+    assert(values.size() <= N && "Batch is larger than the result bitset");
 
-            return true;
-        }
+    std::array<uint64_t, N> hashes;
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        hashes[i] = hash(values[i].MessageId);
+    }
+
+    prefetchBuckets(std::span<const uint64_t>(hashes.data(), values.size()));
 
-        prev = curr;
-        curr = curr->next.load(std::memory_order_acquire);
+    size_t count = 0;
+    inserted.reset();
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        inserted[i] = insertHashed(values[i], hashes[i]);
+        count += inserted[i];
     }
 
-    _epochManager->exitEpoch();
+    return count;
+}
+
+template <typename Value, size_t Size, template <typename, typename> class Reclaimer, typename Allocator, typename Hash>
+template <size_t N>
+size_t LF_HashMap<Value, Size, Reclaimer, Allocator, Hash>::findBatch(std::span<const uint64_t> ids, std::span<Value> results, std::bitset<N>& found)
+{
+    assert(ids.size() <= N && ids.size() <= results.size() && "Batch is larger than the results");
+
+    std::array<uint64_t, N> hashes;
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        hashes[i] = hash(ids[i]);
+    }
+
+    prefetchBuckets(std::span<const uint64_t>(hashes.data(), ids.size()));
+
+    size_t count = 0;
+    found.reset();
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        found[i] = findHashed(ids[i], hashes[i], results[i]);
+        count += found[i];
+    }
 
-    return false;
+    return count;
 }
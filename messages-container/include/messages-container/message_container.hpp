@@ -0,0 +1,159 @@
+#pragma once
+
+#include <message.hpp>
+
+/// @brief Container used by the UDP receivers, selected at configure time:
+/// cmake -DMESSAGES_CONTAINER=blocking|flat|sharded|sharded-flat|lock-free|lock-free-hp|shared
+/// cmake -DMESSAGES_CONTAINER_SHM_NAME=<name> -DMESSAGES_CONTAINER_SHM_CAPACITY=<n> for the shared container
+/// cmake -DMESSAGES_CONTAINER_NODE_POOL=ON to allocate nodes from NodePool
+/// cmake -DMESSAGES_CONTAINER_MAX_ENTRIES=<n> -DMESSAGES_CONTAINER_TTL_MS=<ms> to bound the blocking HashMap
+/// cmake -DMESSAGES_CONTAINER_TYPE_INDEX=ON to index the blocking HashMap by MessageType
+/// cmake -DMESSAGES_CONTAINER_LOCK=shared-mutex|ttas|ticket|mcs for the stripe locks of the blocking HashMap
+/// cmake -DMESSAGES_CONTAINER_HASH=murmur|wyhash|fibonacci|identity for the blocking, lock-free and shared containers
+/// cmake -DMESSAGES_CONTAINER_LOCK_STATS=ON to profile the HashMap locks (LockStats, dumped on SIGUSR1 and at exit)
+/// cmake -DMESSAGES_CONTAINER_PREFILTER=ON -DMESSAGES_CONTAINER_PREFILTER_ENTRIES=<n> to put a counting Bloom filter
+/// in front of the container, duplicates are then answered without its locks
+
+#if defined(MESSAGES_CONTAINER_NODE_POOL)
+
+#include "allocators/node_pool.hpp"
+
+using MessageAllocator = NodePoolAllocator<Message>;
+
+#else
+
+#include <memory>
+
+using MessageAllocator = std::allocator<Message>;
+
+#endif
+
+#include "blocking/lock_policies.hpp"
+#include "blocking/lock_stats.hpp"
+
+#if defined(MESSAGES_CONTAINER_LOCK_TTAS)
+using MessageLock = TTASLock;
+#elif defined(MESSAGES_CONTAINER_LOCK_TICKET)
+using MessageLock = TicketLock;
+#elif defined(MESSAGES_CONTAINER_LOCK_MCS)
+using MessageLock = MCSLock;
+#else
+#include <shared_mutex>
+using MessageLock = std::shared_mutex;
+#endif
+
+#include "hash_policies.hpp"
+
+#if defined(MESSAGES_CONTAINER_HASH_WYHASH)
+using MessageHash = WyHash;
+#elif defined(MESSAGES_CONTAINER_HASH_FIBONACCI)
+using MessageHash = FibonacciHash;
+#elif defined(MESSAGES_CONTAINER_HASH_IDENTITY)
+using MessageHash = IdentityHash;
+#else
+using MessageHash = MurmurHash;
+#endif
+
+#if defined(MESSAGES_CONTAINER_LOCK_FREE)
+
+#include "lock-free/lock_free_container.hpp"
+
+using MessageStore = LF_HashMap<Message, INITIAL_CAPACITY, EpochManager, MessageAllocator, MessageHash>;
+
+#elif defined(MESSAGES_CONTAINER_LOCK_FREE_HP)
+
+#include "lock-free/lock_free_container.hpp"
+
+using MessageStore = LF_HashMap<Message, INITIAL_CAPACITY, HazardPointerDomain, MessageAllocator, MessageHash>;
+
+#elif defined(MESSAGES_CONTAINER_SHARED)
+
+#include "blocking/shared_memory_hash_map.hpp"
+
+/// @brief SharedMemoryHashMap in the named region given at configure time, processes share one store
+class MessageStore : public SharedMemoryHashMap<256, MessageHash>
+{
+  public:
+    MessageStore()
+        : SharedMemoryHashMap(MESSAGES_CONTAINER_SHM_NAME, MESSAGES_CONTAINER_SHM_CAPACITY)
+    {
+    }
+};
+
+#elif defined(MESSAGES_CONTAINER_SHARDED)
+
+#include "blocking/hash_map.hpp"
+#include "blocking/sharded_hash_map.hpp"
+
+constexpr size_t MESSAGE_CONTAINER_SHARDS = 16;
+
+using MessageStore =
+    ShardedHashMap<MESSAGE_CONTAINER_SHARDS,
+        HashMap<INITIAL_CAPACITY / MESSAGE_CONTAINER_SHARDS, MessageAllocator, false, MessageLock, MessageHash>>;
+
+#elif defined(MESSAGES_CONTAINER_SHARDED_FLAT)
+
+#include "blocking/flat_hash_map.hpp"
+#include "blocking/sharded_hash_map.hpp"
+
+constexpr size_t MESSAGE_CONTAINER_SHARDS = 16;
+
+using MessageStore = ShardedHashMap<MESSAGE_CONTAINER_SHARDS, FlatHashMap<INITIAL_CAPACITY / MESSAGE_CONTAINER_SHARDS>>;
+
+#elif defined(MESSAGES_CONTAINER_FLAT)
+
+#include "blocking/flat_hash_map.hpp"
+
+using MessageStore = FlatHashMap<INITIAL_CAPACITY>;
+
+#else
+
+#include "blocking/hash_map.hpp"
+
+#if defined(MESSAGES_CONTAINER_TYPE_INDEX)
+constexpr bool MESSAGE_CONTAINER_TYPE_INDEX = true;
+#else
+constexpr bool MESSAGE_CONTAINER_TYPE_INDEX = false;
+#endif
+
+#if defined(MESSAGES_CONTAINER_MAX_ENTRIES)
+
+/// @brief HashMap with the limits given at configure time
+class MessageStore
+    : public HashMap<INITIAL_CAPACITY, MessageAllocator, MESSAGE_CONTAINER_TYPE_INDEX, MessageLock, MessageHash>
+{
+  public:
+    MessageStore()
+        : HashMap(HashMapLimits{MESSAGES_CONTAINER_MAX_ENTRIES, std::chrono::milliseconds(MESSAGES_CONTAINER_TTL_MS)})
+    {
+    }
+};
+
+#else
+
+using MessageStore =
+    HashMap<INITIAL_CAPACITY, MessageAllocator, MESSAGE_CONTAINER_TYPE_INDEX, MessageLock, MessageHash>;
+
+#endif
+
+#endif
+
+#if defined(MESSAGES_CONTAINER_PREFILTER)
+
+#include "filters/prefiltered_map.hpp"
+
+/// @brief Container behind a duplicate prefilter sized at configure time
+class MessageContainer : public PrefilteredMap<MessageStore>
+{
+  public:
+    MessageContainer()
+        : PrefilteredMap(MESSAGES_CONTAINER_PREFILTER_ENTRIES)
+    {
+    }
+};
+
+#else
+
+using MessageContainer = MessageStore;
+
+#endif
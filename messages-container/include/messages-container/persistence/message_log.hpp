@@ -0,0 +1,887 @@
+#pragma once
+
+#include <message.hpp>
+
+#include "../lock-free/details/thread_registry.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+/// @brief Tuning of MessageLog, the defaults suit the UDP ingest rate
+struct MessageLogOptions
+{
+    std::filesystem::path directory;
+    size_t segmentBytes{64 << 20};  // a segment is sealed once it grows past this
+    size_t groupBytes{1 << 20};  // pending bytes that commit a group before the interval is over
+    std::chrono::milliseconds commitInterval{2};  // longest time an accepted message waits for its fsync
+    size_t checkpointSegments{4};  // sealed segments that trigger a compacted snapshot, 0 disables
+};
+
+namespace log_details
+{
+
+enum class Op : uint8_t
+{
+    Insert = 1,
+    Remove = 2,
+};
+
+/// @brief Fixed size record of the log and of snapshots, host byte order
+struct Record
+{
+    Op op;
+    uint8_t type;
+    uint16_t size;
+    uint32_t check;  // of the other fields, a torn record does not match
+    uint64_t id;
+    uint64_t data;
+};
+
+static_assert(sizeof(Record) == 24, "Record must not contain padding");
+
+/// @brief Snapshot file header, count records follow it
+struct SnapshotHeader
+{
+    uint64_t magic;
+    uint64_t count;
+    uint64_t segment;  // first log segment the snapshot does not contain
+    uint64_t check;
+};
+
+constexpr uint64_t SNAPSHOT_MAGIC = 0x31504E5347534D4DULL;  // "MMSGSNP1"
+
+inline uint64_t mix(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDULL;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ULL;
+    return value ^ (value >> 33);
+}
+
+inline uint32_t checksum(const Record& record)
+{
+    const uint64_t head = static_cast<uint64_t>(record.op) << 24 | static_cast<uint64_t>(record.type) << 16 | record.size;
+    return static_cast<uint32_t>(mix(record.id ^ mix(record.data ^ mix(head))));
+}
+
+inline uint64_t checksum(const SnapshotHeader& header)
+{
+    return mix(header.magic ^ mix(header.count ^ mix(header.segment)));
+}
+
+inline Record makeRecord(Op op, const Message& message)
+{
+    Record record{op, message.MessageType, message.MessageSize, 0, message.MessageId, message.MessageData};
+    record.check = checksum(record);
+    return record;
+}
+
+inline bool valid(const Record& record)
+{
+    return (record.op == Op::Insert || record.op == Op::Remove) && record.check == checksum(record);
+}
+
+inline Message toMessage(const Record& record)
+{
+    return Message{record.size, record.type, record.id, record.data};
+}
+
+inline std::filesystem::path numberedPath(const std::filesystem::path& directory, const char* prefix,
+    uint64_t number, const char* suffix)
+{
+    char name[64];
+    std::snprintf(name, sizeof(name), "%s%016llx%s", prefix, static_cast<unsigned long long>(number), suffix);
+    return directory / name;
+}
+
+inline std::filesystem::path segmentPath(const std::filesystem::path& directory, uint64_t segment)
+{
+    return numberedPath(directory, "wal-", segment, ".log");
+}
+
+inline std::filesystem::path snapshotPath(const std::filesystem::path& directory, uint64_t segment)
+{
+    return numberedPath(directory, "snapshot-", segment, ".bin");
+}
+
+/// @brief Number of a file named prefix<hex>suffix, false for any other file
+inline bool parseNumber(const std::filesystem::path& path, const std::string& prefix, const std::string& suffix,
+    uint64_t& number)
+{
+    const std::string name = path.filename().string();
+    if (name.size() <= prefix.size() + suffix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+    {
+        return false;
+    }
+
+    const std::string digits = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+    char* end = nullptr;
+    number = std::strtoull(digits.c_str(), &end, 16);
+    return *end == '\0';
+}
+
+inline bool writeAll(int fd, const void* data, size_t bytes)
+{
+    const auto* position = static_cast<const char*>(data);
+    while (bytes)
+    {
+        const ssize_t written = ::write(fd, position, bytes);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+
+        position += written;
+        bytes -= static_cast<size_t>(written);
+    }
+
+    return true;
+}
+
+/// @brief Read up to bytes at offset, short only at the end of the file
+inline ssize_t readAt(int fd, void* data, size_t bytes, off_t offset)
+{
+    auto* position = static_cast<char*>(data);
+    size_t done = 0;
+    while (done < bytes)
+    {
+        const ssize_t count = ::pread(fd, position + done, bytes - done, offset + static_cast<off_t>(done));
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        if (count == 0)
+        {
+            break;
+        }
+
+        done += static_cast<size_t>(count);
+    }
+
+    return static_cast<ssize_t>(done);
+}
+
+/// @brief Make a created, renamed or removed file durable
+inline void syncDirectory(const std::filesystem::path& directory)
+{
+    const int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0)
+    {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+}  // namespace log_details
+
+/// @brief Write-ahead log of a message container, for a warm restart without a duplicate storm
+/// Accepted inserts and removes are appended to an in-memory group, a writer thread writes and fdatasyncs
+/// the whole group to the current segment (group commit), the receive threads never touch the disk.
+/// A segment is sealed once it grows past segmentBytes. After checkpointSegments sealed segments a
+/// checkpoint thread writes a compacted snapshot of the map (Map::snapshot(), copy on write, ingest goes
+/// on) and deletes the segments and snapshots it covers.
+/// recover() sizes the map for the snapshot and the log once (Map::reserve, no rehash while loading),
+/// loads the snapshot with one thread per core, then replays the younger segments in order.
+/// Durability lags by at most one commit interval, a torn record ends the replay of its segment.
+/// A failed write or sync is never reported as durable: the segment is cut back to its last synced group,
+/// logging continues in a fresh segment (so no record is ever appended behind a torn one) and the group is
+/// retried with a growing delay. While the log is failing flush() returns false and insert/remove throw
+/// before they touch the map.
+/// Entries a bounded map evicts or expires are not logged, they go away again after the restart.
+/// @tparam Map container with insert, remove and insertBatch, snapshot() and reserve() are used if present
+template <typename Map> class MessageLog
+{
+    using Op = log_details::Op;
+    using Record = log_details::Record;
+    using SnapshotHeader = log_details::SnapshotHeader;
+
+    static constexpr size_t KEY_LOCKS = 64;  // an insert and its record are ordered with the key's remove
+    static constexpr size_t LOAD_BATCH = 256;  // insertBatch size while loading a snapshot
+    static constexpr size_t IO_RECORDS = 1 << 15;  // records per read or write call
+    // snapshot loader threads at most, each may take a ThreadRegistry slot (the map's epoch guards) while it
+    // inserts, half of MAX_THREADS leaves the other half to the receivers and whoever else uses the map
+    static constexpr size_t MAX_LOADERS = MAX_THREADS / 2;
+    static constexpr std::chrono::milliseconds MAX_RETRY_DELAY{1000};  // between retries of a failed group
+
+    Map& _map;
+    const MessageLogOptions _options;
+    const size_t _groupRecords;
+
+    std::unique_ptr<std::mutex[]> _keyLocks;
+
+    std::mutex _mutex;  // pending group and the counters below
+    std::condition_variable _commitCv;
+    std::condition_variable _durableCv;
+    std::vector<Record> _pending;
+    uint64_t _appended{0};  // records handed to the log
+    uint64_t _durable{0};  // records written and synced
+    bool _checkpointRequested{false};
+    bool _stopping{false};
+    std::atomic<int> _error{0};  // errno of the last failed commit, 0 once a commit succeeds again
+
+    // only the writer thread uses these once recover() returned
+    int _fd{-1};
+    uint64_t _segment{0};
+    size_t _segmentBytes{0};
+    size_t _sealed{0};  // since the last checkpoint
+    bool _torn{false};  // the current segment may end with a partial record, append only to a new one
+
+    std::mutex _checkpointMutex;
+    std::condition_variable _checkpointCv;
+    uint64_t _checkpointSegment{0};  // segment the requested checkpoint starts at
+    bool _checkpointDue{false};
+    bool _checkpointStop{false};
+    std::atomic<size_t> _checkpoints{0};
+
+    std::thread _writer;
+    std::thread _checkpointer;
+
+  private:
+    std::mutex& keyLock(uint64_t messageId)
+    {
+        return _keyLocks[(messageId * 0x9E3779B97F4A7C15ULL) >> 58];
+    }
+
+    void throwIfFailing() const
+    {
+        if (const int error = _error.load(std::memory_order_relaxed))
+        {
+            throw std::system_error(error, std::generic_category(), "MessageLog: cannot write the log");
+        }
+    }
+
+    void append(Op op, const Message& message)
+    {
+        const Record record = log_details::makeRecord(op, message);
+
+        bool full = false;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _pending.push_back(record);
+            ++_appended;
+            full = _pending.size() == _groupRecords;
+        }
+
+        if (full)
+        {
+            _commitCv.notify_one();
+        }
+    }
+
+    int openSegment(uint64_t segment) const
+    {
+        const auto path = log_details::segmentPath(_options.directory, segment);
+        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+        if (fd >= 0)
+        {
+            log_details::syncDirectory(_options.directory);
+        }
+        return fd;
+    }
+
+    /// @brief Continue in the next segment, the current one keeps being used if it cannot be created
+    bool seal()
+    {
+        const int fd = openSegment(_segment + 1);
+        if (fd < 0)
+        {
+            std::cerr << "MessageLog: cannot create segment: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+
+        ::close(_fd);
+        _fd = fd;
+        ++_segment;
+        _segmentBytes = 0;
+        _torn = false;
+        ++_sealed;
+        return true;
+    }
+
+    /// @brief Write and sync a group at the end of the current segment
+    /// On failure the segment is cut back to its last synced group and sealed, a partial record is never
+    /// followed by another one. Records of the group may still have reached the old segment, replaying
+    /// them again from the retry is harmless: an insert of a present key and a remove of an absent one
+    /// change nothing.
+    /// @return 0 or the errno of the failure
+    int commit(const std::vector<Record>& group)
+    {
+        if (_torn && !seal())
+        {
+            return errno;
+        }
+
+        const size_t bytes = group.size() * sizeof(Record);
+        if (log_details::writeAll(_fd, group.data(), bytes) && ::fdatasync(_fd) == 0)
+        {
+            _segmentBytes += bytes;
+            return 0;
+        }
+
+        const int error = errno;
+        _torn = ::ftruncate(_fd, static_cast<off_t>(_segmentBytes)) != 0 || ::fdatasync(_fd) != 0;
+        if (_segmentBytes || _torn)
+        {
+            seal();
+        }
+        return error;
+    }
+
+    /// @brief Group commit: swap out what the receive threads appended, write it with one call and sync
+    void writerLoop()
+    {
+        std::vector<Record> group;  // records not durable yet, a failed group stays here for the retry
+        std::vector<Record> incoming;
+        group.reserve(_groupRecords);
+        incoming.reserve(_groupRecords);
+        std::chrono::milliseconds retryDelay{0};
+        bool deferredCheckpoint = false;  // requested while a group was failing
+
+        for (;;)
+        {
+            uint64_t appended = 0;
+            bool checkpoint = false;
+            bool stopping = false;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (retryDelay.count())
+                {
+                    _commitCv.wait_for(lock, retryDelay, [&] { return _stopping; });
+                }
+                else
+                {
+                    _commitCv.wait_for(lock, _options.commitInterval,
+                        [&] { return _stopping || _checkpointRequested || _pending.size() >= _groupRecords; });
+                }
+
+                incoming.swap(_pending);
+                appended = _appended;
+                checkpoint = std::exchange(_checkpointRequested, false) || deferredCheckpoint;
+                stopping = _stopping;
+            }
+
+            group.insert(group.end(), incoming.begin(), incoming.end());
+            incoming.clear();
+
+            const int error = group.empty() ? 0 : commit(group);
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (!error)
+                {
+                    _durable = appended;
+                }
+                _error.store(error, std::memory_order_relaxed);
+            }
+            _durableCv.notify_all();
+
+            if (error)
+            {
+                std::cerr << "MessageLog: write failed, " << group.size()
+                          << " records kept for a retry: " << std::strerror(error) << std::endl;
+                if (stopping)
+                {
+                    return;
+                }
+
+                deferredCheckpoint = checkpoint;
+                retryDelay = std::clamp(retryDelay * 2, _options.commitInterval, MAX_RETRY_DELAY);
+                continue;
+            }
+            retryDelay = std::chrono::milliseconds{0};
+            deferredCheckpoint = false;
+            group.clear();
+
+            // every record appended so far is in a segment before the one a checkpoint starts at
+            if (_segmentBytes >= _options.segmentBytes || (checkpoint && _segmentBytes))
+            {
+                seal();
+            }
+
+            if (checkpoint || (_options.checkpointSegments && _sealed >= _options.checkpointSegments))
+            {
+                _sealed = 0;
+                {
+                    std::lock_guard<std::mutex> lock(_checkpointMutex);
+                    _checkpointSegment = _segment;
+                    _checkpointDue = true;
+                }
+                _checkpointCv.notify_one();
+            }
+
+            if (stopping)
+            {
+                return;
+            }
+        }
+    }
+
+    void checkpointLoop()
+    {
+        for (;;)
+        {
+            uint64_t segment = 0;
+            {
+                std::unique_lock<std::mutex> lock(_checkpointMutex);
+                _checkpointCv.wait(lock, [&] { return _checkpointDue || _checkpointStop; });
+                if (_checkpointStop)
+                {
+                    return;
+                }
+
+                segment = _checkpointSegment;
+                _checkpointDue = false;
+            }
+
+            writeSnapshot(segment);
+        }
+    }
+
+    /// @brief Write the map as the snapshot that log segment `segment` continues, then delete the files
+    /// it replaces. The map snapshot is taken after every record of the older segments was applied.
+    void writeSnapshot(uint64_t segment)
+    {
+        if constexpr (requires(const Map& map) { map.snapshot(); })
+        {
+            namespace fs = std::filesystem;
+
+            const fs::path path = log_details::snapshotPath(_options.directory, segment);
+            fs::path temporary = path;
+            temporary += ".tmp";
+
+            const int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0)
+            {
+                std::cerr << "MessageLog: cannot create snapshot: " << std::strerror(errno) << std::endl;
+                return;
+            }
+
+            SnapshotHeader header{log_details::SNAPSHOT_MAGIC, 0, segment, 0};
+            bool written = log_details::writeAll(fd, &header, sizeof(header));
+
+            std::vector<Record> chunk;
+            chunk.reserve(IO_RECORDS);
+            auto writeChunk = [&]
+            {
+                written = written && log_details::writeAll(fd, chunk.data(), chunk.size() * sizeof(Record));
+                header.count += chunk.size();
+                chunk.clear();
+            };
+
+            {
+                const auto snapshot = _map.snapshot();
+                snapshot.forEach(
+                    [&](const Message& message)
+                    {
+                        chunk.push_back(log_details::makeRecord(Op::Insert, message));
+                        if (chunk.size() == IO_RECORDS)
+                        {
+                            writeChunk();
+                        }
+                    });
+            }
+            writeChunk();
+
+            header.check = log_details::checksum(header);
+            written = written && ::pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)) &&
+                      ::fdatasync(fd) == 0;
+            ::close(fd);
+
+            std::error_code error;
+            if (!written)
+            {
+                std::cerr << "MessageLog: snapshot write failed: " << std::strerror(errno) << std::endl;
+                fs::remove(temporary, error);
+                return;
+            }
+
+            fs::rename(temporary, path, error);
+            if (error)
+            {
+                std::cerr << "MessageLog: snapshot rename failed: " << error.message() << std::endl;
+                return;
+            }
+
+            for (const auto& entry : fs::directory_iterator(_options.directory, error))
+            {
+                uint64_t number = 0;
+                if ((log_details::parseNumber(entry.path(), "wal-", ".log", number) ||
+                        log_details::parseNumber(entry.path(), "snapshot-", ".bin", number)) &&
+                    number < segment)
+                {
+                    fs::remove(entry.path(), error);
+                }
+            }
+            log_details::syncDirectory(_options.directory);
+
+            _checkpoints.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            (void)segment;  // without a consistent view of the map the log is never compacted
+        }
+    }
+
+    static bool readHeader(const std::filesystem::path& path, SnapshotHeader& header)
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        const bool read = log_details::readAt(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+        ::close(fd);
+
+        std::error_code error;
+        const auto size = std::filesystem::file_size(path, error);
+        return read && !error && header.magic == log_details::SNAPSHOT_MAGIC &&
+               header.check == log_details::checksum(header) && size == sizeof(header) + header.count * sizeof(Record);
+    }
+
+    /// @brief Load the snapshot's records with one thread per core up to MAX_LOADERS, each reads and inserts its
+    /// own range
+    /// @return records that failed their checksum
+    size_t loadSnapshot(const std::filesystem::path& path, uint64_t count)
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "MessageLog: cannot open " + path.string());
+        }
+
+        const size_t threads = std::clamp<size_t>(std::min<size_t>(std::thread::hardware_concurrency(), MAX_LOADERS),
+            1, count / IO_RECORDS + 1);
+        std::atomic<size_t> corrupt{0};
+        std::atomic<bool> failed{false};
+
+        auto load = [&](uint64_t first, uint64_t last)
+        {
+            std::vector<Record> records(IO_RECORDS);
+            std::array<Message, LOAD_BATCH> batch;
+            std::bitset<LOAD_BATCH> inserted;
+            size_t batched = 0;
+
+            for (uint64_t position = first; position < last;)
+            {
+                const size_t wanted = static_cast<size_t>(std::min<uint64_t>(IO_RECORDS, last - position));
+                const auto offset = static_cast<off_t>(sizeof(SnapshotHeader) + position * sizeof(Record));
+                if (log_details::readAt(fd, records.data(), wanted * sizeof(Record), offset) !=
+                    static_cast<ssize_t>(wanted * sizeof(Record)))
+                {
+                    failed.store(true);
+                    return;
+                }
+
+                for (size_t i = 0; i < wanted; ++i)
+                {
+                    if (!log_details::valid(records[i]))
+                    {
+                        corrupt.fetch_add(1, std::memory_order_relaxed);
+                        continue;
+                    }
+
+                    batch[batched++] = log_details::toMessage(records[i]);
+                    if (batched == LOAD_BATCH)
+                    {
+                        _map.insertBatch(std::span<const Message>(batch.data(), batched), inserted);
+                        batched = 0;
+                    }
+                }
+                position += wanted;
+            }
+
+            _map.insertBatch(std::span<const Message>(batch.data(), batched), inserted);
+        };
+
+        std::vector<std::thread> loaders;
+        const uint64_t perThread = count / threads + 1;
+        for (size_t t = 1; t < threads; ++t)
+        {
+            loaders.emplace_back(load, std::min(count, t * perThread), std::min(count, (t + 1) * perThread));
+        }
+        load(0, std::min(count, perThread));
+
+        for (auto& loader : loaders)
+        {
+            loader.join();
+        }
+        ::close(fd);
+
+        if (failed.load())
+        {
+            throw std::runtime_error("MessageLog: cannot read " + path.string());
+        }
+        return corrupt.load();
+    }
+
+    /// @brief Apply one segment in log order
+    /// @return false if the segment ends with a torn record
+    bool replaySegment(const std::filesystem::path& path)
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "MessageLog: cannot open " + path.string());
+        }
+
+        std::vector<Record> records(IO_RECORDS);
+        bool complete = true;
+        for (off_t offset = 0; complete;)
+        {
+            const ssize_t bytes = log_details::readAt(fd, records.data(), IO_RECORDS * sizeof(Record), offset);
+            if (bytes <= 0)
+            {
+                complete = bytes == 0;
+                break;
+            }
+
+            const size_t count = static_cast<size_t>(bytes) / sizeof(Record);
+            complete = static_cast<size_t>(bytes) % sizeof(Record) == 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (!log_details::valid(records[i]))
+                {
+                    complete = false;
+                    break;
+                }
+
+                if (records[i].op == Op::Insert)
+                {
+                    _map.insert(log_details::toMessage(records[i]));
+                }
+                else
+                {
+                    _map.remove(records[i].id);
+                }
+            }
+            offset += bytes;
+        }
+
+        ::close(fd);
+        return complete;
+    }
+
+  public:
+    explicit MessageLog(Map& map, MessageLogOptions options)
+        : _map(map)
+        , _options(std::move(options))
+        , _groupRecords(std::max<size_t>(1, _options.groupBytes / sizeof(Record)))
+        , _keyLocks(std::make_unique<std::mutex[]>(KEY_LOCKS))
+    {
+        _pending.reserve(_groupRecords);
+    }
+
+    /// @brief Commits what is pending and stops the writer, a running checkpoint is finished first
+    ~MessageLog()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _commitCv.notify_one();
+        if (_writer.joinable())
+        {
+            _writer.join();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_checkpointMutex);
+            _checkpointStop = true;
+        }
+        _checkpointCv.notify_one();
+        if (_checkpointer.joinable())
+        {
+            _checkpointer.join();
+        }
+
+        if (_fd >= 0)
+        {
+            ::close(_fd);
+        }
+    }
+
+    MessageLog(const MessageLog&) = delete;
+    MessageLog& operator=(const MessageLog&) = delete;
+    MessageLog(MessageLog&&) = delete;
+    MessageLog& operator=(MessageLog&&) = delete;
+
+    /// @brief Rebuild the map from the newest snapshot and the segments after it, then start logging
+    /// Call once before the map is shared, nothing is logged before.
+    /// @return number of messages in the map afterwards
+    size_t recover()
+    {
+        namespace fs = std::filesystem;
+
+        fs::create_directories(_options.directory);
+
+        std::vector<uint64_t> snapshots;
+        std::vector<uint64_t> segments;
+        for (const auto& entry : fs::directory_iterator(_options.directory))
+        {
+            uint64_t number = 0;
+            if (log_details::parseNumber(entry.path(), "snapshot-", ".bin", number))
+            {
+                snapshots.push_back(number);
+            }
+            else if (log_details::parseNumber(entry.path(), "wal-", ".log", number))
+            {
+                segments.push_back(number);
+            }
+            else if (entry.path().extension() == ".tmp")
+            {
+                fs::remove(entry.path());  // a checkpoint that did not finish
+            }
+        }
+
+        // newest complete snapshot, the log before it is not needed
+        SnapshotHeader header{};
+        bool haveSnapshot = false;
+        std::sort(snapshots.rbegin(), snapshots.rend());
+        for (uint64_t number : snapshots)
+        {
+            if (readHeader(log_details::snapshotPath(_options.directory, number), header) && header.segment == number)
+            {
+                haveSnapshot = true;
+                break;
+            }
+            std::cerr << "MessageLog: ignoring damaged snapshot " << number << std::endl;
+        }
+
+        const uint64_t first = haveSnapshot ? header.segment : 0;
+        std::sort(segments.begin(), segments.end());
+        std::erase_if(segments, [first](uint64_t segment) { return segment < first; });
+
+        // size the table once for everything that is about to be inserted
+        uint64_t logged = 0;
+        for (uint64_t segment : segments)
+        {
+            logged += fs::file_size(log_details::segmentPath(_options.directory, segment)) / sizeof(Record);
+        }
+        if constexpr (requires(Map& map, size_t entries) { map.reserve(entries); })
+        {
+            _map.reserve(static_cast<size_t>((haveSnapshot ? header.count : 0) + logged));
+        }
+
+        if (haveSnapshot)
+        {
+            if (size_t corrupt = loadSnapshot(log_details::snapshotPath(_options.directory, first), header.count))
+            {
+                std::cerr << "MessageLog: skipped " << corrupt << " damaged snapshot records" << std::endl;
+            }
+        }
+
+        for (uint64_t segment : segments)
+        {
+            // the writer continues in a new segment after a failed write, the next segments are still valid
+            if (!replaySegment(log_details::segmentPath(_options.directory, segment)))
+            {
+                std::cerr << "MessageLog: segment " << segment << " ends with a torn record" << std::endl;
+            }
+        }
+
+        // never append behind a torn record, logging goes on in a fresh segment
+        _segment = segments.empty() ? first : segments.back() + 1;
+        _fd = openSegment(_segment);
+        if (_fd < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "MessageLog: cannot create a log segment");
+        }
+
+        _writer = std::thread(&MessageLog::writerLoop, this);
+        _checkpointer = std::thread(&MessageLog::checkpointLoop, this);
+
+        return _map.size();
+    }
+
+    /// @brief Insert into the map and log the insert if it was accepted
+    /// @throw std::system_error while the log cannot be written, the map is left unchanged
+    bool insert(const Message& message)
+    {
+        throwIfFailing();
+
+        std::lock_guard<std::mutex> lock(keyLock(message.MessageId));
+        if (!_map.insert(message))
+        {
+            return false;
+        }
+
+        append(Op::Insert, message);
+        return true;
+    }
+
+    /// @brief Remove from the map and log the remove if the key was present
+    /// @throw std::system_error while the log cannot be written, the map is left unchanged
+    bool remove(uint64_t messageId)
+    {
+        throwIfFailing();
+
+        std::lock_guard<std::mutex> lock(keyLock(messageId));
+        if (!_map.remove(messageId))
+        {
+            return false;
+        }
+
+        append(Op::Remove, Message{0, 0, messageId, 0});
+        return true;
+    }
+
+    /// @brief Wait until everything accepted so far is on disk, needs recover() to have run
+    /// @return false if a write failed, the records stay queued and the writer keeps retrying them
+    bool flush()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        const uint64_t target = _appended;
+        _durableCv.wait(lock, [&] { return _durable >= target || _error.load(std::memory_order_relaxed); });
+        return _durable >= target;
+    }
+
+    /// @brief Seal the current segment with the next group and write a compacted snapshot
+    void checkpoint()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _checkpointRequested = true;
+        }
+        _commitCv.notify_one();
+    }
+
+    /// @brief Snapshots written so far
+    size_t checkpoints() const
+    {
+        return _checkpoints.load(std::memory_order_relaxed);
+    }
+};
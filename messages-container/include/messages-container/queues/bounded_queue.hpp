@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <thread>
+
+/// @brief Bounded multi producer queue (Vyukov), single or multi consumer
+/// Every cell carries a sequence number: a cell at position pos is free for the producer of pos while its
+/// sequence is pos, filled while it is pos + 1, and free again for the next lap at pos + Capacity.
+/// A producer claims a position with a CAS on the enqueue counter, consumers the same on the dequeue
+/// counter (a plain store with a single consumer), so threads only contend on the counter they share.
+/// push_n/pop_n claim a whole run of positions with one CAS. A run may reach cells whose previous owner
+/// claimed them but has not released them yet, those are waited for (the owner is in the middle of a copy).
+/// @tparam T element, default constructible and copy assignable
+/// @tparam Capacity number of cells, a power of two
+/// @tparam MultiConsumer false for a single consumer (MPSC), its side needs no CAS
+template <typename T, size_t Capacity, bool MultiConsumer = true> class BoundedQueue
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    static constexpr size_t MASK = Capacity - 1;
+
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    alignas(64) std::atomic<size_t> _enqueue{0};
+    alignas(64) std::atomic<size_t> _dequeue{0};
+    alignas(64) std::array<Cell, Capacity> _cells;
+
+    static void waitFor(const Cell& cell, size_t sequence)
+    {
+        while (cell.sequence.load(std::memory_order_acquire) != sequence)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    static intptr_t distance(size_t from, size_t to)
+    {
+        return static_cast<intptr_t>(to - from);
+    }
+
+  public:
+    BoundedQueue()
+    {
+        for (size_t i = 0; i < Capacity; ++i)
+        {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    bool push(const T& value)
+    {
+        size_t pos = _enqueue.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = _cells[pos & MASK];
+            const intptr_t diff = distance(pos, cell.sequence.load(std::memory_order_acquire));
+            if (diff == 0)
+            {
+                if (_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.value = value;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;  // full: the cell still holds the value of the previous lap
+            }
+            else
+            {
+                pos = _enqueue.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /// @brief Push as many leading values as there is room for, one CAS for the whole run
+    /// @return number of values pushed
+    size_t push_n(std::span<const T> values)
+    {
+        size_t pos = _enqueue.load(std::memory_order_relaxed);
+        size_t count = 0;
+        do
+        {
+            const intptr_t used = distance(_dequeue.load(std::memory_order_acquire), pos);
+            const intptr_t free = static_cast<intptr_t>(Capacity) - std::max<intptr_t>(used, 0);
+            count = std::min(values.size(), static_cast<size_t>(std::max<intptr_t>(free, 0)));
+            if (!count)
+            {
+                return 0;
+            }
+        } while (!_enqueue.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed));
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            Cell& cell = _cells[(pos + i) & MASK];
+            waitFor(cell, pos + i);
+            cell.value = values[i];
+            cell.sequence.store(pos + i + 1, std::memory_order_release);
+        }
+        return count;
+    }
+
+    bool pop(T& value)
+    {
+        size_t pos = _dequeue.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = _cells[pos & MASK];
+            const intptr_t diff = distance(pos + 1, cell.sequence.load(std::memory_order_acquire));
+            if (diff == 0)
+            {
+                if constexpr (MultiConsumer)
+                {
+                    if (!_dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        continue;
+                    }
+                }
+                else
+                {
+                    _dequeue.store(pos + 1, std::memory_order_relaxed);
+                }
+
+                value = cell.value;
+                cell.sequence.store(pos + Capacity, std::memory_order_release);
+                return true;
+            }
+            else if (diff < 0)
+            {
+                return false;  // empty
+            }
+            else
+            {
+                pos = _dequeue.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /// @brief Pop up to values.size() values, one CAS for the whole run
+    /// @return number of values popped
+    size_t pop_n(std::span<T> values)
+    {
+        size_t pos = _dequeue.load(std::memory_order_relaxed);
+        size_t count = 0;
+        for (;;)
+        {
+            const intptr_t filled = distance(pos, _enqueue.load(std::memory_order_acquire));
+            count = std::min(values.size(), static_cast<size_t>(std::max<intptr_t>(filled, 0)));
+            if (!count)
+            {
+                return 0;
+            }
+
+            if constexpr (MultiConsumer)
+            {
+                if (_dequeue.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else
+            {
+                _dequeue.store(pos + count, std::memory_order_relaxed);
+                break;
+            }
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            Cell& cell = _cells[(pos + i) & MASK];
+            waitFor(cell, pos + i + 1);
+            values[i] = cell.value;
+            cell.sequence.store(pos + i + Capacity, std::memory_order_release);
+        }
+        return count;
+    }
+
+    /// @brief Approximate while producers or consumers run
+    size_t size() const
+    {
+        const intptr_t size = distance(_dequeue.load(std::memory_order_acquire), _enqueue.load(std::memory_order_acquire));
+        return static_cast<size_t>(std::clamp<intptr_t>(size, 0, Capacity));
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    static constexpr size_t capacity()
+    {
+        return Capacity;
+    }
+};
+
+template <typename T, size_t Capacity> using MpscQueue = BoundedQueue<T, Capacity, false>;
+template <typename T, size_t Capacity> using MpmcQueue = BoundedQueue<T, Capacity, true>;
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <span>
+
+/// @brief Bounded single producer single consumer ring
+/// Head and tail are monotonic counters on their own cache lines, the slot is the counter masked by Capacity - 1.
+/// Each side keeps a cached copy of the other side's counter and reloads it only when the ring looks full
+/// (producer) or empty (consumer), so in steady state a push or pop touches no shared line but the slot.
+/// @tparam T element, default constructible and copy assignable
+/// @tparam Capacity number of slots, a power of two
+template <typename T, size_t Capacity> class SpscRing
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    static constexpr size_t MASK = Capacity - 1;
+
+    struct alignas(64) Producer
+    {
+        std::atomic<size_t> tail{0};
+        size_t cachedHead{0};
+    };
+
+    struct alignas(64) Consumer
+    {
+        std::atomic<size_t> head{0};
+        size_t cachedTail{0};
+    };
+
+    Producer _producer;
+    Consumer _consumer;
+    alignas(64) std::array<T, Capacity> _slots{};
+
+    /// @brief Free slots seen by the producer, reloads the head only if fewer than wanted
+    size_t freeSlots(size_t tail, size_t wanted)
+    {
+        size_t free = Capacity - (tail - _producer.cachedHead);
+        if (free < wanted)
+        {
+            _producer.cachedHead = _consumer.head.load(std::memory_order_acquire);
+            free = Capacity - (tail - _producer.cachedHead);
+        }
+        return free;
+    }
+
+    /// @brief Filled slots seen by the consumer, reloads the tail only if fewer than wanted
+    size_t filledSlots(size_t head, size_t wanted)
+    {
+        size_t filled = _consumer.cachedTail - head;
+        if (filled < wanted)
+        {
+            _consumer.cachedTail = _producer.tail.load(std::memory_order_acquire);
+            filled = _consumer.cachedTail - head;
+        }
+        return filled;
+    }
+
+  public:
+    /// @brief Producer side
+    bool push(const T& value)
+    {
+        const size_t tail = _producer.tail.load(std::memory_order_relaxed);
+        if (!freeSlots(tail, 1))
+        {
+            return false;
+        }
+
+        _slots[tail & MASK] = value;
+        _producer.tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// @brief Producer side, pushes as many leading values as fit with one release of the tail
+    /// @return number of values pushed
+    size_t push_n(std::span<const T> values)
+    {
+        const size_t tail = _producer.tail.load(std::memory_order_relaxed);
+        const size_t count = std::min(values.size(), freeSlots(tail, values.size()));
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            _slots[(tail + i) & MASK] = values[i];
+        }
+
+        if (count)
+        {
+            _producer.tail.store(tail + count, std::memory_order_release);
+        }
+        return count;
+    }
+
+    /// @brief Consumer side
+    bool pop(T& value)
+    {
+        const size_t head = _consumer.head.load(std::memory_order_relaxed);
+        if (!filledSlots(head, 1))
+        {
+            return false;
+        }
+
+        value = _slots[head & MASK];
+        _consumer.head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// @brief Consumer side, pops up to values.size() with one release of the head
+    /// @return number of values popped
+    size_t pop_n(std::span<T> values)
+    {
+        const size_t head = _consumer.head.load(std::memory_order_relaxed);
+        const size_t count = std::min(values.size(), filledSlots(head, values.size()));
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            values[i] = _slots[(head + i) & MASK];
+        }
+
+        if (count)
+        {
+            _consumer.head.store(head + count, std::memory_order_release);
+        }
+        return count;
+    }
+
+    /// @brief Approximate while both sides run
+    size_t size() const
+    {
+        const size_t head = _consumer.head.load(std::memory_order_acquire);
+        return _producer.tail.load(std::memory_order_acquire) - head;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    static constexpr size_t capacity()
+    {
+        return Capacity;
+    }
+};
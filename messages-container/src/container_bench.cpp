@@ -0,0 +1,1202 @@
+#include "messages-container/allocators/node_pool.hpp"
+#include "messages-container/blocking/flat_hash_map.hpp"
+#include "messages-container/blocking/hash_map.hpp"
+#include "messages-container/blocking/shared_memory_hash_map.hpp"
+#include "messages-container/blocking/sharded_hash_map.hpp"
+#include "messages-container/filters/prefiltered_map.hpp"
+#include "messages-container/lock-free/details/epoch_based_freedom.hpp"
+#include "messages-container/lock-free/details/hazard_pointers.hpp"
+#include "messages-container/lock-free/lock_free_container.hpp"
+#include "messages-container/persistence/message_log.hpp"
+#include "messages-container/queues/bounded_queue.hpp"
+#include "messages-container/queues/spsc_ring.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <bitset>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <shared_mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+constexpr size_t NUM_KEYS = 1 << 18;
+constexpr size_t NUM_WRITERS = 2;  // same as the number of UDP receive threads
+constexpr size_t NUM_RETIRED = 1 << 20;
+
+using Clock = std::chrono::steady_clock;
+
+struct Result
+{
+    double insertNs;
+    double findHitNs;
+    double findMissNs;
+    double removeNs;
+    double concurrentInsertNs;
+    double concurrentFindNs;
+};
+
+std::vector<Message> generate_messages(size_t count, uint64_t seed)
+{
+    std::mt19937_64 rng(seed);
+    std::vector<Message> messages(count);
+    for (auto& message : messages)
+    {
+        message = Message{MESSAGE_SIZE, static_cast<uint8_t>(rng()), rng(), rng()};
+    }
+    return messages;
+}
+
+template <typename Fn> double ns_per_op(size_t ops, Fn&& fn)
+{
+    auto start = Clock::now();
+    fn();
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    return static_cast<double>(elapsed) / static_cast<double>(ops);
+}
+
+template <typename Map> Result run_bench(const std::vector<Message>& messages, const std::vector<Message>& misses)
+{
+    Result result{};
+    Message found{};
+    size_t hits = 0;
+
+    {
+        Map map;
+
+        result.insertNs = ns_per_op(messages.size(),
+            [&]
+            {
+                for (const auto& message : messages)
+                {
+                    map.insert(message);
+                }
+            });
+
+        result.findHitNs = ns_per_op(messages.size(),
+            [&]
+            {
+                for (const auto& message : messages)
+                {
+                    hits += map.find(message.MessageId, found);
+                }
+            });
+
+        result.findMissNs = ns_per_op(misses.size(),
+            [&]
+            {
+                for (const auto& message : misses)
+                {
+                    hits += map.find(message.MessageId, found);
+                }
+            });
+
+        result.removeNs = ns_per_op(messages.size(),
+            [&]
+            {
+                for (const auto& message : messages)
+                {
+                    map.remove(message.MessageId);
+                }
+            });
+    }
+
+    {
+        Map map;
+
+        result.concurrentInsertNs = ns_per_op(messages.size(),
+            [&]
+            {
+                std::vector<std::thread> threads;
+                for (size_t t = 0; t < NUM_WRITERS; ++t)
+                {
+                    threads.emplace_back(
+                        [&, t]
+                        {
+                            for (size_t i = t; i < messages.size(); i += NUM_WRITERS)
+                            {
+                                map.insert(messages[i]);
+                            }
+                        });
+                }
+
+                for (auto& thread : threads)
+                {
+                    thread.join();
+                }
+            });
+
+        // readers share the keys, each one looks up all of them
+        std::atomic<size_t> concurrentHits{0};
+        result.concurrentFindNs = ns_per_op(messages.size() * NUM_WRITERS,
+            [&]
+            {
+                std::vector<std::thread> threads;
+                for (size_t t = 0; t < NUM_WRITERS; ++t)
+                {
+                    threads.emplace_back(
+                        [&]
+                        {
+                            Message local{};
+                            size_t localHits = 0;
+                            for (const auto& message : messages)
+                            {
+                                localHits += map.find(message.MessageId, local);
+                            }
+                            concurrentHits.fetch_add(localHits);
+                        });
+                }
+
+                for (auto& thread : threads)
+                {
+                    thread.join();
+                }
+            });
+        hits += concurrentHits.load() / NUM_WRITERS;
+    }
+
+    if (hits != 2 * messages.size())
+    {
+        std::fprintf(stderr, "unexpected hit count %zu\n", hits);
+    }
+
+    return result;
+}
+
+/// @brief insertBatch/findBatch against the one at a time loop over the same messages
+template <typename Map, size_t Batch> void bench_batch(const char* name, const std::vector<Message>& messages)
+{
+    std::vector<uint64_t> ids(messages.size());
+    for (size_t i = 0; i < messages.size(); ++i)
+    {
+        ids[i] = messages[i].MessageId;
+    }
+
+    std::array<Message, Batch> results;
+    std::bitset<Batch> bits;
+    Message found{};
+    size_t hits = 0;
+
+    Map single;
+    double insertNs = ns_per_op(messages.size(),
+        [&]
+        {
+            for (const auto& message : messages)
+            {
+                single.insert(message);
+            }
+        });
+    double findNs = ns_per_op(messages.size(),
+        [&]
+        {
+            for (uint64_t id : ids)
+            {
+                hits += single.find(id, found);
+            }
+        });
+
+    Map batched;
+    double insertBatchNs = ns_per_op(messages.size(),
+        [&]
+        {
+            for (size_t i = 0; i < messages.size(); i += Batch)
+            {
+                size_t count = std::min(Batch, messages.size() - i);
+                batched.insertBatch(std::span<const Message>(messages.data() + i, count), bits);
+            }
+        });
+    double findBatchNs = ns_per_op(messages.size(),
+        [&]
+        {
+            for (size_t i = 0; i < ids.size(); i += Batch)
+            {
+                size_t count = std::min(Batch, ids.size() - i);
+                hits += batched.findBatch(std::span<const uint64_t>(ids.data() + i, count), std::span<Message>(results), bits);
+            }
+        });
+
+    if (hits != 2 * messages.size())
+    {
+        std::fprintf(stderr, "unexpected hit count %zu\n", hits);
+    }
+
+    std::printf("%-24s %6zu %10.1f %10.1f %8.2fx %10.1f %10.1f %8.2fx\n", name, Batch, insertNs, insertBatchNs,
+        insertNs / insertBatchNs, findNs, findBatchNs, findNs / findBatchNs);
+}
+
+/// @brief Producers hand NUM_KEYS messages to consumers, one at a time or in batches of Batch (1 = push/pop)
+template <typename Queue, size_t Batch>
+double bench_queue_batch(const std::vector<Message>& messages, size_t producers, size_t consumers)
+{
+    Queue queue;
+    std::atomic<size_t> consumed{0};
+
+    return ns_per_op(messages.size(),
+        [&]
+        {
+            std::vector<std::thread> threads;
+            for (size_t p = 0; p < producers; ++p)
+            {
+                threads.emplace_back(
+                    [&, p]
+                    {
+                        for (size_t i = p * Batch; i < messages.size();)
+                        {
+                            size_t pushed = 0;
+                            if constexpr (Batch == 1)
+                            {
+                                pushed = queue.push(messages[i]);
+                            }
+                            else
+                            {
+                                // producers take alternating chunks of Batch messages
+                                const size_t end = std::min(messages.size(), (i / Batch + 1) * Batch);
+                                pushed = queue.push_n(std::span<const Message>(messages.data() + i, end - i));
+                            }
+
+                            if (!pushed)
+                            {
+                                std::this_thread::yield();
+                                continue;
+                            }
+
+                            i += pushed;
+                            if (i % Batch == 0)
+                            {
+                                i += (producers - 1) * Batch;
+                            }
+                        }
+                    });
+            }
+
+            for (size_t c = 0; c < consumers; ++c)
+            {
+                threads.emplace_back(
+                    [&]
+                    {
+                        std::array<Message, Batch> batch;
+                        while (consumed.load(std::memory_order_relaxed) < messages.size())
+                        {
+                            size_t popped = 0;
+                            if constexpr (Batch == 1)
+                            {
+                                popped = queue.pop(batch[0]);
+                            }
+                            else
+                            {
+                                popped = queue.pop_n(std::span<Message>(batch));
+                            }
+
+                            consumed.fetch_add(popped, std::memory_order_relaxed);
+                            if (!popped)
+                            {
+                                std::this_thread::yield();
+                            }
+                        }
+                    });
+            }
+
+            for (auto& thread : threads)
+            {
+                thread.join();
+            }
+        });
+}
+
+template <typename Queue>
+void bench_queue(const char* name, const std::vector<Message>& messages, size_t producers, size_t consumers)
+{
+    const double single = bench_queue_batch<Queue, 1>(messages, producers, consumers);
+    const double batched = bench_queue_batch<Queue, 32>(messages, producers, consumers);
+    std::printf("%-24s %3zu %3zu %10.1f %10.1f %8.2fx\n", name, producers, consumers, single, batched, single / batched);
+}
+
+/// @brief NUM_WRITERS threads ingest a feed where every message is retransmitted Copies - 1 times
+/// @return ns per insert
+template <size_t Copies, typename Map> double bench_duplicates(Map& map, const std::vector<Message>& messages)
+{
+    return ns_per_op(messages.size() * Copies,
+        [&]
+        {
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < NUM_WRITERS; ++t)
+            {
+                threads.emplace_back(
+                    [&, t]
+                    {
+                        for (size_t i = t; i < messages.size() * Copies; i += NUM_WRITERS)
+                        {
+                            // retransmissions follow their original within a short window
+                            const size_t window = i / (Copies * 64);
+                            map.insert(messages[window * 64 + i % 64]);
+                        }
+                    });
+            }
+
+            for (auto& thread : threads)
+            {
+                thread.join();
+            }
+        });
+}
+
+/// @brief Single thread insert/find of ids whose low byte is a constant sender id, chain skew of each map
+template <typename Hash> void bench_hash(const char* name, const std::vector<Message>& messages)
+{
+    std::vector<Message> skewed(messages);
+    for (size_t i = 0; i < skewed.size(); ++i)
+    {
+        skewed[i].MessageId = static_cast<uint64_t>(i) << 8 | 7;
+    }
+
+    auto run = [&](auto& map, const char* container)
+    {
+        Message found{};
+        size_t hits = 0;
+        double insertNs = ns_per_op(skewed.size(),
+            [&]
+            {
+                for (const auto& message : skewed)
+                {
+                    map.insert(message);
+                }
+            });
+        double findNs = ns_per_op(skewed.size(),
+            [&]
+            {
+                for (const auto& message : skewed)
+                {
+                    hits += map.find(message.MessageId, found);
+                }
+            });
+
+        if (hits != skewed.size())
+        {
+            std::fprintf(stderr, "unexpected hit count %zu\n", hits);
+        }
+
+        const auto stats = map.chainStats();
+        std::printf("%-12s %-12s %10.1f %10.1f %10zu %10.2f\n", container, name, insertNs, findNs, stats.maxLength,
+            stats.skew());
+    };
+
+    {
+        HashMap<INITIAL_CAPACITY, std::allocator<Message>, false, std::shared_mutex, Hash> map;
+        run(map, "HashMap");
+    }
+    {
+        LF_HashMap<Message, INITIAL_CAPACITY, EpochManager, std::allocator<Message>, Hash> map;
+        run(map, "LF_HashMap");
+    }
+}
+
+/// @brief Single thread insert/find/remove, the cost of the stripe lock itself without contention
+template <typename Map> void bench_single_owner(const char* name, const std::vector<Message>& messages)
+{
+    Map map;
+    Message found{};
+    size_t hits = 0;
+
+    double insertNs = ns_per_op(messages.size(),
+        [&]
+        {
+            for (const auto& message : messages)
+            {
+                map.insert(message);
+            }
+        });
+    double findNs = ns_per_op(messages.size(),
+        [&]
+        {
+            for (const auto& message : messages)
+            {
+                hits += map.find(message.MessageId, found);
+            }
+        });
+    double removeNs = ns_per_op(messages.size(),
+        [&]
+        {
+            for (const auto& message : messages)
+            {
+                map.remove(message.MessageId);
+            }
+        });
+
+    if (hits != messages.size())
+    {
+        std::fprintf(stderr, "unexpected hit count %zu\n", hits);
+    }
+
+    std::printf("%-32s %10.1f %10.1f %10.1f\n", name, insertNs, findNs, removeNs);
+}
+
+template <typename Map> void bench_batches(const char* name, const std::vector<Message>& messages)
+{
+    bench_batch<Map, 8>(name, messages);
+    bench_batch<Map, 32>(name, messages);
+    bench_batch<Map, 128>(name, messages);
+}
+
+/// @brief 2 thread ingest alone and while a reader keeps taking and walking snapshots
+void bench_snapshot(const std::vector<Message>& messages)
+{
+    auto ingest = [&](bool exporting, double& snapshotNs, size_t& snapshots)
+    {
+        HashMap<INITIAL_CAPACITY> map;
+        std::atomic<bool> running{true};
+        std::thread exporter;
+        if (exporting)
+        {
+            exporter = std::thread(
+                [&]
+                {
+                    double createNs = 0;
+                    while (running.load())
+                    {
+                        size_t visited = 0;
+                        createNs += ns_per_op(1, [&] { map.snapshot().forEach([&](const Message&) { ++visited; }); });
+                        ++snapshots;
+                    }
+                    snapshotNs = snapshots ? createNs / static_cast<double>(snapshots) : 0;
+                });
+        }
+
+        double insertNs = ns_per_op(messages.size(),
+            [&]
+            {
+                std::vector<std::thread> threads;
+                for (size_t t = 0; t < NUM_WRITERS; ++t)
+                {
+                    threads.emplace_back(
+                        [&, t]
+                        {
+                            for (size_t i = t; i < messages.size(); i += NUM_WRITERS)
+                            {
+                                map.insert(messages[i]);
+                            }
+                        });
+                }
+
+                for (auto& thread : threads)
+                {
+                    thread.join();
+                }
+            });
+
+        running.store(false);
+        if (exporter.joinable())
+        {
+            exporter.join();
+        }
+        return insertNs;
+    };
+
+    double snapshotNs = 0;
+    size_t snapshots = 0;
+    double aloneNs = ingest(false, snapshotNs, snapshots);
+    double exportingNs = ingest(true, snapshotNs, snapshots);
+
+    std::printf("%-32s %10.1f\n", "insert 2t", aloneNs);
+    std::printf("%-32s %10.1f\n", "insert 2t, snapshots running", exportingNs);
+    std::printf("%-32s %10.0f (%zu taken)\n", "snapshot + walk", snapshotNs, snapshots);
+}
+
+/// @brief Logged 2 thread ingest, then a restart from the snapshot alone and from the log alone
+void bench_recovery(const std::vector<Message>& messages)
+{
+    using Map = HashMap<INITIAL_CAPACITY>;
+
+    const auto directory = std::filesystem::temp_directory_path() / "container_bench_log";
+    MessageLogOptions options;
+    options.directory = directory;
+    options.checkpointSegments = 0;
+
+    auto recover = [&]
+    {
+        Map map;
+        MessageLog<Map> log(map, options);
+        double ns = ns_per_op(messages.size(), [&] { log.recover(); });
+        if (map.size() != messages.size())
+        {
+            std::fprintf(stderr, "recovered %zu of %zu\n", map.size(), messages.size());
+        }
+        return ns;
+    };
+
+    std::filesystem::remove_all(directory);
+    double insertNs = 0;
+    {
+        Map map;
+        MessageLog<Map> log(map, options);
+        log.recover();
+
+        insertNs = ns_per_op(messages.size(),
+            [&]
+            {
+                std::vector<std::thread> threads;
+                for (size_t t = 0; t < NUM_WRITERS; ++t)
+                {
+                    threads.emplace_back(
+                        [&, t]
+                        {
+                            for (size_t i = t; i < messages.size(); i += NUM_WRITERS)
+                            {
+                                log.insert(messages[i]);
+                            }
+                        });
+                }
+
+                for (auto& thread : threads)
+                {
+                    thread.join();
+                }
+            });
+        log.flush();
+    }
+    double replayNs = recover();
+
+    {
+        Map map;
+        MessageLog<Map> log(map, options);
+        log.recover();
+        log.checkpoint();
+        while (!log.checkpoints())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    double snapshotNs = recover();
+    std::filesystem::remove_all(directory);
+
+    std::printf("%-32s %10.1f\n", "logged insert 2t", insertNs);
+    std::printf("%-32s %10.1f\n", "recover from log", replayNs);
+    std::printf("%-32s %10.1f\n", "recover from snapshot", snapshotNs);
+}
+
+struct RetiredNode
+{
+    Message message;
+    void* next;
+};
+
+std::vector<RetiredNode*> allocate_nodes()
+{
+    std::vector<RetiredNode*> nodes(NUM_RETIRED);
+    for (auto& node : nodes)
+    {
+        node = new RetiredNode{};
+    }
+    return nodes;
+}
+
+/// @brief Retire cost alone (a reader pins the epoch), then the cost of freeing the backlog
+void bench_epoch_reclamation()
+{
+    EpochManager<RetiredNode> manager;
+    auto nodes = allocate_nodes();
+
+    std::atomic<bool> pinned{false};
+    std::atomic<bool> release{false};
+    std::thread reader(
+        [&]
+        {
+            manager.enterEpoch();
+            pinned.store(true);
+            while (!release.load())
+            {
+                std::this_thread::yield();
+            }
+            manager.exitEpoch();
+        });
+
+    while (!pinned.load())
+    {
+        std::this_thread::yield();
+    }
+
+    double retireNs = ns_per_op(nodes.size(),
+        [&]
+        {
+            EpochManager<RetiredNode>::Guard guard(manager);
+            for (auto* node : nodes)
+            {
+                manager.retireNode(node);
+            }
+        });
+
+    release.store(true);
+    reader.join();
+
+    double reclaimNs = ns_per_op(nodes.size(),
+        [&]
+        {
+            while (manager.retiredCount() != 0)
+            {
+                manager.flush();
+            }
+        });
+
+    nodes = allocate_nodes();
+    double steadyNs = ns_per_op(nodes.size(),
+        [&]
+        {
+            for (auto* node : nodes)
+            {
+                EpochManager<RetiredNode>::Guard guard(manager);
+                manager.retireNode(node);
+            }
+        });
+
+    std::printf("%-32s %10.1f\n", "epoch retire (reader pinned)", retireNs);
+    std::printf("%-32s %10.1f\n", "epoch reclaim backlog", reclaimNs);
+    std::printf("%-32s %10.1f\n", "epoch retire + reclaim", steadyNs);
+}
+
+void bench_hazard_reclamation()
+{
+    HazardPointerDomain<RetiredNode> domain;
+    auto nodes = allocate_nodes();
+
+    double steadyNs = ns_per_op(nodes.size(),
+        [&]
+        {
+            for (auto* node : nodes)
+            {
+                HazardPointerDomain<RetiredNode>::Guard guard(domain);
+                domain.retireNode(node);
+            }
+        });
+
+    std::printf("%-32s %10.1f\n", "hazard retire + reclaim", steadyNs);
+}
+
+void print_header()
+{
+    std::printf("%-24s %10s %10s %10s %10s %10s %10s %9s\n", "ns/op", "insert", "find hit", "find miss", "remove",
+        "insert 2t", "find 2t", "speedup");
+}
+
+/// @brief One container per row, speedup of the 2 thread insert over the baseline
+void print_row(const char* name, const Result& base, const Result& result)
+{
+    std::printf("%-24s %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %8.2fx\n", name, result.insertNs, result.findHitNs,
+        result.findMissNs, result.removeNs, result.concurrentInsertNs, result.concurrentFindNs,
+        base.concurrentInsertNs / result.concurrentInsertNs);
+}
+
+// Suite (ContainerBench --suite): throughput and latency percentiles over thread counts, op mixes and key
+// distributions, every cell is a fresh map, results go to stdout and to a JSON file
+
+constexpr size_t SUITE_KEYS = 1 << 18;  // key universe, half of it is inserted before a cell starts
+constexpr size_t STREAM_LENGTH = 1 << 16;  // pregenerated ops per thread, replayed in a loop
+constexpr size_t LATENCY_SAMPLE = 8;  // one op in LATENCY_SAMPLE is timed
+constexpr double ZIPF_EXPONENT = 0.99;
+
+/// @brief Log-linear histogram of latencies: 16 sub-buckets per power of two, about 6% resolution
+class LatencyHistogram
+{
+    static constexpr size_t SUB_BITS = 4;
+    static constexpr size_t SUB_BUCKETS = size_t{1} << SUB_BITS;
+
+    std::array<uint64_t, 64 * SUB_BUCKETS> _counts{};
+    uint64_t _total{0};
+
+    static size_t index(uint64_t ns)
+    {
+        if (ns < SUB_BUCKETS)
+        {
+            return ns;
+        }
+        const size_t msb = 63 - std::countl_zero(ns);
+        return ((msb - SUB_BITS + 1) << SUB_BITS) | ((ns >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1));
+    }
+
+    /// @brief Lower bound of a bucket
+    static uint64_t value(size_t index)
+    {
+        if (index < SUB_BUCKETS)
+        {
+            return index;
+        }
+        return (SUB_BUCKETS | (index & (SUB_BUCKETS - 1))) << ((index >> SUB_BITS) - 1);
+    }
+
+  public:
+    void add(uint64_t ns)
+    {
+        ++_counts[index(ns)];
+        ++_total;
+    }
+
+    void merge(const LatencyHistogram& other)
+    {
+        for (size_t i = 0; i < _counts.size(); ++i)
+        {
+            _counts[i] += other._counts[i];
+        }
+        _total += other._total;
+    }
+
+    uint64_t percentile(double fraction) const
+    {
+        const auto rank = static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(_total)));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < _counts.size(); ++i)
+        {
+            seen += _counts[i];
+            if (seen >= rank && seen)
+            {
+                return value(i);
+            }
+        }
+        return 0;
+    }
+};
+
+enum class Op : uint8_t
+{
+    Find,
+    Insert,
+    Remove
+};
+
+/// @brief Share of finds and inserts in percent, the rest are removes
+struct Workload
+{
+    const char* name;
+    unsigned findPercent;
+    unsigned insertPercent;
+};
+
+constexpr std::array<Workload, 4> WORKLOADS = {{
+    {"read-mostly", 90, 5},
+    {"balanced", 50, 25},
+    {"write-heavy", 10, 45},
+    {"duplicate-ingest", 0, 100},  // receivers re-seeing the same ids, nearly every insert is a duplicate
+}};
+
+enum class Distribution
+{
+    Uniform,
+    Zipf
+};
+
+struct Stream
+{
+    std::vector<Op> ops;
+    std::vector<uint64_t> ids;
+};
+
+struct SuiteOptions
+{
+    size_t maxThreads;
+    std::chrono::milliseconds duration;
+    std::string json;
+};
+
+struct CellResult
+{
+    std::string container;
+    std::string workload;
+    std::string distribution;
+    size_t threads;
+    double opsPerSec;
+    uint64_t p50Ns;
+    uint64_t p99Ns;
+    uint64_t p999Ns;
+};
+
+/// @brief Key of a rank, scrambled (murmur finalizer is a bijection) so hot keys are not neighbours
+uint64_t suite_key(uint64_t rank)
+{
+    return MurmurHash{}(rank + 1);
+}
+
+/// @brief Cumulative Zipf distribution over SUITE_KEYS ranks
+std::vector<double> zipf_cdf()
+{
+    std::vector<double> cdf(SUITE_KEYS);
+    double sum = 0.0;
+    for (size_t rank = 0; rank < SUITE_KEYS; ++rank)
+    {
+        sum += 1.0 / std::pow(static_cast<double>(rank + 1), ZIPF_EXPONENT);
+        cdf[rank] = sum;
+    }
+    for (auto& value : cdf)
+    {
+        value /= sum;
+    }
+    return cdf;
+}
+
+std::vector<Stream> make_streams(const Workload& workload, Distribution distribution, const std::vector<double>& cdf,
+    size_t threads)
+{
+    std::vector<Stream> streams(threads);
+    for (size_t t = 0; t < threads; ++t)
+    {
+        std::mt19937_64 rng(t + 1);
+        std::uniform_int_distribution<unsigned> percent(0, 99);
+        std::uniform_int_distribution<uint64_t> uniform(0, SUITE_KEYS - 1);
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+        auto& stream = streams[t];
+        stream.ops.resize(STREAM_LENGTH);
+        stream.ids.resize(STREAM_LENGTH);
+        for (size_t i = 0; i < STREAM_LENGTH; ++i)
+        {
+            const unsigned p = percent(rng);
+            stream.ops[i] = p < workload.findPercent                              ? Op::Find
+                            : p < workload.findPercent + workload.insertPercent ? Op::Insert
+                                                                                 : Op::Remove;
+
+            uint64_t rank = uniform(rng);
+            if (distribution == Distribution::Zipf)
+            {
+                rank = std::min<uint64_t>(std::upper_bound(cdf.begin(), cdf.end(), unit(rng)) - cdf.begin(), SUITE_KEYS - 1);
+            }
+            stream.ids[i] = suite_key(rank);
+        }
+    }
+    return streams;
+}
+
+/// @brief Run op(thread, i) on `threads` threads for `duration`, one op in LATENCY_SAMPLE is timed
+template <typename Fn>
+void run_threads(size_t threads, std::chrono::milliseconds duration, const Fn& op, CellResult& result)
+{
+    std::atomic<size_t> ready{0};
+    std::atomic<bool> start{false};
+    std::atomic<bool> stop{false};
+    std::vector<LatencyHistogram> histograms(threads);
+    std::vector<uint64_t> counts(threads);
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t)
+    {
+        workers.emplace_back(
+            [&, t]
+            {
+                auto& histogram = histograms[t];
+                ready.fetch_add(1);
+                while (!start.load(std::memory_order_acquire))
+                {
+                    std::this_thread::yield();
+                }
+
+                uint64_t i = 0;
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    for (size_t n = 0; n < 64; ++n, ++i)
+                    {
+                        if (i % LATENCY_SAMPLE == 0)
+                        {
+                            auto begin = Clock::now();
+                            op(t, i);
+                            histogram.add(static_cast<uint64_t>(
+                                std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count()));
+                        }
+                        else
+                        {
+                            op(t, i);
+                        }
+                    }
+                }
+                counts[t] = i;
+            });
+    }
+
+    while (ready.load() < threads)
+    {
+        std::this_thread::yield();
+    }
+
+    auto begin = Clock::now();
+    start.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(duration);
+    stop.store(true, std::memory_order_relaxed);
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+
+    LatencyHistogram total;
+    uint64_t ops = 0;
+    for (size_t t = 0; t < threads; ++t)
+    {
+        total.merge(histograms[t]);
+        ops += counts[t];
+    }
+
+    result.threads = threads;
+    result.opsPerSec = static_cast<double>(ops) / seconds;
+    result.p50Ns = total.percentile(0.5);
+    result.p99Ns = total.percentile(0.99);
+    result.p999Ns = total.percentile(0.999);
+}
+
+void print_cell(const CellResult& result)
+{
+    std::printf("%-26s %-17s %-8s %7zu %10.2f %8" PRIu64 " %8" PRIu64 " %8" PRIu64 "\n", result.container.c_str(),
+        result.workload.c_str(), result.distribution.c_str(), result.threads, result.opsPerSec / 1e6, result.p50Ns,
+        result.p99Ns, result.p999Ns);
+}
+
+class Suite
+{
+    SuiteOptions _options;
+    std::vector<size_t> _threadCounts;
+    std::vector<std::array<std::vector<Stream>, 2>> _streams;  // per workload, uniform and Zipf
+    std::vector<CellResult> _results;
+
+  public:
+    explicit Suite(const SuiteOptions& options)
+        : _options(options)
+    {
+        for (size_t threads = 1; threads < _options.maxThreads; threads *= 2)
+        {
+            _threadCounts.push_back(threads);
+        }
+        _threadCounts.push_back(_options.maxThreads);
+
+        const auto cdf = zipf_cdf();
+        for (const auto& workload : WORKLOADS)
+        {
+            _streams.push_back({make_streams(workload, Distribution::Uniform, cdf, _options.maxThreads),
+                make_streams(workload, Distribution::Zipf, cdf, _options.maxThreads)});
+        }
+
+        std::printf("%-26s %-17s %-8s %7s %10s %8s %8s %8s\n", "container", "workload", "keys", "threads", "Mops/s",
+            "p50 ns", "p99 ns", "p99.9 ns");
+    }
+
+    /// @brief Every workload and distribution over every thread count, then the resize cell
+    template <typename Map> void run(const char* name)
+    {
+        for (size_t w = 0; w < WORKLOADS.size(); ++w)
+        {
+            for (size_t d = 0; d < 2; ++d)
+            {
+                for (size_t threads : _threadCounts)
+                {
+                    const auto& streams = _streams[w][d];
+
+                    Map map;
+                    for (uint64_t rank = 0; rank < SUITE_KEYS; rank += 2)
+                    {
+                        const uint64_t id = suite_key(rank);
+                        map.insert(Message{MESSAGE_SIZE, 0, id, id});
+                    }
+
+                    CellResult result{name, WORKLOADS[w].name, d ? "zipf" : "uniform", 0, 0.0, 0, 0, 0};
+                    run_threads(threads, _options.duration,
+                        [&map, &streams](size_t t, uint64_t i)
+                        {
+                            const size_t at = i & (STREAM_LENGTH - 1);
+                            const uint64_t id = streams[t].ids[at];
+                            switch (streams[t].ops[at])
+                            {
+                            case Op::Find:
+                            {
+                                Message found{};
+                                map.find(id, found);
+                                break;
+                            }
+                            case Op::Insert:
+                                map.insert(Message{MESSAGE_SIZE, 0, id, id});
+                                break;
+                            case Op::Remove:
+                                map.remove(id);
+                                break;
+                            }
+                        },
+                        result);
+                    print_cell(result);
+                    _results.push_back(result);
+                }
+            }
+        }
+
+        // fresh ids into a map at its initial capacity, every cell runs through a chain of resizes
+        if constexpr (!requires(Map& map) { map.rejected(); })
+        {
+            for (size_t threads : _threadCounts)
+            {
+                Map map;
+                CellResult result{name, "resize", "unique", 0, 0.0, 0, 0, 0};
+                run_threads(threads, _options.duration,
+                    [&map](size_t t, uint64_t i)
+                    {
+                        const uint64_t id = (static_cast<uint64_t>(t) + 1) << 40 | i;
+                        map.insert(Message{MESSAGE_SIZE, 0, id, id});
+                    },
+                    result);
+                print_cell(result);
+                _results.push_back(result);
+            }
+        }
+    }
+
+    void writeJson() const
+    {
+        std::ofstream out(_options.json);
+        if (!out)
+        {
+            throw std::runtime_error("Cannot write " + _options.json);
+        }
+
+        out << "{\n  \"keys\": " << SUITE_KEYS << ",\n  \"duration_ms\": " << _options.duration.count()
+            << ",\n  \"latency_sample\": " << LATENCY_SAMPLE << ",\n  \"results\": [\n";
+        for (size_t i = 0; i < _results.size(); ++i)
+        {
+            const auto& result = _results[i];
+            out << "    {\"container\": \"" << result.container << "\", \"workload\": \"" << result.workload
+                << "\", \"keys\": \"" << result.distribution << "\", \"threads\": " << result.threads
+                << ", \"ops_per_sec\": " << static_cast<uint64_t>(result.opsPerSec) << ", \"p50_ns\": " << result.p50Ns
+                << ", \"p99_ns\": " << result.p99Ns << ", \"p999_ns\": " << result.p999Ns << "}"
+                << (i + 1 < _results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+
+        std::printf("\nresults written to %s\n", _options.json.c_str());
+    }
+};
+
+void run_suite(const SuiteOptions& options)
+{
+    Suite suite(options);
+    suite.run<HashMap<INITIAL_CAPACITY>>("HashMap");
+    suite.run<HashMap<INITIAL_CAPACITY, std::allocator<Message>, false, TTASLock>>("HashMap TTASLock");
+    suite.run<FlatHashMap<INITIAL_CAPACITY>>("FlatHashMap");
+    suite.run<ShardedHashMap<16, HashMap<INITIAL_CAPACITY / 16>>>("Sharded<16, HashMap>");
+    suite.run<ShardedHashMap<16, FlatHashMap<INITIAL_CAPACITY / 16>>>("Sharded<16, FlatHashMap>");
+    suite.run<LF_HashMap<Message, INITIAL_CAPACITY>>("LF_HashMap");
+    suite.run<LF_HashMap<Message, INITIAL_CAPACITY, HazardPointerDomain>>("LF_HashMap hazard pointers");
+    suite.run<SharedMemoryHashMap<>>("SharedMemoryHashMap");
+    suite.writeJson();
+}
+
+}  // namespace
+
+/// ContainerBench                 per container tables (single thread, 2 threads, batches, snapshots, log)
+/// ContainerBench --suite [--threads N] [--ms M] [--json FILE]
+///                                thread scaling x op mixes x uniform/Zipf keys, duplicates and resizes, JSON out
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> args(argv + 1, argv + argc);
+    if (!args.empty() && args[0] == "--suite")
+    {
+        SuiteOptions options{std::max<size_t>(std::thread::hardware_concurrency(), 2), std::chrono::milliseconds(200),
+            "container_bench.json"};
+        for (size_t i = 1; i + 1 < args.size(); i += 2)
+        {
+            if (args[i] == "--threads")
+            {
+                options.maxThreads = std::max(std::stoul(args[i + 1]), 1UL);
+            }
+            else if (args[i] == "--ms")
+            {
+                options.duration = std::chrono::milliseconds(std::stoul(args[i + 1]));
+            }
+            else if (args[i] == "--json")
+            {
+                options.json = args[i + 1];
+            }
+            else
+            {
+                std::cerr << "Usage: " << argv[0] << " [--suite [--threads N] [--ms M] [--json FILE]]\n";
+                return 1;
+            }
+        }
+
+        run_suite(options);
+        return 0;
+    }
+
+    const auto messages = generate_messages(NUM_KEYS, 1);
+    const auto misses = generate_messages(NUM_KEYS, 2);
+
+    std::printf("keys: %zu, initial capacity: %zu\n\n", NUM_KEYS, INITIAL_CAPACITY);
+
+    auto chained = run_bench<HashMap<INITIAL_CAPACITY>>(messages, misses);
+
+    print_header();
+    print_row("HashMap", chained, chained);
+    print_row("HashMap +NodePool", chained,
+        run_bench<HashMap<INITIAL_CAPACITY, NodePoolAllocator<Message>>>(messages, misses));
+    print_row("FlatHashMap", chained, run_bench<FlatHashMap<INITIAL_CAPACITY>>(messages, misses));
+    print_row("Sharded<16, HashMap>", chained,
+        run_bench<ShardedHashMap<16, HashMap<INITIAL_CAPACITY / 16>>>(messages, misses));
+    print_row("Sharded<16, FlatHashMap>", chained,
+        run_bench<ShardedHashMap<16, FlatHashMap<INITIAL_CAPACITY / 16>>>(messages, misses));
+    print_row("HashMap +Prefilter", chained, run_bench<PrefilteredMap<HashMap<INITIAL_CAPACITY>>>(messages, misses));
+    print_row("SharedMemoryHashMap", chained, run_bench<SharedMemoryHashMap<>>(messages, misses));
+    print_row("HashMap TTASLock", chained,
+        run_bench<HashMap<INITIAL_CAPACITY, std::allocator<Message>, false, TTASLock>>(messages, misses));
+    print_row("HashMap TicketLock", chained,
+        run_bench<HashMap<INITIAL_CAPACITY, std::allocator<Message>, false, TicketLock>>(messages, misses));
+    print_row("HashMap MCSLock", chained,
+        run_bench<HashMap<INITIAL_CAPACITY, std::allocator<Message>, false, MCSLock>>(messages, misses));
+
+    std::printf("\n%-32s %10s %10s %10s\n", "single owner ns/op", "insert", "find", "remove");
+    bench_single_owner<HashMap<INITIAL_CAPACITY>>("HashMap shared_mutex", messages);
+    bench_single_owner<HashMap<INITIAL_CAPACITY, std::allocator<Message>, false, NoLock>>("HashMap NoLock", messages);
+
+    std::printf("\n%-32s %10s %10s %10s\n", "4x retransmitted ns/insert", "ns/op", "skip", "false pos");
+    {
+        HashMap<INITIAL_CAPACITY> map;
+        std::printf("%-32s %10.1f\n", "HashMap", bench_duplicates<4>(map, messages));
+    }
+    {
+        PrefilteredMap<HashMap<INITIAL_CAPACITY>> map(messages.size());
+        const double ns = bench_duplicates<4>(map, messages);
+        const auto stats = map.prefilterStats();
+        std::printf("%-32s %10.1f %9.1f%% %9.2f%%\n", "HashMap +Prefilter", ns, stats.skipRate() * 100.0,
+            stats.falsePositiveRate() * 100.0);
+    }
+
+    std::printf("\n%-25s %10s %10s %10s %10s\n", "skewed ids ns/op", "insert", "find", "max chain", "skew");
+    bench_hash<MurmurHash>("murmur", messages);
+    bench_hash<WyHash>("wyhash", messages);
+    bench_hash<FibonacciHash>("fibonacci", messages);
+    bench_hash<IdentityHash>("identity", messages);
+
+    std::printf("\n%-24s %6s %10s %10s %9s %10s %10s %9s\n", "ns/op", "batch", "insert", "batched", "speedup",
+        "find", "batched", "speedup");
+    bench_batches<HashMap<INITIAL_CAPACITY>>("HashMap", messages);
+    bench_batches<FlatHashMap<INITIAL_CAPACITY>>("FlatHashMap", messages);
+    bench_batches<ShardedHashMap<16, FlatHashMap<INITIAL_CAPACITY / 16>>>("Sharded<16, FlatHashMap>", messages);
+    bench_batches<LF_HashMap<Message, INITIAL_CAPACITY>>("LF_HashMap", messages);
+
+    std::printf("\n%-24s %3s %3s %10s %10s %9s\n", "queues ns/msg", "P", "C", "single", "batch 32", "speedup");
+    bench_queue<SpscRing<Message, 1024>>("SpscRing", messages, 1, 1);
+    bench_queue<MpscQueue<Message, 1024>>("MpscQueue", messages, 2, 1);
+    bench_queue<MpmcQueue<Message, 1024>>("MpmcQueue", messages, 2, 2);
+
+    std::printf("\n%-32s %10s\n", "HashMap snapshots", "ns/op");
+    bench_snapshot(messages);
+
+    std::printf("\n%-32s %10s\n", "HashMap write-ahead log", "ns/msg");
+    bench_recovery(messages);
+
+    std::printf("\nnodes retired: %zu\n%-32s %10s\n", NUM_RETIRED, "reclamation", "ns/node");
+    bench_epoch_reclamation();
+    bench_hazard_reclamation();
+
+    return 0;
+}
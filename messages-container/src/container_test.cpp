@@ -1,20 +1,37 @@
-// #include "messages-container/lock-free/lock_free_container.hpp"
+#include "messages-container/allocators/node_pool.hpp"
+#include "messages-container/blocking/flat_hash_map.hpp"
 #include "messages-container/blocking/hash_map.hpp"
+#include "messages-container/blocking/shared_memory_hash_map.hpp"
+#include "messages-container/blocking/sharded_hash_map.hpp"
+#include "messages-container/filters/counting_bloom_filter.hpp"
+#include "messages-container/filters/prefiltered_map.hpp"
+#include "messages-container/lock-free/lock_free_container.hpp"
+#include "messages-container/persistence/message_log.hpp"
+#include "messages-container/queues/bounded_queue.hpp"
+#include "messages-container/queues/spsc_ring.hpp"
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <bit>
+#include <bitset>
 #include <cassert>
 #include <chrono>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <random>
 #include <shared_mutex>
+#include <span>
 #include <thread>
 #include <vector>
 
+#include <sys/wait.h>
+#include <unistd.h>
+
 namespace
 {
 
-std::shared_mutex g_mutex;
-
 constexpr size_t NUM_KEYS = 1000;
 constexpr auto TIMEOUT_MS = 1000;
 
@@ -35,7 +52,7 @@ Message generate_random_message(uint64_t id)
     };
 }
 
-int stress_test(HashMap<INITIAL_CAPACITY>& map, std::atomic<bool>& running)
+template <typename Map> int stress_test(Map& map, std::atomic<bool>& running)
 {
     std::vector<Message> local_messages;
     local_messages.reserve(NUM_KEYS);
@@ -43,10 +60,7 @@ int stress_test(HashMap<INITIAL_CAPACITY>& map, std::atomic<bool>& running)
     for (uint64_t i = 0; i < NUM_KEYS; i++)
     {
         auto key = key_dist(rng);
-        {
-            std::unique_lock<std::shared_mutex> lk(g_mutex);
-            local_messages.push_back(generate_random_message(key));
-        }
+        local_messages.push_back(generate_random_message(key));
         map.insert(local_messages.back());
     }
 
@@ -63,10 +77,7 @@ int stress_test(HashMap<INITIAL_CAPACITY>& map, std::atomic<bool>& running)
             auto local_key = key_dist(rng);
             Message msg = generate_random_message(local_key);
             map.insert(msg);
-            {
-                std::unique_lock<std::shared_mutex> lk(g_mutex);
-                local_messages.push_back(msg);
-            }
+            local_messages.push_back(msg);
 
             break;
         }
@@ -79,13 +90,10 @@ int stress_test(HashMap<INITIAL_CAPACITY>& map, std::atomic<bool>& running)
         case 2:
         {  // Remove
             map.remove(key);
+            auto it = std::find(local_messages.begin(), local_messages.end(), message);
+            if (it != local_messages.end())
             {
-                std::unique_lock<std::shared_mutex> lk(g_mutex);
-                auto it = std::find(local_messages.begin(), local_messages.end(), message);
-                if (it != local_messages.end())
-                {
-                    local_messages.erase(it);
-                }
+                local_messages.erase(it);
             }
             break;
         }
@@ -105,7 +113,7 @@ int stress_test(HashMap<INITIAL_CAPACITY>& map, std::atomic<bool>& running)
     return 0;
 }
 
-void concurrent_operations_test(HashMap<INITIAL_CAPACITY>& map, size_t num_threads)
+template <typename Map> void concurrent_operations_test(Map& map, size_t num_threads)
 {
     std::atomic<bool> running(true);
     std::vector<std::thread> threads;
@@ -113,7 +121,7 @@ void concurrent_operations_test(HashMap<INITIAL_CAPACITY>& map, size_t num_threa
 
     for (size_t i = 0; i < num_threads; ++i)
     {
-        threads.emplace_back(stress_test, std::ref(map), std::ref(running));
+        threads.emplace_back(stress_test<Map>, std::ref(map), std::ref(running));
     }
 
     std::this_thread::sleep_for(std::chrono::seconds(10));
@@ -130,7 +138,7 @@ void concurrent_operations_test(HashMap<INITIAL_CAPACITY>& map, size_t num_threa
     assert(map.size() == 0);  // All keys should be removed
 }
 
-void basic_concurrent_test(HashMap<INITIAL_CAPACITY>& map, size_t num_threads)
+template <typename Map> void basic_concurrent_test(Map& map, size_t num_threads)
 {
     std::vector<std::thread> threads;
     std::vector<uint64_t> keys;
@@ -201,6 +209,864 @@ void basic_concurrent_test(HashMap<INITIAL_CAPACITY>& map, size_t num_threads)
     assert(map.size() == 0);
 }
 
+/// @brief Every writer inserts its own keys in batches, half of each batch repeats keys already inserted
+template <typename Map> void batch_test(Map& map, size_t num_threads)
+{
+    constexpr size_t BATCH = 32;
+    constexpr size_t BATCHES = 64;
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < num_threads; ++t)
+    {
+        threads.emplace_back(
+            [&map, t, num_threads]
+            {
+                std::array<Message, BATCH> batch;
+                std::array<uint64_t, BATCH> ids;
+                std::array<Message, BATCH> results;
+                std::bitset<BATCH> bits;
+
+                for (size_t b = 0; b < BATCHES; ++b)
+                {
+                    for (size_t i = 0; i < BATCH; ++i)
+                    {
+                        // odd slots repeat the previous slot, the second copy must be rejected
+                        uint64_t id = ((b * BATCH + (i & ~size_t{1})) * num_threads + t) * 2 + 1;
+                        batch[i] = generate_random_message(id);
+                        ids[i] = id;
+                    }
+
+                    [[maybe_unused]] size_t inserted = map.insertBatch(std::span<const Message>(batch), bits);
+                    assert(inserted == BATCH / 2);
+                    for (size_t i = 0; i < BATCH; ++i)
+                    {
+                        assert(bits[i] == (i % 2 == 0));
+                    }
+
+                    // even ids were never inserted
+                    ids[BATCH - 1] = ids[0] + 1;
+
+                    [[maybe_unused]] size_t found = map.findBatch(std::span<const uint64_t>(ids), std::span<Message>(results), bits);
+                    assert(found == BATCH - 1);
+                    assert(!bits[BATCH - 1]);
+                    for (size_t i = 0; i + 1 < BATCH; ++i)
+                    {
+                        assert(bits[i] && results[i] == batch[i & ~size_t{1}]);
+                    }
+                }
+
+                for (size_t b = 0; b < BATCHES; ++b)
+                {
+                    for (size_t i = 0; i < BATCH; i += 2)
+                    {
+                        [[maybe_unused]] bool removed = map.remove(((b * BATCH + i) * num_threads + t) * 2 + 1);
+                        assert(removed);
+                    }
+                }
+            });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    std::cout << "Current Map Size: " << map.size() << "\n";
+    assert(map.size() == 0);
+}
+
+/// @brief Writers stream unique keys through a map capped at MAX_ENTRIES, one hot key is looked up
+/// all the time and must survive CLOCK; then a short TTL must hide and drop everything
+void bounded_test(size_t num_threads)
+{
+    constexpr size_t MAX_ENTRIES = 1000;
+    constexpr size_t KEYS_PER_THREAD = 20000;
+    constexpr uint64_t HOT_KEY = 0;
+
+    {
+        HashMap<INITIAL_CAPACITY> map(HashMapLimits{MAX_ENTRIES, {}});
+        map.insert(generate_random_message(HOT_KEY));
+
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < num_threads; ++t)
+        {
+            threads.emplace_back(
+                [&map, t, num_threads]
+                {
+                    Message found_msg;
+                    for (uint64_t i = 0; i < KEYS_PER_THREAD; ++i)
+                    {
+                        map.insert(generate_random_message((i * num_threads + t) + 1));
+                        [[maybe_unused]] bool found = map.find(HOT_KEY, found_msg);
+                        assert(found);
+                    }
+                });
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        std::cout << "Size: " << map.size() << " capacity: " << map.capacity() << " evictions: " << map.evictions()
+                  << "\n";
+        assert(map.size() <= MAX_ENTRIES + num_threads);
+        assert(map.evictions() + map.size() == num_threads * KEYS_PER_THREAD + 1);
+        assert(map.capacity() == std::bit_ceil(static_cast<size_t>(MAX_ENTRIES / 0.75) + 1));
+    }
+
+    {
+        HashMap<INITIAL_CAPACITY> map(HashMapLimits{0, std::chrono::milliseconds(50)});
+        for (uint64_t i = 0; i < NUM_KEYS; ++i)
+        {
+            map.insert(generate_random_message(i));
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        Message found_msg;
+        [[maybe_unused]] bool found = map.find(1, found_msg);
+        assert(!found);
+
+        // an expired key can be inserted again, the sweep drops the rest at the insert rate
+        [[maybe_unused]] bool inserted = map.insert(generate_random_message(1));
+        assert(inserted);
+        for (uint64_t i = NUM_KEYS; map.expirations() < NUM_KEYS; ++i)
+        {
+            map.insert(generate_random_message(i));
+        }
+
+        std::cout << "Expirations: " << map.expirations() << "\n";
+        found = map.find(1, found_msg);
+        assert(found);
+    }
+}
+
+/// @brief Per-type counts, scans and concurrent drains of the MessageType index
+void type_index_test(size_t num_threads)
+{
+    using IndexedMap = HashMap<INITIAL_CAPACITY, std::allocator<Message>, true>;
+    constexpr size_t KEYS_PER_THREAD = 4096;
+
+    IndexedMap map;
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < num_threads; ++t)
+    {
+        threads.emplace_back(
+            [&map, t, num_threads]
+            {
+                for (uint64_t i = 0; i < KEYS_PER_THREAD; ++i)
+                {
+                    Message message = generate_random_message(i * num_threads + t);
+                    message.MessageType = static_cast<uint8_t>(message.MessageId % 256);
+                    map.insert(message);
+
+                    // every other key is removed again, the index must follow
+                    if (i % 2)
+                    {
+                        map.remove(message.MessageId);
+                    }
+                }
+            });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    size_t total = 0;
+    for (unsigned type = 0; type < 256; ++type)
+    {
+        size_t visited = 0;
+        map.forEachOfType(static_cast<uint8_t>(type),
+            [&]([[maybe_unused]] const Message& message)
+            {
+                assert(message.MessageType == type);
+                ++visited;
+            });
+        assert(visited == map.countType(static_cast<uint8_t>(type)));
+        total += visited;
+    }
+    assert(total == map.size());
+
+    size_t inRange = 0;
+    map.forEachInTypeRange(16, 31, [&](const Message&) { ++inRange; });
+    size_t expected = 0;
+    for (unsigned type = 16; type <= 31; ++type)
+    {
+        expected += map.countType(static_cast<uint8_t>(type));
+    }
+    assert(inRange == expected);
+
+    // two drainers race for the same types, every message is handed out once
+    std::vector<Message> drained[2];
+    std::thread drainers[2];
+    for (size_t d = 0; d < 2; ++d)
+    {
+        drainers[d] = std::thread(
+            [&map, &drained, d]
+            {
+                for (unsigned type = 0; type < 256; ++type)
+                {
+                    map.drainType(static_cast<uint8_t>(type), drained[d]);
+                }
+            });
+    }
+    for (auto& drainer : drainers)
+    {
+        drainer.join();
+    }
+
+    std::cout << "Drained: " << drained[0].size() << " + " << drained[1].size() << " of " << total << "\n";
+    assert(drained[0].size() + drained[1].size() == total);
+    assert(map.size() == 0);
+}
+
+/// @brief Snapshots taken while writers remove old keys and insert new ones (through several resizes)
+/// hold exactly the entries stored when they were taken
+void snapshot_test(size_t num_threads)
+{
+    constexpr size_t KEYS_PER_THREAD = 4096;
+    constexpr size_t NUM_SNAPSHOTS = 32;
+
+    HashMap<64> map;
+    for (uint64_t i = 0; i < NUM_KEYS; ++i)
+    {
+        map.insert(generate_random_message(i));
+    }
+
+    auto first = map.snapshot();
+    assert(first.size() == NUM_KEYS);
+
+    std::atomic<bool> running{true};
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < num_threads; ++t)
+    {
+        threads.emplace_back(
+            [&map, t, num_threads]
+            {
+                for (uint64_t i = t; i < NUM_KEYS; i += num_threads)
+                {
+                    map.remove(i);
+                }
+                for (uint64_t i = 0; i < KEYS_PER_THREAD; ++i)
+                {
+                    map.insert(generate_random_message(NUM_KEYS + i * num_threads + t));
+                }
+            });
+    }
+
+    std::thread reader(
+        [&map, &running]
+        {
+            for (size_t n = 0; n < NUM_SNAPSHOTS || running.load(); ++n)
+            {
+                auto snapshot = map.snapshot();
+                std::vector<uint64_t> ids;
+                snapshot.forEach([&ids](const Message& message) { ids.push_back(message.MessageId); });
+
+                std::sort(ids.begin(), ids.end());
+                [[maybe_unused]] bool unique = std::adjacent_find(ids.begin(), ids.end()) == ids.end();
+                assert(unique);
+                assert(ids.size() == snapshot.size());
+            }
+        });
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    running.store(false);
+    reader.join();
+
+    std::vector<uint64_t> ids;
+    first.forEach([&ids](const Message& message) { ids.push_back(message.MessageId); });
+    std::sort(ids.begin(), ids.end());
+
+    std::cout << "Snapshot: " << ids.size() << " map: " << map.size() << " capacity: " << map.capacity() << "\n";
+    assert(ids.size() == NUM_KEYS);
+    for (uint64_t i = 0; i < NUM_KEYS; ++i)
+    {
+        assert(ids[i] == i);
+    }
+    assert(map.snapshot().size() == num_threads * KEYS_PER_THREAD);
+}
+
+/// @brief Log inserts and removes across several segments and a checkpoint, then recover into a fresh map,
+/// again with torn records at the end of the log and of an older segment
+void message_log_test(size_t num_threads)
+{
+    using LoggedMap = HashMap<64>;
+    constexpr size_t KEYS_PER_THREAD = 2048;
+
+    const auto directory = std::filesystem::temp_directory_path() / "container_test_log";
+    std::filesystem::remove_all(directory);
+
+    MessageLogOptions options;
+    options.directory = directory;
+    options.segmentBytes = 4096;
+    options.checkpointSegments = 8;
+
+    std::vector<Message> expected;
+    {
+        LoggedMap map;
+        MessageLog<LoggedMap> log(map, options);
+        [[maybe_unused]] size_t recovered = log.recover();
+        assert(recovered == 0);
+
+        auto write = [&](uint64_t base)
+        {
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < num_threads; ++t)
+            {
+                threads.emplace_back(
+                    [&log, t, num_threads, base]
+                    {
+                        for (uint64_t i = 0; i < KEYS_PER_THREAD; ++i)
+                        {
+                            uint64_t id = base + i * num_threads + t;
+                            log.insert(generate_random_message(id));
+                            if (id % 3 == 0)
+                            {
+                                log.remove(id);
+                            }
+                        }
+                    });
+            }
+
+            for (auto& thread : threads)
+            {
+                thread.join();
+            }
+        };
+
+        write(0);
+        log.checkpoint();
+        write(num_threads * KEYS_PER_THREAD);
+        log.flush();
+
+        map.snapshot().forEach([&expected](const Message& message) { expected.push_back(message); });
+        std::cout << "Logged: " << map.size() << " checkpoints: " << log.checkpoints() << "\n";
+    }
+
+    auto verify = [&]
+    {
+        LoggedMap map;
+        MessageLog<LoggedMap> log(map, options);
+        size_t recovered = log.recover();
+
+        std::cout << "Recovered: " << recovered << " capacity: " << map.capacity() << "\n";
+        assert(recovered == expected.size());
+        for (const auto& message : expected)
+        {
+            Message found_msg;
+            [[maybe_unused]] bool found = map.find(message.MessageId, found_msg);
+            assert(found && found_msg.MessageData == message.MessageData);
+        }
+    };
+
+    verify();
+
+    std::vector<std::filesystem::path> segments;
+    for (const auto& entry : std::filesystem::directory_iterator(directory))
+    {
+        if (entry.path().extension() == ".log")
+        {
+            segments.push_back(entry.path());
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+    std::ofstream(segments.back(), std::ios::binary | std::ios::app) << "torn";
+
+    // a failed write leaves its segment torn and the writer goes on in the next one, which is still replayed
+    assert(segments.size() > 1);
+    std::ofstream(segments.front(), std::ios::binary | std::ios::app) << "torn";
+
+    verify();
+    std::filesystem::remove_all(directory);
+}
+
+/// @brief One producer, one consumer, single and batched calls mixed: every value arrives once and in order
+void spsc_test()
+{
+    constexpr uint64_t COUNT = 100000;
+
+    SpscRing<uint64_t, 64> ring;
+    std::thread producer(
+        [&ring]
+        {
+            std::array<uint64_t, 7> batch;
+            for (uint64_t next = 0; next < COUNT;)
+            {
+                size_t pushed = 0;
+                if (next % 3 == 0)
+                {
+                    pushed = ring.push(next);
+                }
+                else
+                {
+                    const size_t count = std::min<uint64_t>(batch.size(), COUNT - next);
+                    for (size_t i = 0; i < count; ++i)
+                    {
+                        batch[i] = next + i;
+                    }
+                    pushed = ring.push_n(std::span<const uint64_t>(batch.data(), count));
+                }
+
+                next += pushed;
+                if (!pushed)
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+
+    bool ordered = true;
+    std::array<uint64_t, 5> batch;
+    for (uint64_t expected = 0; expected < COUNT;)
+    {
+        size_t popped = expected % 2 ? ring.pop(batch[0]) : ring.pop_n(std::span<uint64_t>(batch));
+        for (size_t i = 0; i < popped; ++i)
+        {
+            ordered &= batch[i] == expected++;
+        }
+        if (!popped)
+        {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+
+    assert(ordered);
+    assert(ring.empty());
+}
+
+/// @brief Values of every producer are consumed exactly once, each consumer sees a producer's values in order
+template <typename Queue> void bounded_queue_test(size_t producers, size_t consumers)
+{
+    constexpr uint64_t COUNT = 50000;
+
+    Queue queue;
+    std::vector<std::atomic<uint8_t>> seen(producers * COUNT);
+    std::atomic<size_t> consumed{0};
+    std::atomic<bool> ordered{true};
+
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < producers; ++p)
+    {
+        threads.emplace_back(
+            [&queue, p]
+            {
+                std::array<uint64_t, 6> batch;
+                for (uint64_t next = 0; next < COUNT;)
+                {
+                    size_t pushed = 0;
+                    if (next % 2)
+                    {
+                        pushed = queue.push(p << 32 | next);
+                    }
+                    else
+                    {
+                        const size_t count = std::min<uint64_t>(batch.size(), COUNT - next);
+                        for (size_t i = 0; i < count; ++i)
+                        {
+                            batch[i] = p << 32 | (next + i);
+                        }
+                        pushed = queue.push_n(std::span<const uint64_t>(batch.data(), count));
+                    }
+
+                    next += pushed;
+                    if (!pushed)
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+    }
+
+    for (size_t c = 0; c < consumers; ++c)
+    {
+        threads.emplace_back(
+            [&, producers]
+            {
+                std::vector<int64_t> last(producers, -1);
+                std::array<uint64_t, 4> batch;
+                for (size_t round = 0; consumed.load() < producers * COUNT; ++round)
+                {
+                    size_t popped = round % 2 ? queue.pop(batch[0]) : queue.pop_n(std::span<uint64_t>(batch));
+                    for (size_t i = 0; i < popped; ++i)
+                    {
+                        const uint64_t producer = batch[i] >> 32;
+                        const auto sequence = static_cast<int64_t>(batch[i] & 0xffffffff);
+                        if (sequence <= last[producer])
+                        {
+                            ordered = false;
+                        }
+                        last[producer] = sequence;
+                        seen[producer * COUNT + static_cast<uint64_t>(sequence)].fetch_add(1);
+                    }
+
+                    consumed.fetch_add(popped);
+                    if (!popped)
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    assert(ordered.load());
+    assert(consumed.load() == producers * COUNT);
+    assert(std::all_of(seen.begin(), seen.end(), [](const auto& count) { return count.load() == 1; }));
+    assert(queue.empty());
+}
+
+/// @brief Ids that differ only in their high bits (sender in the low byte) land in a few buckets with the
+/// identity hash, chainStats has to show that skew and the mixing policies have to remove it
+template <typename Map> ChainStats skewed_keys_stats()
+{
+    constexpr uint64_t SENDER = 7;
+
+    Map map;
+    for (uint64_t i = 0; i < NUM_KEYS; ++i)
+    {
+        map.insert(generate_random_message(i << 8 | SENDER));
+    }
+
+    Message found{};
+    size_t hits = 0;
+    for (uint64_t i = 0; i < NUM_KEYS; ++i)
+    {
+        hits += map.find(i << 8 | SENDER, found);
+    }
+    assert(hits == NUM_KEYS);
+
+    auto stats = map.chainStats();
+    assert(stats.entries == NUM_KEYS);
+    assert(stats.buckets == map.capacity());
+    return stats;
+}
+
+template <typename Hash> void hash_policy_test(const char* name)
+{
+    auto chained = skewed_keys_stats<HashMap<64, std::allocator<Message>, false, std::shared_mutex, Hash>>();
+    auto lockFree = skewed_keys_stats<LF_HashMap<Message, 64, EpochManager, std::allocator<Message>, Hash>>();
+
+    std::cout << name << " HashMap " << chained << name << " LF_HashMap " << lockFree;
+    if constexpr (std::is_same_v<Hash, IdentityHash>)
+    {
+        assert(chained.skew() > 10.0 && lockFree.skew() > 10.0);
+    }
+    else
+    {
+        assert(chained.skew() < 1.5 && lockFree.skew() < 1.5);
+    }
+}
+
+/// @brief HashMap capped at a tenth of NUM_KEYS, PrefilteredMap default constructs the map it wraps
+struct SmallBoundedMap : HashMap<64>
+{
+    SmallBoundedMap()
+        : HashMap(HashMapLimits{NUM_KEYS / 10})
+    {
+    }
+};
+
+/// @brief The filter never loses a present key, removes bring the counters back, retransmitted messages
+/// are answered as duplicates by the prefilter and unknown ids mostly skip the map; entries a bounded map
+/// evicts give their counters back too
+void prefilter_test()
+{
+    CountingBloomFilter<> filter(NUM_KEYS);
+    for (uint64_t i = 0; i < NUM_KEYS; ++i)
+    {
+        filter.add(i);
+    }
+    for (uint64_t i = 0; i < NUM_KEYS; ++i)
+    {
+        assert(filter.mayContain(i));
+    }
+    for (uint64_t i = 0; i < NUM_KEYS; i += 2)
+    {
+        filter.remove(i);
+    }
+    size_t falsePositives = 0;
+    for (uint64_t i = 0; i < NUM_KEYS; ++i)
+    {
+        assert(i % 2 == 0 || filter.mayContain(i));
+        falsePositives += i % 2 == 0 && filter.mayContain(i);
+    }
+    assert(falsePositives < NUM_KEYS / 20);
+
+    PrefilteredMap<HashMap<64>> map(NUM_KEYS);
+    for (uint64_t i = 0; i < NUM_KEYS; ++i)
+    {
+        [[maybe_unused]] const bool inserted = map.insert(generate_random_message(i));
+        assert(inserted);
+    }
+    for (uint64_t i = 0; i < NUM_KEYS; ++i)
+    {
+        [[maybe_unused]] const bool inserted = map.insert(generate_random_message(i));
+        assert(!inserted);
+    }
+    auto stats = map.prefilterStats();
+    assert(stats.duplicates == NUM_KEYS);
+
+    for (uint64_t i = 0; i < NUM_KEYS; i += 2)
+    {
+        [[maybe_unused]] const bool removed = map.remove(i);
+        assert(removed);
+    }
+
+    Message found{};
+    size_t hits = 0;
+    for (uint64_t i = 0; i < 2 * NUM_KEYS; ++i)
+    {
+        hits += map.find(i, found);
+    }
+    assert(hits == NUM_KEYS / 2);
+    assert(map.size() == NUM_KEYS / 2);
+
+    // removed ids are new again
+    [[maybe_unused]] const bool reinserted = map.insert(generate_random_message(0));
+    assert(reinserted);
+
+    stats = map.prefilterStats();
+    std::cout << stats;
+    assert(stats.queries == 4 * NUM_KEYS + 1);
+    assert(stats.negatives > NUM_KEYS);
+
+    // every id streamed through the bounded map but the last few hundred was evicted
+    PrefilteredMap<SmallBoundedMap> bounded(NUM_KEYS / 10);
+    for (uint64_t i = 0; i < 10 * NUM_KEYS; ++i)
+    {
+        bounded.insert(generate_random_message(i));
+    }
+    assert(bounded.size() <= NUM_KEYS / 10 + 1);
+
+    const auto before = bounded.prefilterStats();
+    for (uint64_t i = 0; i < 9 * NUM_KEYS; ++i)
+    {
+        bounded.find(i, found);
+    }
+    const uint64_t evictedNegatives = bounded.prefilterStats().negatives - before.negatives;
+    std::cout << "evicted ids answered by the filter alone: " << evictedNegatives << " of " << 9 * NUM_KEYS << "\n";
+    assert(evictedNegatives > 9 * NUM_KEYS * 9 / 10);
+}
+
+/// @brief A NoLock map owned by one thread still resizes and removes like the locked ones
+void no_lock_test()
+{
+    HashMap<64, std::allocator<Message>, false, NoLock> map;
+    for (uint64_t i = 0; i < NUM_KEYS; ++i)
+    {
+        map.insert(generate_random_message(i));
+    }
+    [[maybe_unused]] const bool duplicate = map.insert(generate_random_message(0));
+    assert(!duplicate);
+    assert(map.size() == NUM_KEYS);
+
+    for (uint64_t i = 0; i < NUM_KEYS; i += 2)
+    {
+        map.remove(i);
+    }
+
+    Message found{};
+    size_t hits = 0;
+    for (uint64_t i = 0; i < NUM_KEYS; ++i)
+    {
+        hits += map.find(i, found);
+    }
+    assert(hits == NUM_KEYS / 2);
+    assert(map.size() == NUM_KEYS / 2);
+}
+
+/// @brief With every thread slot taken a new thread still inserts (through resizes), finds and removes,
+/// its lookups take the stripe locks and its removed entries go to the orphan list
+void thread_limit_test()
+{
+    HashMap<64> map;
+    for (uint64_t i = 0; i < NUM_KEYS; ++i)
+    {
+        map.insert(generate_random_message(i));
+    }
+
+    auto& registry = reclamation_details::ThreadRegistry::instance();
+    std::vector<size_t> taken;
+    for (size_t slot = registry.tryAcquire(); slot != reclamation_details::NO_SLOT; slot = registry.tryAcquire())
+    {
+        taken.push_back(slot);
+    }
+
+    std::thread slotless(
+        [&]
+        {
+            for (uint64_t i = NUM_KEYS; i < 2 * NUM_KEYS; ++i)
+            {
+                map.insert(generate_random_message(i));
+            }
+
+            Message found{};
+            [[maybe_unused]] size_t hits = 0;
+            for (uint64_t i = 0; i < 2 * NUM_KEYS; ++i)
+            {
+                hits += map.find(i, found);
+            }
+            assert(hits == 2 * NUM_KEYS);
+
+            std::array<uint64_t, 8> ids{0, 1, 2, 3, 4, 5, 6, 2 * NUM_KEYS};
+            std::array<Message, 8> results{};
+            std::bitset<8> bits;
+            [[maybe_unused]] const size_t batchHits =
+                map.findBatch(std::span<const uint64_t>(ids), std::span<Message>(results), bits);
+            assert(batchHits == 7 && !bits[7]);
+
+            for (uint64_t i = 0; i < 2 * NUM_KEYS; i += 2)
+            {
+                map.remove(i);
+            }
+        });
+    slotless.join();
+
+    for (size_t slot : taken)
+    {
+        registry.release(slot);
+    }
+
+    Message found{};
+    [[maybe_unused]] size_t hits = 0;
+    for (uint64_t i = 0; i < 2 * NUM_KEYS; ++i)
+    {
+        hits += map.find(i, found);
+    }
+    assert(hits == NUM_KEYS);
+    assert(map.size() == NUM_KEYS);
+}
+
+#if defined(MESSAGES_CONTAINER_LOCK_STATS)
+/// @brief Concurrent inserts through a few resizes are counted under all three lock classes
+void lock_stats_test(size_t num_threads)
+{
+    auto& stats = LockStats::instance();
+    const uint64_t global = stats.acquisitions(LockClass::Global);
+    const uint64_t bucket = stats.acquisitions(LockClass::Bucket);
+    const uint64_t rehash = stats.acquisitions(LockClass::Rehash);
+
+    HashMap<64> map;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < num_threads; ++t)
+    {
+        threads.emplace_back(
+            [&map, t, num_threads]
+            {
+                for (uint64_t i = t; i < NUM_KEYS; i += num_threads)
+                {
+                    map.insert(generate_random_message(i));
+                }
+            });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    assert(map.size() == NUM_KEYS);
+    assert(stats.acquisitions(LockClass::Global) >= global + NUM_KEYS);
+    assert(stats.acquisitions(LockClass::Bucket) >= bucket + NUM_KEYS);
+    assert(stats.acquisitions(LockClass::Rehash) > rehash);
+    assert(stats.contended(LockClass::Bucket) <= stats.acquisitions(LockClass::Bucket));
+
+    stats.dump(std::cout);
+}
+#endif
+
+/// @brief A forked process inserts through its own mapping of a named region while this one inserts too,
+/// then the region is reattached after every mapping is gone
+void shared_memory_test()
+{
+    using SharedMap = SharedMemoryHashMap<>;
+    const std::string name = "/container_test_shm";
+    constexpr uint64_t KEYS = 20000;
+
+    SharedMap::unlink(name);
+    {
+        SharedMap map(name, 4 * KEYS);
+
+        std::cout.flush();  // the child must not repeat buffered output
+        pid_t child = fork();
+        if (child == 0)
+        {
+            SharedMap attached(name);
+            for (uint64_t i = 1; i < KEYS; i += 2)
+            {
+                if (!attached.insert(generate_random_message(i)))
+                {
+                    _exit(1);
+                }
+            }
+            _exit(0);
+        }
+
+        for (uint64_t i = 0; i < KEYS; i += 2)
+        {
+            map.insert(generate_random_message(i));
+        }
+
+        int status = 0;
+        waitpid(child, &status, 0);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        assert(map.size() == KEYS);
+
+        for (uint64_t i = 0; i < KEYS; i += 3)
+        {
+            map.remove(i);
+        }
+    }
+
+    SharedMap reattached(name);
+    std::cout << "Reattached: " << reattached.size() << " capacity: " << reattached.capacity() << "\n";
+    assert(reattached.capacity() == 4 * KEYS);
+    for (uint64_t i = 0; i < KEYS; ++i)
+    {
+        Message found_msg;
+        [[maybe_unused]] bool found = reattached.find(i, found_msg);
+        assert(found == (i % 3 != 0));
+    }
+    SharedMap::unlink(name);
+
+    // full: every node in use, freed nodes are reused
+    SharedMap small(16);
+    for (uint64_t i = 0; i < 32; ++i)
+    {
+        small.insert(generate_random_message(i));
+    }
+    assert(small.size() == 16 && small.rejected() == 16);
+    small.remove(0);
+    [[maybe_unused]] bool inserted = small.insert(generate_random_message(100));
+    assert(inserted);
+}
+
+template <typename Map> void run_tests(const char* name, size_t num_threads)
+{
+    Map map;
+
+    std::cout << "\n[" << name << "] Running batch test...\n";
+    batch_test(map, num_threads);
+
+    std::cout << "\n[" << name << "] Running basic concurrency test...\n";
+    basic_concurrent_test(map, num_threads);
+
+    std::cout << "\n[" << name << "] Running stress test...\n";
+    concurrent_operations_test(map, num_threads);
+}
+
 }  // namespace
 
 int main()
@@ -210,15 +1076,61 @@ int main()
     {
         num_threads = 4;
     }
+    // basic test checks keys[3], it needs at least 4 writers
+    num_threads = std::max<size_t>(num_threads, 4);
     std::cout << "Running tests with " << num_threads << " threads\n";
 
-    HashMap<INITIAL_CAPACITY> map;
+    run_tests<HashMap<INITIAL_CAPACITY>>("HashMap", num_threads);
+    run_tests<HashMap<INITIAL_CAPACITY, NodePoolAllocator<Message>>>("HashMap node pool", num_threads);
+    run_tests<HashMap<INITIAL_CAPACITY, std::allocator<Message>, false, TTASLock>>("HashMap TTASLock", num_threads);
+    run_tests<HashMap<INITIAL_CAPACITY, std::allocator<Message>, false, TicketLock>>("HashMap TicketLock", num_threads);
+    run_tests<HashMap<INITIAL_CAPACITY, std::allocator<Message>, false, MCSLock>>("HashMap MCSLock", num_threads);
+    std::cout << "\n[HashMap NoLock] Running single owner test...\n";
+    no_lock_test();
+    std::cout << "\n[HashMap thread limit] Running test without a free thread slot...\n";
+    thread_limit_test();
+    run_tests<PrefilteredMap<HashMap<INITIAL_CAPACITY>>>("HashMap prefilter", num_threads);
+    std::cout << "\n[HashMap prefilter] Running duplicate prefilter test...\n";
+    prefilter_test();
+    run_tests<FlatHashMap<INITIAL_CAPACITY>>("FlatHashMap", num_threads);
+    run_tests<ShardedHashMap<16, HashMap<INITIAL_CAPACITY / 16>>>("ShardedHashMap", num_threads);
+    run_tests<ShardedHashMap<16, FlatHashMap<INITIAL_CAPACITY / 16>>>("ShardedHashMap flat", num_threads);
+    run_tests<SharedMemoryHashMap<>>("SharedMemoryHashMap", num_threads);
+    std::cout << "\n[SharedMemoryHashMap] Running multi-process test...\n";
+    shared_memory_test();
+    run_tests<HashMap<INITIAL_CAPACITY, std::allocator<Message>, true>>("HashMap type index", num_threads);
+    std::cout << "\n[HashMap type index] Running per-type scan test...\n";
+    type_index_test(num_threads);
 
-    std::cout << "Running basic concurrency test...\n";
-    basic_concurrent_test(map, num_threads);
+#if defined(MESSAGES_CONTAINER_LOCK_STATS)
+    std::cout << "\n[HashMap lock stats] Running lock profiling test...\n";
+    lock_stats_test(num_threads);
+#endif
 
-    std::cout << "\n\nRunning stress test...\n";
-    concurrent_operations_test(map, num_threads);
+    std::cout << "\n[Hash policies] Running skewed key test...\n";
+    hash_policy_test<IdentityHash>("identity");
+    hash_policy_test<MurmurHash>("murmur");
+    hash_policy_test<WyHash>("wyhash");
+    hash_policy_test<FibonacciHash>("fibonacci");
+
+    std::cout << "\n[Queues] Running SPSC ring, MPSC and MPMC queue tests...\n";
+    spsc_test();
+    bounded_queue_test<MpscQueue<uint64_t, 64>>(3, 1);
+    bounded_queue_test<MpmcQueue<uint64_t, 64>>(2, 2);
+
+    std::cout << "\n[HashMap bounded] Running eviction and expiry test...\n";
+    bounded_test(num_threads);
+
+    std::cout << "\n[HashMap snapshot] Running point-in-time iteration test...\n";
+    snapshot_test(num_threads);
+
+    std::cout << "\n[HashMap log] Running write-ahead log recovery test...\n";
+    message_log_test(num_threads);
+
+    run_tests<LF_HashMap<Message, INITIAL_CAPACITY>>("LF_HashMap", num_threads);
+    run_tests<LF_HashMap<Message, INITIAL_CAPACITY, HazardPointerDomain>>("LF_HashMap hazard pointers", num_threads);
+    run_tests<LF_HashMap<Message, INITIAL_CAPACITY, EpochManager, NodePoolAllocator<Message>>>("LF_HashMap node pool", num_threads);
+    run_tests<PrefilteredMap<LF_HashMap<Message, INITIAL_CAPACITY>>>("LF_HashMap prefilter", num_threads);
 
     std::cout << "All tests passed!\n";
 
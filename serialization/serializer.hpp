@@ -3,7 +3,7 @@
 #include <message.hpp>
 
 void serializeMessage(const Message& msg, char* buffer);
-void deserializeMessage(const char* buffer, const Message& msg);
+void deserializeMessage(const char* buffer, Message& msg);
 
 int sendMessage(int sockfd, const Message& msg);
 int receiveMessage(int sockfd, Message& msg);
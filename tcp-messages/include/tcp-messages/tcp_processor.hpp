@@ -2,6 +2,8 @@
 
 #include <sys/epoll.h>
 #include <atomic>
+#include <unordered_map>
+#include <vector>
 
 
 class TcpServer
@@ -17,10 +19,12 @@ class TcpServer
     int _port;
     int _clientFds[FD_SETSIZE];
     int _clientCount;
+    std::unordered_map<int, std::vector<char>> _pending;  // bytes of a message not complete yet, per client
 
 
     bool setupServer();
     void handleConnections();
+    bool drainClient(int fd);
     static int makeNonBlocking(int fd);
     void closeClients();
 };
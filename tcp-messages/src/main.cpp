@@ -1,5 +1,6 @@
 #include "tcp-messages/tcp_processor.hpp"
 
+#include <common/async_log.hpp>
 #include <common/signal_handler.hpp>
 
 #include <iostream>
@@ -15,6 +16,9 @@ int main(int argc, char* argv[])
 
     setupSignalHandler();
 
+    // messages with Data=10 are traced here when built with COMMON_LOG_LEVEL=trace
+    AsyncLogger::instance().traceTo("tcp_messages.log");
+
     uint16_t port = static_cast<uint16_t>(std::atoi(argv[1]));
     TcpServer server(port);
 
@@ -1,25 +1,29 @@
 #include "tcp-messages/tcp_processor.hpp"
 #include <message.hpp>
 #include <serializer.hpp>
+#include <common/async_log.hpp>
 #include <common/signal_handler.hpp>
 
 #include <arpa/inet.h>
+#include <array>
+#include <cerrno>
+#include <cstddef>
 #include <fcntl.h>
 #include <iostream>
 #include <signal.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <unistd.h>
-#include <mutex>
-#include <fstream>
 
 
 namespace
 {
 
-std::mutex file_mutex;
 constexpr int MAX_EVENTS = 16;
 
+constexpr LogFormat RECEIVED{LogLevel::Debug, LogSink::Console, "Received TCP message: Type={}, Id={}, Data={}"};
+constexpr LogFormat FORWARDED{LogLevel::Trace, LogSink::TraceFile, "Size: {} Type: {} ID: {} Data: {}"};
+
 }  // namespace
 
 TcpServer::TcpServer(int port)
@@ -121,40 +125,19 @@ void TcpServer::run()
                     _clientFds[_clientCount++] = clientFd;
                 }
             }
-            else
+            else if (!drainClient(fd))
             {
-                Message receivedMessage;
-                ssize_t bytesRead = receiveMessage(fd, receivedMessage);
-                if (bytesRead == sizeof(receivedMessage))
+                // Client disconnected
+                std::cout << "Client disconnected: " << fd << std::endl;
+                close(fd);
+                epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+                _pending.erase(fd);
+                for (int j = 0; j < _clientCount; ++j)
                 {
-                    std::cout << "Received TCP message: Type=" << (int)receivedMessage.MessageType
-                              << ", Id=" << receivedMessage.MessageId << ", Data=" << receivedMessage.MessageData
-                              << std::endl;
-
-                              /*
-                    if (receivedMessage.MessageData == 10)
+                    if (_clientFds[j] == fd)
                     {
-                        std::unique_lock<std::mutex> lk(file_mutex);
-                        std::ofstream log_file("tcp_messaages.log", std::ios::app);
-                        log_file << "Size: " << receivedMessage.MessageSize << " Type: " << receivedMessage.MessageType
-                                 << " ID: " << receivedMessage.MessageId << " Data: " << receivedMessage.MessageData
-                                 << std::endl;
-                    }
-                                 */
-                }
-                else if (bytesRead == 0 || (bytesRead < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
-                {
-                    // Client disconnected
-                    std::cout << "Client disconnected: " << fd << std::endl;
-                    close(fd);
-                    epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, nullptr);
-                    for (int j = 0; j < _clientCount; ++j)
-                    {
-                        if (_clientFds[j] == fd)
-                        {
-                            _clientFds[j] = 0;
-                            break;
-                        }
+                        _clientFds[j] = 0;
+                        break;
                     }
                 }
             }
@@ -162,6 +145,49 @@ void TcpServer::run()
     }
 }
 
+bool TcpServer::drainClient(int fd)
+{
+    // edge triggered: read until the socket is empty, a forwarder writes many messages per send
+    std::vector<char>& pending = _pending[fd];
+    std::array<char, 4096> chunk;
+
+    for (;;)
+    {
+        const ssize_t bytesRead = recv(fd, chunk.data(), chunk.size(), 0);
+        if (bytesRead == 0)
+        {
+            return false;
+        }
+
+        if (bytesRead < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        pending.insert(pending.end(), chunk.data(), chunk.data() + bytesRead);
+
+        // a message split over two reads stays pending until its last byte arrives
+        size_t offset = 0;
+        for (; offset + sizeof(Message) <= pending.size(); offset += sizeof(Message))
+        {
+            Message receivedMessage;
+            deserializeMessage(pending.data() + offset, receivedMessage);
+            logAsync<RECEIVED>(receivedMessage.MessageType, receivedMessage.MessageId, receivedMessage.MessageData);
+            if (receivedMessage.MessageData == 10)
+            {
+                logAsync<FORWARDED>(receivedMessage.MessageSize, receivedMessage.MessageType,
+                    receivedMessage.MessageId, receivedMessage.MessageData);
+            }
+        }
+
+        pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(offset));
+    }
+}
+
 void TcpServer::closeClients()
 {
     for (int i = 0; i < _clientCount; ++i)
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <message.hpp>
+#include <serializer.hpp>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/// @brief Preallocated receive buffers for recvmmsg, one datagram of sizeof(Message) bytes per slot
+/// The iovecs and message headers point into the buffers once, a receive only resets the lengths.
+/// @tparam N datagrams per recvmmsg call
+template <size_t N> class DatagramBatch
+{
+    static_assert(N > 0, "A batch holds at least one datagram");
+
+    std::array<std::array<char, sizeof(Message)>, N> _buffers{};
+    std::array<iovec, N> _iovecs{};
+    std::array<mmsghdr, N> _headers{};
+
+  public:
+    DatagramBatch()
+    {
+        for (size_t i = 0; i < N; ++i)
+        {
+            _iovecs[i].iov_base = _buffers[i].data();
+            _iovecs[i].iov_len = _buffers[i].size();
+            _headers[i].msg_hdr.msg_iov = &_iovecs[i];
+            _headers[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+
+    DatagramBatch(const DatagramBatch&) = delete;
+    DatagramBatch& operator=(const DatagramBatch&) = delete;
+
+    /// @brief Take up to N queued datagrams without blocking
+    /// @return number of datagrams, 0 if none was queued, -1 on error (errno is set)
+    int receive(int sockfd)
+    {
+        const int received = recvmmsg(sockfd, _headers.data(), N, MSG_DONTWAIT, nullptr);
+        if (received < 0)
+        {
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        return received;
+    }
+
+    /// @brief Decode datagram i of the last receive
+    /// @return false if it is not exactly one serialized Message
+    bool decode(size_t i, Message& message) const
+    {
+        if (_headers[i].msg_len != sizeof(Message) || (_headers[i].msg_hdr.msg_flags & MSG_TRUNC))
+        {
+            return false;
+        }
+
+        deserializeMessage(_buffers[i].data(), message);
+        return true;
+    }
+};
+
+/// @brief Distribution of the datagrams returned per receive call, buckets are powers of two
+struct BatchStats
+{
+    static constexpr size_t BUCKETS = 17;  // [2^i, 2^(i+1)) datagrams, the last one counts larger batches too
+
+    uint64_t calls{0};  // receive calls, including the ones that found nothing
+    uint64_t empty{0};
+    uint64_t datagrams{0};
+    uint64_t malformed{0};  // datagrams that were not one Message, dropped
+    std::array<uint64_t, BUCKETS> sizes{};
+
+    void add(size_t received)
+    {
+        ++calls;
+        if (!received)
+        {
+            ++empty;
+            return;
+        }
+
+        datagrams += received;
+        ++sizes[std::min<size_t>(std::bit_width(received) - 1, BUCKETS - 1)];
+    }
+
+    double meanBatch() const
+    {
+        const uint64_t filled = calls - empty;
+        return filled ? static_cast<double>(datagrams) / static_cast<double>(filled) : 0.0;
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& out, const BatchStats& stats)
+{
+    out << "receive calls: " << stats.calls << " empty: " << stats.empty << " datagrams: " << stats.datagrams
+        << " malformed: " << stats.malformed << " mean batch: " << stats.meanBatch() << "\nbatch size:";
+    for (size_t i = 0; i < BatchStats::BUCKETS; ++i)
+    {
+        if (stats.sizes[i])
+        {
+            const size_t low = size_t{1} << i;
+            out << " " << low;
+            if (i == BatchStats::BUCKETS - 1)
+            {
+                out << "+";
+            }
+            else if (low > 1)
+            {
+                out << "-" << (low * 2 - 1);
+            }
+            out << "=" << stats.sizes[i];
+        }
+    }
+    return out << "\n";
+}
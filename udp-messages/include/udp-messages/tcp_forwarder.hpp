@@ -0,0 +1,133 @@
+#pragma once
+
+#include <message.hpp>
+#include <messages-container/queues/bounded_queue.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <ostream>
+#include <span>
+#include <thread>
+
+/// @brief Messages the receivers may queue for the forwarder before new ones are dropped
+constexpr size_t TCP_FORWARD_QUEUE = 4096;
+
+/// @brief Most messages written with one send
+constexpr size_t TCP_FORWARD_MAX_BATCH = 64;
+
+/// @brief Flush policy of TcpForwarder
+struct TcpForwarderOptions
+{
+    size_t maxBatch{TCP_FORWARD_MAX_BATCH};  // a batch this large is written at once, at most TCP_FORWARD_MAX_BATCH
+    std::chrono::microseconds maxDelay{100};  // a smaller batch waits at most this long for more messages
+};
+
+/// @brief Counters of a TcpForwarder, read while it runs they are approximate
+struct TcpForwarderStats
+{
+    static constexpr size_t BUCKETS = 8;  // batches of [2^i, 2^(i+1)) messages, the last one counts larger ones too
+
+    uint64_t forwarded{0};  // messages written to the TCP connection
+    uint64_t dropped{0};  // messages not queued because the queue was full
+    uint64_t failed{0};  // messages lost with a failed send or while the server was unreachable at stop
+    uint64_t reconnects{0};  // connections made after the first one
+    uint64_t batches{0};
+    uint64_t maxDepth{0};  // queue depth seen when a batch was taken
+    uint64_t depthSum{0};
+    std::array<uint64_t, BUCKETS> sizes{};
+
+    double meanBatch() const
+    {
+        return batches ? static_cast<double>(forwarded + failed) / static_cast<double>(batches) : 0.0;
+    }
+
+    double meanDepth() const
+    {
+        return batches ? static_cast<double>(depthSum) / static_cast<double>(batches) : 0.0;
+    }
+};
+
+std::ostream& operator<<(std::ostream& out, const TcpForwarderStats& stats);
+
+/// @brief Forwarding stage between the UDP receivers and the TCP server
+/// Receivers hand messages over through a bounded lock free MPSC queue and never block: a full queue drops the
+/// message and counts it. One thread owns the connection, takes up to maxBatch messages at a time and writes
+/// them with a single send, so messages are never interleaved on the stream and every receiver's messages
+/// arrive in the order it forwarded them. A batch smaller than maxBatch waits up to maxDelay for more, an
+/// idle forwarder sleeps until a message is queued.
+/// The forwarding thread connects on its own: while the server is unreachable it retries with a growing delay
+/// (MIN_RETRY_DELAY doubling up to MAX_RETRY_DELAY) and the receivers keep running, dropping what the queue
+/// cannot hold. A failed send closes the connection and the rest of the batch is written on a new one, from the
+/// first message the old connection did not take whole. A send the kernel accepted after the server closed the
+/// connection succeeds and its messages are lost, TCP reports the failure only to the next send.
+class TcpForwarder
+{
+  public:
+    static constexpr std::chrono::milliseconds MIN_RETRY_DELAY{10};
+    static constexpr std::chrono::milliseconds MAX_RETRY_DELAY{1000};
+
+  private:
+    using Queue = MpscQueue<Message, TCP_FORWARD_QUEUE>;
+
+    struct alignas(64) Counters
+    {
+        std::atomic<uint64_t> forwarded{0};
+        std::atomic<uint64_t> failed{0};
+        std::atomic<uint64_t> reconnects{0};
+        std::atomic<uint64_t> batches{0};
+        std::atomic<uint64_t> maxDepth{0};
+        std::atomic<uint64_t> depthSum{0};
+        std::array<std::atomic<uint64_t>, TcpForwarderStats::BUCKETS> sizes{};
+    };
+
+    const int _tcpServerPort;
+    const char* _tcpServerIp = "127.0.0.1";
+    const TcpForwarderOptions _options;
+    sockaddr_in _tcpServerAddr{};
+
+    int _tcpSockfd{-1};  // forwarding thread only, -1 while disconnected
+    bool _connected{false};  // a connection was made before, the next one counts as a reconnect
+    std::unique_ptr<Queue> _queue;
+    std::atomic<uint32_t> _signal{0};  // bumped after every enqueue, the idle forwarder waits on it
+    std::atomic<bool> _stopping{false};
+    std::atomic<uint64_t> _dropped{0};
+    Counters _counters;
+    std::mutex _stopMutex;
+    std::condition_variable _stopCv;  // cuts a retry delay short on stop
+    std::thread _thread;
+
+    void forwardLoop();
+    void send(std::span<const Message> batch);
+    bool connect();
+    void disconnect();
+
+  public:
+    explicit TcpForwarder(int tcpPort, TcpForwarderOptions options = {});
+    ~TcpForwarder();
+
+    TcpForwarder(const TcpForwarder&) = delete;
+    TcpForwarder& operator=(const TcpForwarder&) = delete;
+
+    TcpForwarder(TcpForwarder&& other) = delete;
+    TcpForwarder& operator=(TcpForwarder&& other) = delete;
+
+    /// @brief Start the forwarding thread, it connects to the TCP server and retries until the server accepts
+    void start();
+
+    /// @brief Write what is queued and stop the thread, called by the destructor as well
+    /// Without a connection one more attempt is made, messages it cannot deliver are counted as failed
+    void stop();
+
+    /// @brief Queue messages for the TCP server without blocking, callable from any number of threads
+    /// @return number of messages queued, the others were dropped
+    size_t forward(std::span<const Message> messages);
+
+    TcpForwarderStats stats() const;
+};
@@ -1,29 +1,58 @@
 #pragma once
 
-#include <messages-container/blocking/hash_map.hpp>
+#include <messages-container/message_container.hpp>
+#include <messages-container/persistence/message_log.hpp>
+
+#include "datagram_batch.hpp"
+#include "tcp_forwarder.hpp"
 
 #include <netinet/in.h>
 #include <cstddef>
 #include <optional>
+#include <span>
+
+using MessageContainerLog = MessageLog<MessageContainer>;
+
+/// @brief Datagrams drained per recvmmsg call, cmake -DUDP_RECV_BATCH=<n>; 1 reads one datagram per readiness event
+#if defined(UDP_RECV_BATCH)
+constexpr size_t UDP_BATCH_SIZE = UDP_RECV_BATCH;
+#else
+constexpr size_t UDP_BATCH_SIZE = 64;
+#endif
+
+/// @brief Per socket settings of a UdpServer
+struct UdpSocketOptions
+{
+    bool reusePort{false};  // SO_REUSEPORT: several servers bind the port, the kernel spreads flows over them
+    int incomingCpu{-1};  // SO_INCOMING_CPU: prefer flows whose packets the NIC queue of this CPU receives
+};
 
 class UdpServer
 {
   private:
-    int _tcpSockfd{};
     int _sockfd{};
     struct sockaddr_in _servaddr{};
-    const char* _tcpServerIp = "127.0.0.1";
 
-    const int _tcpServerPort;
     const int _selfPort;
 
-    HashMap<INITIAL_CAPACITY>& _map;
+    TcpForwarder& _forwarder;  // new messages with MessageData == 10 are queued here for the TCP server
+
+    MessageContainer& _map;
+    MessageContainerLog* _log;  // accepted messages are logged here when set
+    bool _logFailing{false};  // the log rejected the last batch, reported once until it recovers
+    const UdpSocketOptions _socketOptions;
+
+    DatagramBatch<UDP_BATCH_SIZE> _batch;
+    BatchStats _batchStats;
 
     std::optional<int> init();
-    void sendViaTcp(Message message);
+    void receiveOne();
+    void receiveBatches();
+    void accept(std::span<const Message> messages);
 
   public:
-    UdpServer(int tcpPort, int selfPort, HashMap<INITIAL_CAPACITY>& map);
+    UdpServer(TcpForwarder& forwarder, int selfPort, MessageContainer& map, MessageContainerLog* log = nullptr,
+        UdpSocketOptions socketOptions = {});
     ~UdpServer();
 
     UdpServer(const UdpServer&) = delete;
@@ -32,5 +61,22 @@ class UdpServer
     UdpServer(UdpServer&& other) = delete;
     UdpServer& operator=(UdpServer&& other) = delete;
 
+    /// @brief Open the UDP socket, throws if it fails
+    /// @return the UDP socket to watch for readability
+    int open();
+
+    /// @brief Receive what is queued on the UDP socket, called by the reactor when it is readable
+    void onReadable();
+
+    /// @brief Report the receive statistics, called by the reactor when it stops
+    void onStopped();
+
+    /// @brief Serve this port alone on the calling thread (a UdpReactor with one server)
     void run();
+
+    /// @brief Datagrams per receive call so far, read after run() returned
+    const BatchStats& batchStats() const
+    {
+        return _batchStats;
+    }
 };
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+class UdpServer;
+
+/// @brief epoll event loop over any number of UdpServers on one thread
+/// The thread sleeps in epoll_wait until a socket is readable or the loop is stopped through its eventfd
+/// (stop() or SIGINT), so an idle receiver costs no wakeups and the number of ports is not bound by FD_SETSIZE.
+class UdpReactor
+{
+  private:
+    int _epollFd{-1};
+    int _wakeFd{-1};
+    std::vector<UdpServer*> _servers;
+
+  public:
+    UdpReactor();
+    ~UdpReactor();
+
+    UdpReactor(const UdpReactor&) = delete;
+    UdpReactor& operator=(const UdpReactor&) = delete;
+
+    UdpReactor(UdpReactor&& other) = delete;
+    UdpReactor& operator=(UdpReactor&& other) = delete;
+
+    /// @brief Open the server's sockets and watch its UDP socket, the server must outlive the reactor
+    void add(UdpServer& server);
+
+    /// @brief Dispatch readable sockets until stop() or SIGINT
+    void run();
+
+    /// @brief Wake run() for shutdown, callable from any thread
+    void stop();
+
+    size_t servers() const
+    {
+        return _servers.size();
+    }
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "tcp_forwarder.hpp"
+#include "udp_processor.hpp"
+#include "udp_reactor.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// @brief How many receivers serve every UDP port and where they run
+struct UdpWorkerOptions
+{
+    size_t workersPerPort{1};  // more than one binds every port with SO_REUSEPORT in every worker
+    std::vector<int> cpus;  // worker i is pinned to cpus[i % cpus.size()] and its sockets get SO_INCOMING_CPU, empty: not pinned
+};
+
+/// @brief Take "--workers <n>" and "--cpus <a,b,...>" out of args, the remaining arguments keep their order
+/// @throws std::invalid_argument on a missing or bad value, or more workers than SIGINT can wake (MAX_STOP_FDS)
+UdpWorkerOptions takeWorkerOptions(std::vector<std::string>& args);
+
+/// @brief workersPerPort receiver threads, each serves every UDP port from one UdpReactor
+/// A worker opens its own socket on each port. The kernel hashes every flow to one of the SO_REUSEPORT sockets
+/// of a port, so a single hot port scales over as many cores as there are workers. Pinned workers ask for the
+/// flows their CPU receives (SO_INCOMING_CPU), a packet is then received, decoded and inserted on the core
+/// whose NIC queue took it. With one worker a single thread serves all ports.
+/// A worker whose loop ends (SIGINT, stop() or an error) stops the others too.
+/// All workers share one TcpForwarder, the only writer of the TCP connection.
+class UdpWorkerPool
+{
+  private:
+    std::vector<int> _ports;
+    TcpForwarder _forwarder;
+    MessageContainer& _map;
+    MessageContainerLog* _log;
+    UdpWorkerOptions _options;
+
+    std::mutex _reactorsMutex;
+    std::vector<std::unique_ptr<UdpReactor>> _reactors;  // one per worker while run() runs
+
+    void runWorker(UdpReactor& reactor, size_t worker, int cpu);
+
+  public:
+    UdpWorkerPool(std::vector<int> ports, int tcpPort, MessageContainer& map, MessageContainerLog* log,
+        UdpWorkerOptions options);
+
+    /// @brief Connect the forwarder, start every worker and wait until all of them stopped (SIGINT or stop())
+    void run();
+
+    /// @brief Wake every worker for shutdown, callable from any thread
+    void stop();
+
+    const TcpForwarder& forwarder() const
+    {
+        return _forwarder;
+    }
+
+    size_t workers() const
+    {
+        return _options.workersPerPort;
+    }
+};
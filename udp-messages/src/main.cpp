@@ -1,6 +1,8 @@
 #include "udp-messages/udp_processor.hpp"
+#include "udp-messages/udp_workers.hpp"
 
 #include <serializer.hpp>
+#include <common/async_log.hpp>
 #include <common/signal_handler.hpp>
 
 #include <arpa/inet.h>
@@ -8,6 +10,7 @@
 #include <cstring>
 #include <fcntl.h>
 #include <iostream>
+#include <string>
 #include <stdexcept>
 #include <sys/socket.h>
 #include <thread>
@@ -15,34 +18,47 @@
 #include <csignal>
 #include <fstream>
 #include <mutex>
+#include <vector>
 
 int main(int argc, char* argv[])
 {
-    if (argc != 4)
+    std::vector<std::string> args(argv + 1, argv + argc);
+    UdpWorkerOptions workerOptions;
+    try
     {
-        std::cerr << "Usage: " << argv[0] << "<UDP_PORT_1> <UDP_PORT_2> <TCP_PORT> " << std::endl;
+        workerOptions = takeWorkerOptions(args);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        args.clear();
+    }
+
+    if (args.size() < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " [--workers <per port>] [--cpus <a,b,...>] <UDP_PORT>... <TCP_PORT>"
+                  << std::endl;
         return 1;
     }
 
-    int udpPort1 = std::stoi(argv[1]);
-    int udpPort2 = std::stoi(argv[2]);
-    int tcpPort = std::stoi(argv[3]);
+    int tcpPort = std::stoi(args.back());
 
-    HashMap<INITIAL_CAPACITY> messageMap;
+    std::vector<int> udpPorts;
+    for (size_t i = 0; i + 1 < args.size(); ++i)
+    {
+        udpPorts.push_back(std::stoi(args[i]));
+    }
 
-    UdpServer udpProcessor1(tcpPort, udpPort1, messageMap);
-    UdpServer udpProcessor2(tcpPort, udpPort2, messageMap);
+    MessageContainer messageMap;
 
     setupSignalHandler();
 
-    std::thread udpThread1(&UdpServer::run, &udpProcessor1);
-
-    udpProcessor2.run();
+    // forwarded messages are traced here when built with COMMON_LOG_LEVEL=trace
+    AsyncLogger::instance().traceTo("udp_messages.log");
 
-    if (udpThread1.joinable())
-    {
-        udpThread1.join();
-    }
+    // every worker sleeps in its own event loop until a datagram or SIGINT arrives
+    UdpWorkerPool workers(udpPorts, tcpPort, messageMap, nullptr, workerOptions);
+    workers.run();
 
     return 0;
 }
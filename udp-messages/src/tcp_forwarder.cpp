@@ -0,0 +1,279 @@
+#include "udp-messages/tcp_forwarder.hpp"
+
+#include <serializer.hpp>
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+std::ostream& operator<<(std::ostream& out, const TcpForwarderStats& stats)
+{
+    out << "forwarded: " << stats.forwarded << " dropped: " << stats.dropped << " failed: " << stats.failed
+        << " reconnects: " << stats.reconnects << " batches: " << stats.batches << " mean batch: " << stats.meanBatch()
+        << " queue depth mean: " << stats.meanDepth() << " max: " << stats.maxDepth << "\nbatch size:";
+    for (size_t i = 0; i < TcpForwarderStats::BUCKETS; ++i)
+    {
+        if (stats.sizes[i])
+        {
+            const size_t low = size_t{1} << i;
+            out << " " << low;
+            if (i == TcpForwarderStats::BUCKETS - 1)
+            {
+                out << "+";
+            }
+            else if (low > 1)
+            {
+                out << "-" << (low * 2 - 1);
+            }
+            out << "=" << stats.sizes[i];
+        }
+    }
+    return out << "\n";
+}
+
+TcpForwarder::TcpForwarder(int tcpPort, TcpForwarderOptions options)
+    : _tcpServerPort(tcpPort)
+    , _options{std::clamp<size_t>(options.maxBatch, 1, TCP_FORWARD_MAX_BATCH), options.maxDelay}
+    , _queue(std::make_unique<Queue>())
+{
+    if (tcpPort < 0 || tcpPort > 65535)
+    {
+        throw std::invalid_argument("Invalid port number");
+    }
+
+    _tcpServerAddr.sin_family = AF_INET;
+    _tcpServerAddr.sin_port = htons(_tcpServerPort);
+
+    if (inet_pton(AF_INET, _tcpServerIp, &_tcpServerAddr.sin_addr) <= 0)
+    {
+        throw std::invalid_argument("Invalid TCP server address");
+    }
+}
+
+TcpForwarder::~TcpForwarder()
+{
+    stop();
+    disconnect();
+}
+
+void TcpForwarder::start()
+{
+    _thread = std::thread(&TcpForwarder::forwardLoop, this);
+}
+
+void TcpForwarder::stop()
+{
+    if (!_thread.joinable())
+    {
+        return;
+    }
+
+    {
+        // under the lock, so a forwarder between its stop check and its retry wait is not missed
+        std::lock_guard<std::mutex> lock(_stopMutex);
+        _stopping.store(true, std::memory_order_release);
+    }
+    _stopCv.notify_one();
+    _signal.fetch_add(1, std::memory_order_release);
+    _signal.notify_one();
+    _thread.join();
+
+    std::cout << "TCP forwarder stopped: " << stats();
+}
+
+size_t TcpForwarder::forward(std::span<const Message> messages)
+{
+    if (messages.empty())
+    {
+        return 0;
+    }
+
+    const size_t queued = _queue->push_n(messages);
+    if (queued < messages.size())
+    {
+        _dropped.fetch_add(messages.size() - queued, std::memory_order_relaxed);
+    }
+
+    if (queued)
+    {
+        // the increment follows the push, a forwarder that saw the old value finds the messages or is woken
+        _signal.fetch_add(1, std::memory_order_release);
+        _signal.notify_one();
+    }
+    return queued;
+}
+
+void TcpForwarder::forwardLoop()
+{
+    std::array<Message, TCP_FORWARD_MAX_BATCH> batch;
+    size_t count = 0;
+    std::chrono::steady_clock::time_point deadline;
+
+    for (;;)
+    {
+        const uint32_t seen = _signal.load(std::memory_order_acquire);
+        const size_t depth = _queue->size();
+        count += _queue->pop_n(std::span<Message>(batch.data() + count, _options.maxBatch - count));
+
+        const bool stopping = _stopping.load(std::memory_order_acquire);
+        if (!count)
+        {
+            if (stopping)
+            {
+                return;
+            }
+
+            _signal.wait(seen, std::memory_order_acquire);
+            continue;
+        }
+
+        // a partial batch waits for more until the deadline set when its first message was taken
+        if (count < _options.maxBatch && !stopping)
+        {
+            const auto now = std::chrono::steady_clock::now();
+            if (deadline == std::chrono::steady_clock::time_point{})
+            {
+                deadline = now + _options.maxDelay;
+            }
+
+            if (now < deadline)
+            {
+                std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(deadline - now, _options.maxDelay / 4));
+                continue;
+            }
+        }
+
+        _counters.depthSum.fetch_add(depth, std::memory_order_relaxed);
+        if (depth > _counters.maxDepth.load(std::memory_order_relaxed))
+        {
+            _counters.maxDepth.store(depth, std::memory_order_relaxed);
+        }
+
+        send(std::span<const Message>(batch.data(), count));
+        count = 0;
+        deadline = {};
+    }
+}
+
+void TcpForwarder::send(std::span<const Message> batch)
+{
+    std::array<char, TCP_FORWARD_MAX_BATCH * sizeof(Message)> buffer;
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+        serializeMessage(batch[i], buffer.data() + i * sizeof(Message));
+    }
+
+    const size_t size = batch.size() * sizeof(Message);
+    size_t sent = 0;
+    while (sent < size)
+    {
+        if (_tcpSockfd < 0 && !connect())
+        {
+            break;
+        }
+
+        const ssize_t n = ::send(_tcpSockfd, buffer.data() + sent, size - sent, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            std::cerr << "Failed to send messages via TCP: " << strerror(errno) << ", reconnecting" << std::endl;
+            disconnect();
+
+            // the server drops a partial message with its connection, the new one starts at a message boundary
+            sent -= sent % sizeof(Message);
+            continue;
+        }
+        sent += static_cast<size_t>(n);
+    }
+
+    // a message is forwarded once all of its bytes are written
+    const uint64_t forwarded = sent / sizeof(Message);
+    _counters.forwarded.fetch_add(forwarded, std::memory_order_relaxed);
+    _counters.failed.fetch_add(batch.size() - forwarded, std::memory_order_relaxed);
+    _counters.batches.fetch_add(1, std::memory_order_relaxed);
+    _counters.sizes[std::min<size_t>(std::bit_width(batch.size()) - 1, TcpForwarderStats::BUCKETS - 1)].fetch_add(
+        1, std::memory_order_relaxed);
+}
+
+bool TcpForwarder::connect()
+{
+    auto delay = MIN_RETRY_DELAY;
+    bool reported = false;
+
+    for (;;)
+    {
+        const int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0 && ::connect(fd, reinterpret_cast<const sockaddr*>(&_tcpServerAddr), sizeof(_tcpServerAddr)) == 0)
+        {
+            _tcpSockfd = fd;
+            if (_connected)
+            {
+                _counters.reconnects.fetch_add(1, std::memory_order_relaxed);
+            }
+            _connected = true;
+
+            if (reported)
+            {
+                std::cout << "TCP connection to port " << _tcpServerPort << " established" << std::endl;
+            }
+            return true;
+        }
+
+        const int error = errno;
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+
+        // one line per outage, not one per attempt
+        if (!reported)
+        {
+            std::cerr << "TCP connection failed: " << strerror(error) << ", retrying" << std::endl;
+            reported = true;
+        }
+
+        std::unique_lock<std::mutex> lock(_stopMutex);
+        if (_stopCv.wait_for(lock, delay, [&] { return _stopping.load(std::memory_order_acquire); }))
+        {
+            return false;
+        }
+        delay = std::min(delay * 2, MAX_RETRY_DELAY);
+    }
+}
+
+void TcpForwarder::disconnect()
+{
+    if (_tcpSockfd >= 0)
+    {
+        close(_tcpSockfd);
+        _tcpSockfd = -1;
+    }
+}
+
+TcpForwarderStats TcpForwarder::stats() const
+{
+    TcpForwarderStats stats;
+    stats.forwarded = _counters.forwarded.load(std::memory_order_relaxed);
+    stats.dropped = _dropped.load(std::memory_order_relaxed);
+    stats.failed = _counters.failed.load(std::memory_order_relaxed);
+    stats.reconnects = _counters.reconnects.load(std::memory_order_relaxed);
+    stats.batches = _counters.batches.load(std::memory_order_relaxed);
+    stats.maxDepth = _counters.maxDepth.load(std::memory_order_relaxed);
+    stats.depthSum = _counters.depthSum.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < TcpForwarderStats::BUCKETS; ++i)
+    {
+        stats.sizes[i] = _counters.sizes[i].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
@@ -1,42 +1,45 @@
 #include "udp-messages/udp_processor.hpp"
+#include "udp-messages/udp_reactor.hpp"
 
 #include <serializer.hpp>
+#include <common/async_log.hpp>
 #include <common/signal_handler.hpp>
 
 #include <arpa/inet.h>
+#include <array>
 #include <atomic>
+#include <bitset>
+#include <cerrno>
 #include <cstring>
 #include <fcntl.h>
 #include <iostream>
 #include <stdexcept>
 #include <sys/socket.h>
+#include <system_error>
 #include <thread>
+#include <utility>
 #include <unistd.h>
 #include <csignal>
-#include <fstream>
-#include <mutex>
-
 
 namespace
 {
 
-std::mutex file_mutex;
+constexpr LogFormat RECEIVED{LogLevel::Debug, LogSink::Console, "Received message: Type={}, Id={}, Data={}"};
+constexpr LogFormat FORWARDED{LogLevel::Trace, LogSink::TraceFile, "Size: {} Type: {} ID: {} Data: {}"};
 
 }  // namespace
 
-UdpServer::UdpServer(int tcpPort, int selfPort, HashMap<INITIAL_CAPACITY>& map)
-    : _tcpServerPort(tcpPort)
-    , _selfPort(selfPort)
+UdpServer::UdpServer(TcpForwarder& forwarder, int selfPort, MessageContainer& map, MessageContainerLog* log,
+    UdpSocketOptions socketOptions)
+    : _selfPort(selfPort)
+    , _forwarder(forwarder)
     , _map(map)
+    , _log(log)
+    , _socketOptions(socketOptions)
 {
-    const std::array<int, 3> temp = {_tcpServerPort, _selfPort};
-
-    for (const auto port : temp)
+    if (_selfPort < 0 || _selfPort > 65535)
     {
-        if (port < 0 || port > 65535)
-        {
-            throw std::invalid_argument("Invalid port number");
-        }
+        throw std::invalid_argument("Invalid port number");
     }
 }
 
@@ -44,11 +47,6 @@ UdpServer::~UdpServer()
 {
     _running.store(false, std::memory_order_release);
 
-    if (_tcpSockfd > 0)
-    {
-        close(_tcpSockfd);
-    }
-
     if (_sockfd > 0)
     {
         close(_sockfd);
@@ -77,6 +75,20 @@ std::optional<int> UdpServer::init()
         return std::nullopt;
     }
 
+    const int enable = 1;
+    if (_socketOptions.reusePort && setsockopt(_sockfd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0)
+    {
+        std::cerr << "Failed to set SO_REUSEPORT: " << strerror(errno) << std::endl;
+        return std::nullopt;
+    }
+
+    // only a preference, a kernel without it still delivers to the socket
+    if (_socketOptions.incomingCpu >= 0 &&
+        setsockopt(_sockfd, SOL_SOCKET, SO_INCOMING_CPU, &_socketOptions.incomingCpu, sizeof(int)) < 0)
+    {
+        std::cerr << "Failed to set SO_INCOMING_CPU: " << strerror(errno) << std::endl;
+    }
+
     memset(&_servaddr, 0, sizeof(_servaddr));
 
     _servaddr.sin_family = AF_INET;
@@ -89,107 +101,147 @@ std::optional<int> UdpServer::init()
         return std::nullopt;
     }
 
-    // open and setup tcp socket:
-    struct sockaddr_in tcpserverAddr{};
+    return _sockfd;  // return udp sock
+}
 
-    if ((_tcpSockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+int UdpServer::open()
+{
+    if (!init())
     {
-        std::cerr << "TCP socket creation failed" << std::endl;
-        return std::nullopt;
+        throw std::runtime_error("Failed to create UDP socket");
     }
 
-    memset(&tcpserverAddr, 0, sizeof(tcpserverAddr));
-    tcpserverAddr.sin_family = AF_INET;
-    tcpserverAddr.sin_port = htons(_tcpServerPort);
+    std::cout << "UDP server started on port " << _selfPort << std::endl;
+    return _sockfd;
+}
 
-    if (inet_pton(AF_INET, _tcpServerIp, &tcpserverAddr.sin_addr) <= 0)
+void UdpServer::onReadable()
+{
+    if constexpr (UDP_BATCH_SIZE > 1)
     {
-        std::cerr << "Invalid TCP server address" << std::endl;
-        return std::nullopt;
+        receiveBatches();
     }
-
-    if (connect(_tcpSockfd, (struct sockaddr*)&tcpserverAddr, sizeof(tcpserverAddr)) < 0)
+    else
     {
-        std::cerr << "TCP connection failed" << std::endl;
-        return std::nullopt;
+        receiveOne();
     }
-
-    return _sockfd;  // return udp sock
 }
 
-void UdpServer::run()
+void UdpServer::onStopped()
 {
-    if (!init())
+    AsyncLogger::instance().flush();
+    std::cout << "UDP server stopped" << std::endl;
+    if constexpr (UDP_BATCH_SIZE > 1)
     {
-        throw std::runtime_error("Failed to create UDP socket");
+        std::cout << "UDP " << _selfPort << " recvmmsg batches of up to " << UDP_BATCH_SIZE << ": " << _batchStats;
     }
+}
 
-    std::cout << "UDP server started on port " << _selfPort << std::endl;
+void UdpServer::run()
+{
+    UdpReactor reactor;
+    reactor.add(*this);
+    reactor.run();
+}
 
-    fd_set read_fds{};
-    struct timeval timeout{};
+void UdpServer::receiveOne()
+{
+    // one datagram is one message, MSG_TRUNC reports the real length of a larger one
+    char buffer[sizeof(Message)];
+    const ssize_t n = recv(_sockfd, buffer, sizeof(buffer), MSG_DONTWAIT | MSG_TRUNC);
 
-    while (_running.load(std::memory_order_acquire))
+    if (n == static_cast<ssize_t>(sizeof(Message)))
     {
-        FD_ZERO(&read_fds);
-        FD_SET(_sockfd, &read_fds);
+        Message receivedMessage;
+        deserializeMessage(buffer, receivedMessage);
+        logAsync<RECEIVED>(receivedMessage.MessageType, receivedMessage.MessageId, receivedMessage.MessageData);
 
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 500;
+        accept(std::span<const Message>(&receivedMessage, 1));
+    }
+    else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+        std::cerr << "recv failed: " << strerror(errno) << std::endl;
+    }
+}
 
-        int activity{select(_sockfd + 1, &read_fds, nullptr, nullptr, &timeout)};
-        if (activity < 0)
+void UdpServer::receiveBatches()
+{
+    std::array<Message, UDP_BATCH_SIZE> messages;
+
+    // drain the socket: a short batch means the receive queue is empty
+    for (;;)
+    {
+        const int received = _batch.receive(_sockfd);
+        if (received < 0)
         {
-            std::cerr << "select failed: " << strerror(errno) << std::endl;
-            break;
+            std::cerr << "recvmmsg failed: " << strerror(errno) << std::endl;
+            return;
         }
-        else if (activity == 0)
+
+        _batchStats.add(static_cast<size_t>(received));
+
+        size_t count = 0;
+        for (size_t i = 0; i < static_cast<size_t>(received); ++i)
         {
-            // Timeout occurred, no data available
-            continue;
+            if (!_batch.decode(i, messages[count]))
+            {
+                ++_batchStats.malformed;
+                continue;
+            }
+
+            const Message& message = messages[count++];
+            logAsync<RECEIVED>(message.MessageType, message.MessageId, message.MessageData);
         }
 
-        if (FD_ISSET(_sockfd, &read_fds))
+        accept(std::span<const Message>(messages.data(), count));
+
+        if (static_cast<size_t>(received) < UDP_BATCH_SIZE)
         {
-            Message receivedMessage{};
-            int n = receiveMessage(_sockfd, receivedMessage);
+            return;
+        }
+    }
+}
 
-            if (n == sizeof(receivedMessage))
+void UdpServer::accept(std::span<const Message> messages)
+{
+    std::bitset<UDP_BATCH_SIZE> inserted;
+    if (_log)
+    {
+        try
+        {
+            for (size_t i = 0; i < messages.size(); ++i)
             {
-                std::cout << "Received message: Type=" << static_cast<int>(receivedMessage.MessageType)
-                          << ", Id=" << receivedMessage.MessageId << ", Data=" << receivedMessage.MessageData
-                          << std::endl;
-
-                _map.insert(receivedMessage);  // duplicates are managed inside container
-
-                // If MessageData equals 10, send it via TCP asynchronously
-                if (receivedMessage.MessageData == 10)
-                {
-                    /*
-                    std::lock_guard<std::mutex> lock(file_mutex);
-                    std::ofstream log_file("udp_messaages.log", std::ios::app);
-                    log_file << "Size: " << receivedMessage.MessageSize << " Type: " << receivedMessage.MessageType << " ID: " << receivedMessage.MessageId
-                             << " Data: " << receivedMessage.MessageData << std::endl;
-
-                             */
-                    std::jthread(&UdpServer::sendViaTcp, this, receivedMessage).detach();
-                }
+                inserted[i] = _log->insert(messages[i]);
             }
-            else if (n < 0)
+            _logFailing = false;
+        }
+        catch (const std::system_error& e)
+        {
+            // the rest of the batch is not accepted, a retransmission is once the log can be written again
+            if (!std::exchange(_logFailing, true))
             {
-                std::cerr << "recvfrom failed: " << strerror(errno) << std::endl;
+                std::cerr << "UDP " << _selfPort << ": " << e.what() << ", messages are rejected" << std::endl;
             }
         }
     }
+    else
+    {
+        // duplicates are managed inside container, only a new message is forwarded
+        _map.insertBatch(messages, inserted);
+    }
 
-    std::cout << "UDP server stopped" << std::endl;
-}
-
-void UdpServer::sendViaTcp(Message message)
-{
-    int n = sendMessage(_tcpSockfd, message);
-    if (n < 0)
+    // new messages with MessageData == 10 go to the TCP server, in order, through the forwarder queue
+    std::array<Message, UDP_BATCH_SIZE> forwarded;
+    size_t count = 0;
+    for (size_t i = 0; i < messages.size(); ++i)
     {
-        std::cerr << "Failed to send message via TCP" << std::endl;
+        if (inserted[i] && messages[i].MessageData == 10)
+        {
+            forwarded[count++] = messages[i];
+            logAsync<FORWARDED>(
+                messages[i].MessageSize, messages[i].MessageType, messages[i].MessageId, messages[i].MessageData);
+        }
     }
+
+    _forwarder.forward(std::span<const Message>(forwarded.data(), count));
 }
@@ -0,0 +1,130 @@
+#include "udp-messages/udp_reactor.hpp"
+#include "udp-messages/udp_processor.hpp"
+
+#include <common/signal_handler.hpp>
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace
+{
+
+constexpr int MAX_EVENTS = 64;
+
+}  // namespace
+
+UdpReactor::UdpReactor()
+{
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (_epollFd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(), "UdpReactor: epoll_create1 failed");
+    }
+
+    _wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_wakeFd < 0)
+    {
+        const int error = errno;
+        close(_epollFd);
+        throw std::system_error(error, std::generic_category(), "UdpReactor: eventfd failed");
+    }
+
+    // the wake descriptor is the only one registered without a server
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, _wakeFd, &event) < 0)
+    {
+        const int error = errno;
+        close(_wakeFd);
+        close(_epollFd);
+        throw std::system_error(error, std::generic_category(), "UdpReactor: cannot watch the eventfd");
+    }
+
+    if (!notifyOnStop(_wakeFd))
+    {
+        std::cerr << "UdpReactor: too many event loops for SIGINT, stop() has to be called" << std::endl;
+    }
+}
+
+UdpReactor::~UdpReactor()
+{
+    forgetOnStop(_wakeFd);
+    close(_wakeFd);
+    close(_epollFd);
+}
+
+void UdpReactor::add(UdpServer& server)
+{
+    const int fd = server.open();
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = &server;
+    if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &event) < 0)
+    {
+        throw std::system_error(errno, std::generic_category(), "UdpReactor: cannot watch the UDP socket");
+    }
+
+    _servers.push_back(&server);
+}
+
+void UdpReactor::run()
+{
+    std::array<epoll_event, MAX_EVENTS> events;
+
+    // a SIGINT before the eventfd was registered only cleared the flag
+    while (_running.load(std::memory_order_acquire))
+    {
+        const int ready = epoll_wait(_epollFd, events.data(), MAX_EVENTS, -1);
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            std::cerr << "epoll_wait failed: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        bool stopped = false;
+        for (int i = 0; i < ready; ++i)
+        {
+            if (!events[i].data.ptr)
+            {
+                stopped = true;
+                continue;
+            }
+
+            static_cast<UdpServer*>(events[i].data.ptr)->onReadable();
+        }
+
+        if (stopped)
+        {
+            break;
+        }
+    }
+
+    for (UdpServer* server : _servers)
+    {
+        server->onStopped();
+    }
+}
+
+void UdpReactor::stop()
+{
+    const uint64_t one = 1;
+    if (write(_wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    {
+        std::cerr << "UdpReactor: cannot wake the event loop: " << strerror(errno) << std::endl;
+    }
+}
@@ -0,0 +1,151 @@
+#include "udp-messages/udp_workers.hpp"
+#include "udp-messages/udp_reactor.hpp"
+
+#include <common/signal_handler.hpp>
+
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <pthread.h>
+#include <sched.h>
+
+UdpWorkerOptions takeWorkerOptions(std::vector<std::string>& args)
+{
+    UdpWorkerOptions options;
+    std::vector<std::string> rest;
+
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        if (args[i] != "--workers" && args[i] != "--cpus")
+        {
+            rest.push_back(args[i]);
+            continue;
+        }
+
+        if (i + 1 == args.size())
+        {
+            throw std::invalid_argument(args[i] + " needs a value");
+        }
+
+        if (args[i] == "--workers")
+        {
+            options.workersPerPort = std::stoul(args[++i]);
+            if (!options.workersPerPort || options.workersPerPort > MAX_STOP_FDS)
+            {
+                throw std::invalid_argument("--workers must be in [1, " + std::to_string(MAX_STOP_FDS) + "]");
+            }
+        }
+        else
+        {
+            std::istringstream cpus(args[++i]);
+            for (std::string cpu; std::getline(cpus, cpu, ',');)
+            {
+                options.cpus.push_back(std::stoi(cpu));
+            }
+        }
+    }
+
+    args = std::move(rest);
+    return options;
+}
+
+UdpWorkerPool::UdpWorkerPool(
+    std::vector<int> ports, int tcpPort, MessageContainer& map, MessageContainerLog* log, UdpWorkerOptions options)
+    : _ports(std::move(ports))
+    , _forwarder(tcpPort)
+    , _map(map)
+    , _log(log)
+    , _options(std::move(options))
+{
+}
+
+void UdpWorkerPool::runWorker(UdpReactor& reactor, size_t worker, int cpu)
+{
+    if (cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+
+        const int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (error)
+        {
+            std::cerr << "UDP worker " << worker << ": cannot pin to CPU " << cpu << ": " << strerror(error)
+                      << std::endl;
+        }
+    }
+
+    // servers are created on the worker, after pinning, so SO_INCOMING_CPU names the CPU it runs on
+    const UdpSocketOptions socketOptions{_options.workersPerPort > 1, cpu};
+    std::vector<std::unique_ptr<UdpServer>> servers;
+    for (int port : _ports)
+    {
+        try
+        {
+            auto server = std::make_unique<UdpServer>(_forwarder, port, _map, _log, socketOptions);
+            reactor.add(*server);
+            servers.push_back(std::move(server));
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "UDP worker " << worker << " on port " << port << " failed: " << e.what() << std::endl;
+        }
+    }
+
+    if (!servers.empty())
+    {
+        reactor.run();
+    }
+
+    // the first loop to end takes the whole pool down, SIGINT may not reach every reactor
+    stop();
+}
+
+void UdpWorkerPool::run()
+{
+    _forwarder.start();
+
+    {
+        std::lock_guard<std::mutex> lock(_reactorsMutex);
+        for (size_t w = 0; w < _options.workersPerPort; ++w)
+        {
+            _reactors.push_back(std::make_unique<UdpReactor>());
+        }
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < _reactors.size(); ++w)
+    {
+        const int cpu = _options.cpus.empty() ? -1 : _options.cpus[w % _options.cpus.size()];
+        threads.emplace_back(&UdpWorkerPool::runWorker, this, std::ref(*_reactors[w]), w, cpu);
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_reactorsMutex);
+        _reactors.clear();
+    }
+
+    // writes what the workers queued before they stopped
+    _forwarder.stop();
+}
+
+void UdpWorkerPool::stop()
+{
+    std::lock_guard<std::mutex> lock(_reactorsMutex);
+    for (auto& reactor : _reactors)
+    {
+        reactor->stop();
+    }
+}